@@ -1,11 +1,20 @@
 // drivers/irq.c - タイマー・キーボード割り込み処理
 #include "../include/kernel/idt.h"
 #include "../include/kernel/proc.h"
+#include "../include/kernel/gdt.h"
+#include "../include/kernel/apic.h"
+#include "../include/kernel/fpu.h"
 #include "../include/kernel/mm.h"
+#include "../include/kernel/vma.h"
+#include "../include/kernel/irqflags.h"
 #include "../include/kernel/types.h"
+#include "../include/kernel/timer.h"
 
 extern void keyboard_handler();
-extern void scheduler_tick(void);
+extern void scheduler_tick(int user_tick);
+extern void sched_irq_exit(void);
+extern void irq_exit(void);
+extern int  in_softirq(void);
 
 // PIC EOI
 static inline void pic_eoi(int irq) {
@@ -20,21 +29,46 @@ static inline uint8_t inb(uint16_t port) {
     return v;
 }
 
+extern void tick_nohz_irq(void);
+
 void irq_handler(regs_t* r) {
     int irq = r->int_no - 32;
 
+    // tick を止めた idle を割り込んだなら、ハンドラが何か起こす前に周期 tick に戻す
+    if (irq != 0) tick_irq_enter();
+
     switch (irq) {
-    case 0: // タイマー (100Hz)
-        scheduler_tick();
+    case 0: // タイマー (100Hz, BSP のみ)
+        tick_nohz_irq();
+        do_timer();
+        scheduler_tick((r->cs & 3) == 3);
         break;
     case 1: // キーボード
         keyboard_handler();
         break;
+    case LAPIC_TIMER_VECTOR - 32: // AP の周期 tick
+        scheduler_tick((r->cs & 3) == 3);
+        break;
+    case RESCHED_VECTOR - 32:     // need_resched は送り手が立てている
+        break;
+    case TLB_FLUSH_VECTOR - 32:
+        smp_tlb_flush_ipi();
+        break;
     default:
         break;
     }
 
-    pic_eoi(irq);
+    if (r->int_no >= LAPIC_TIMER_VECTOR) lapic_eoi();
+    else pic_eoi(irq);
+
+    // ソフト割り込み処理中に入れ子で来た割り込みは、ここで何もせず戻る
+    if (in_softirq()) return;
+
+    // 後半処理 (割り込み許可で実行)
+    irq_exit();
+
+    // EOI 後にプリエンプション (切り替え先が次の割り込みを受けられるように)
+    sched_irq_exit();
 }
 
 // 例外ハンドラ
@@ -65,22 +99,27 @@ extern void kprintf(const char* fmt, ...);
 extern void serial_puts(const char* s);
 extern void tty_puts(const char* s);
 
-// CoW (Copy-on-Write) ページフォルト処理
-
-
+// ページフォルト: ユーザー空間なら VMA を見てページを用意する (遅延マップ・CoW)
 static void handle_page_fault(regs_t* r) {
     uint32_t cr2;
     asm volatile("mov %%cr2, %0" : "=r"(cr2));
 
-    // CoWチェック (簡易)
-    // err_code bit1=0 → read fault, bit1=1 → write fault
-    // bit0=0 → not present, bit0=1 → protection violation
-    if ((r->err_code & 3) == 3) {
-        // 書き込み保護違反 → CoW処理
-        // ページをコピーして再マップ (簡易: カーネルではシンプルに死ぬ)
+    // ファイルを読んで眠ることがあるので、割り込み許可で来たなら許可に戻す
+    if (r->eflags & EFLAGS_IF) local_irq_enable();
+    if (vmm_handle_fault(cr2, r->err_code) == 0) return;
+
+    // ユーザーの不正アクセス (システムコールに渡された不正ポインタも) はプロセスだけ殺す
+    if (current_proc && current_proc->mm &&
+        ((r->cs & 3) == 3 || (cr2 >= USER_SPACE_START && cr2 < USER_SPACE_END))) {
+        kprintf("%s[%d]: segfault at 0x%x eip 0x%x error %d\n",
+                current_proc->name, current_proc->pid, cr2, r->eip, r->err_code);
+        proc_exit(128 + SIGSEGV);
     }
 
-    tty_puts("\n*** KERNEL PANIC: Page Fault ***\n");
+    if (kstack_is_guard(cr2))
+        tty_puts("\n*** KERNEL PANIC: kernel stack overflow ***\n");
+    else
+        tty_puts("\n*** KERNEL PANIC: Page Fault ***\n");
     kprintf("  Address: 0x%x  EIP: 0x%x  Error: 0x%x\n", cr2, r->eip, r->err_code);
     if (current_proc) {
         kprintf("  Process: %s (pid %d)\n", current_proc->name, current_proc->pid);
@@ -88,11 +127,45 @@ static void handle_page_fault(regs_t* r) {
     asm volatile("cli; hlt");
 }
 
+// ダブルフォルト (タスクゲートで df_stack 上に入る)
+static uint8_t df_stack[4096] __attribute__((aligned(16)));
+
+static void double_fault_task(void) {
+    uint32_t esp = gdt_faulting_esp();
+    if (kstack_is_guard(esp))
+        tty_puts("\n*** KERNEL PANIC: kernel stack overflow ***\n");
+    else
+        tty_puts("\n*** KERNEL PANIC: Double fault ***\n");
+    kprintf("  ESP: 0x%x\n", esp);
+    if (current_proc)
+        kprintf("  Process: %s (pid %d)\n", current_proc->name, current_proc->pid);
+    while (1) asm volatile("cli; hlt");
+}
+
+void df_init(void) {
+    gdt_install_df_task((uint32_t)double_fault_task, (uint32_t)&df_stack[sizeof(df_stack)]);
+    idt_set_gate(8, 0, 0x30, 0x85);   // タスクゲート
+}
+
 void isr_handler(regs_t* r) {
     if (r->int_no == 14) {
         handle_page_fault(r);
         return;
     }
+    if (r->int_no == 7) {   // Device not available: FPU の遅延切り替え
+        fpu_nm_trap();
+        return;
+    }
+
+    // ユーザーモードの例外はそのプロセスを終わらせる
+    if (r->int_no < 20 && (r->cs & 3) == 3) {
+        int sig = SIGSEGV;
+        if (r->int_no == 0 || r->int_no == 16 || r->int_no == 19) sig = SIGFPE;
+        else if (r->int_no == 6) sig = SIGILL;
+        kprintf("%s[%d]: %s at eip 0x%x\n", current_proc->name, current_proc->pid,
+                exception_msgs[r->int_no], r->eip);
+        proc_exit(128 + sig);
+    }
 
     if (r->int_no < 20) {
         tty_puts("\n*** EXCEPTION: ");
@@ -107,8 +180,23 @@ void isr_handler(regs_t* r) {
 
 void pit_init(void) {
     // PIT チャンネル0, 100Hz = 1193180 / 100 = 11931
-    uint32_t divisor = 1193180 / 100;
+    uint32_t divisor = 1193180 / HZ;
     asm volatile("outb %0, %1" :: "a"((uint8_t)0x36), "d"((uint16_t)0x43));
     asm volatile("outb %0, %1" :: "a"((uint8_t)(divisor & 0xFF)), "d"((uint16_t)0x40));
     asm volatile("outb %0, %1" :: "a"((uint8_t)((divisor >> 8) & 0xFF)), "d"((uint16_t)0x40));
 }
+
+// ワンショット (モード0): count 経過後に1回だけ IRQ0
+void pit_set_oneshot(uint16_t count) {
+    asm volatile("outb %0, %1" :: "a"((uint8_t)0x30), "d"((uint16_t)0x43));
+    asm volatile("outb %0, %1" :: "a"((uint8_t)(count & 0xFF)), "d"((uint16_t)0x40));
+    asm volatile("outb %0, %1" :: "a"((uint8_t)((count >> 8) & 0xFF)), "d"((uint16_t)0x40));
+}
+
+// チャンネル0 の残りカウントをラッチして読む
+uint16_t pit_read_count(void) {
+    asm volatile("outb %0, %1" :: "a"((uint8_t)0x00), "d"((uint16_t)0x43));
+    uint8_t lo = inb(0x40);
+    uint8_t hi = inb(0x40);
+    return (uint16_t)(lo | (hi << 8));
+}
@@ -3,6 +3,8 @@
 #include "../include/kernel/vfs.h"
 #include "../include/kernel/mm.h"
 #include "../include/kernel/proc.h"
+#include "../include/kernel/softirq.h"
+#include "../include/kernel/async.h"
 #include "../include/kernel/stdint.h"
 
 #define COM1 0x3F8
@@ -117,6 +119,13 @@ void kprintf(const char* fmt, ...);  // 後で定義
 
 static char kb_buf[KB_BUF_SIZE];
 static int  kb_head = 0, kb_tail = 0;
+static wait_queue_head_t kb_wait = WAIT_QUEUE_HEAD_INIT(kb_wait);
+static async_event_t     kb_event;   // tty_getchar_async の待ち
+
+// ハード割り込みで読んだスキャンコード (INPUT_SOFTIRQ が文字に変換する)
+#define SC_BUF_SIZE 64
+static uint8_t sc_buf[SC_BUF_SIZE];
+static volatile int sc_head = 0, sc_tail = 0;
 
 static const char sc_normal[] = {
     0,  27, '1','2','3','4','5','6','7','8','9','0','-','=', 8,
@@ -136,10 +145,18 @@ static const char sc_shift[] = {
 static int shift_held = 0;
 static int ctrl_held  = 0;
 
+// ハード割り込み: ポートを読んで積むだけ
 void keyboard_handler() {
     uint8_t scancode = inb(0x60);
-    
-   
+    int next = (sc_head + 1) % SC_BUF_SIZE;
+    if (next != sc_tail) {
+        sc_buf[sc_head] = scancode;
+        sc_head = next;
+    }
+    raise_softirq(INPUT_SOFTIRQ);
+}
+
+static void keyboard_process(uint8_t scancode) {
     if (scancode == 0x2A || scancode == 0x36) { shift_held = 1; return; }
     if (scancode == 0xAA || scancode == 0xB6) { shift_held = 0; return; }
     if (scancode == 0x1D) { ctrl_held = 1; return; }
@@ -158,28 +175,52 @@ void keyboard_handler() {
         c = 3; // ETX
     }
 
+    // 非同期の読み手が待っていればバッファを通さずに直接渡す
+    if (async_event_signal(&kb_event, (unsigned char)c)) return;
+
     int next = (kb_head + 1) % KB_BUF_SIZE;
     if (next != kb_tail) {
         kb_buf[kb_head] = c;
         kb_head = next;
+        wake_up(&kb_wait);
     }
 }
 
-// ブロッキング読み取り
-char tty_getchar(void) {
-   
-   
-
-    
-    while (kb_head == kb_tail) {
-        asm volatile("hlt"); // 割り込み待ち
+// INPUT_SOFTIRQ (割り込み許可で走る)
+static void keyboard_softirq(void) {
+    while (sc_tail != sc_head) {
+        uint8_t scancode = sc_buf[sc_tail];
+        sc_tail = (sc_tail + 1) % SC_BUF_SIZE;
+        keyboard_process(scancode);
     }
+}
+
+void keyboard_init(void) {
+    async_event_init(&kb_event);
+    open_softirq(INPUT_SOFTIRQ, keyboard_softirq);
+}
+
+// ブロッキング読み取り (入力が来るまで kb_wait で眠る)
+char tty_getchar(void) {
+    wait_event(kb_wait, kb_head != kb_tail);
     char c = kb_buf[kb_tail];
     kb_tail = (kb_tail + 1) % KB_BUF_SIZE;
     return c;
 
 }
 
+// 非同期版: 眠らずに継続を登録して戻る。
+// 登録より前に来てバッファに溜まっていた文字は、待ちから自分を外せたときだけ取る
+// (外せなければ割り込み側が既に文字を渡している)
+void tty_getchar_async(async_task_t* t, async_fn_t next) {
+    async_wait(&kb_event, t, next);
+    if (kb_head != kb_tail && async_event_cancel(&kb_event, t)) {
+        char c = kb_buf[kb_tail];
+        kb_tail = (kb_tail + 1) % KB_BUF_SIZE;
+        async_complete(t, (unsigned char)c);
+    }
+}
+
 // ラインバッファ付き読み取り (シェル用)
 int tty_readline(char* buf, int maxlen) {
     int i = 0;
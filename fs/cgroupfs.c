@@ -0,0 +1,313 @@
+// fs/cgroupfs.c - コントロールグループのファイルシステム (/sys/fs/cgroup)
+// グループごとにディレクトリを1つ見せ、中に設定と使用量のテキストファイルを置く。
+// ディレクトリの mkdir / unlink がグループの作成・削除になる。
+//   cgroup.procs    属しているプロセスの pid。pid を書くとそのプロセスを移す (0 なら自分)
+//   cpu.weight      CPU の重み (1..10000、既定 100)
+//   cpu.stat        usage_usec (子孫を含む CPU 時間) と走れるタスクの数
+//   memory.max      メモリの上限 (バイト。K/M/G を付けてもよい、"max" で無制限)
+//   memory.current / memory.peak / memory.events / memory.stat  使用量・最大値・断った回数・内訳
+// ルートには重みと上限のファイルを置かない
+#include "../include/kernel/cgroup.h"
+#include "../include/kernel/vfs.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/mm.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/types.h"
+
+extern int snprintf(char* buf, size_t size, const char* fmt, ...);
+
+enum {
+    CGF_PROCS,
+    CGF_CPU_WEIGHT,
+    CGF_CPU_STAT,
+    CGF_MEM_MAX,
+    CGF_MEM_CURRENT,
+    CGF_MEM_PEAK,
+    CGF_MEM_EVENTS,
+    CGF_MEM_STAT,
+    CGF_NR,
+};
+
+static const struct {
+    const char* name;
+    int         in_root;    // ルートにも置く
+} cgfs_files[CGF_NR] = {
+    [CGF_PROCS]       = { "cgroup.procs",   1 },
+    [CGF_CPU_WEIGHT]  = { "cpu.weight",     0 },
+    [CGF_CPU_STAT]    = { "cpu.stat",       1 },
+    [CGF_MEM_MAX]     = { "memory.max",     0 },
+    [CGF_MEM_CURRENT] = { "memory.current", 1 },
+    [CGF_MEM_PEAK]    = { "memory.peak",    1 },
+    [CGF_MEM_EVENTS]  = { "memory.events",  1 },
+    [CGF_MEM_STAT]    = { "memory.stat",    1 },
+};
+
+// グループ1つ分のノード (cgroup_t.fs_priv)。初めて引かれたときに作る
+typedef struct cgfs_node {
+    cgroup_t* cg;
+    vnode_t   dir;
+    vnode_t   files[CGF_NR];
+} cgfs_node_t;
+
+#define CGFS_TEXT_MAX PAGE_SIZE
+
+static uint32_t next_inode = 0x10000;   // ramfs の番号と重ならないように
+
+static void kstrcpy(char* d, const char* s) { while ((*d++ = *s++)); }
+static int kstrcmp(const char* a, const char* b) {
+    while (*a && *a == *b) { a++; b++; }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+static void kmemcpy(void* d, const void* s, size_t n) {
+    uint8_t* dd = (uint8_t*)d; const uint8_t* ss = (const uint8_t*)s;
+    for (size_t i = 0; i < n; i++) dd[i] = ss[i];
+}
+static void kmemset(void* d, int v, size_t n) {
+    uint8_t* p = (uint8_t*)d; for (size_t i = 0; i < n; i++) p[i] = (uint8_t)v;
+}
+
+static ssize_t cgfs_read(vnode_t* v, off_t off, size_t sz, void* buf);
+static ssize_t cgfs_write(vnode_t* v, off_t off, size_t sz, const void* buf);
+static int     cgfs_readdir(vnode_t* v, uint32_t idx, char* name_out);
+static vnode_t* cgfs_finddir(vnode_t* v, const char* name);
+static int     cgfs_create(vnode_t* v, const char* name, uint32_t type);
+static int     cgfs_unlink(vnode_t* v, const char* name);
+static int     cgfs_stat(vnode_t* v, stat_t* st);
+
+static vnode_ops_t cgfs_dir_ops = {
+    .readdir = cgfs_readdir,
+    .finddir = cgfs_finddir,
+    .create  = cgfs_create,
+    .unlink  = cgfs_unlink,
+    .stat    = cgfs_stat,
+};
+
+static vnode_ops_t cgfs_file_ops = {
+    .read  = cgfs_read,
+    .write = cgfs_write,
+    .stat  = cgfs_stat,
+};
+
+static inline cgroup_t* cg_of(vnode_t* v) {
+    return ((cgfs_node_t*)v->data)->cg;
+}
+
+static int file_index(vnode_t* v) {
+    cgfs_node_t* n = (cgfs_node_t*)v->data;
+    return (int)(v - n->files);
+}
+
+static int file_visible(cgroup_t* cg, int i) {
+    return cg != &cgroup_root || cgfs_files[i].in_root;
+}
+
+// cgroup_lock を持って呼ぶ
+static cgfs_node_t* node_of(cgroup_t* cg) {
+    if (cg->fs_priv) return (cgfs_node_t*)cg->fs_priv;
+    cgfs_node_t* n = (cgfs_node_t*)kmalloc(sizeof(cgfs_node_t));
+    if (!n) return NULL;
+    kmemset(n, 0, sizeof(cgfs_node_t));
+    n->cg = cg;
+
+    kstrcpy(n->dir.name, cg->name);
+    n->dir.type        = VFS_DIR;
+    n->dir.inode       = next_inode++;
+    n->dir.ops         = &cgfs_dir_ops;
+    n->dir.data        = n;
+    n->dir.permissions = S_IFDIR | S_IRUSR | S_IWUSR | S_IXUSR;
+    for (int i = 0; i < CGF_NR; i++) {
+        vnode_t* f = &n->files[i];
+        kstrcpy(f->name, cgfs_files[i].name);
+        f->type        = VFS_FILE;
+        f->inode       = next_inode++;
+        f->ops         = &cgfs_file_ops;
+        f->data        = n;
+        f->permissions = S_IFREG | S_IRUSR | S_IWUSR;
+    }
+    cg->fs_priv = n;
+    return n;
+}
+
+// ===== 中身 =====
+static int put_u64(char* buf, size_t size, const char* key, uint64_t v) {
+    uint32_t lo;
+    uint32_t hi = (uint32_t)div_u64_rem(v, 1000000000u, &lo);
+    if (hi) return snprintf(buf, size, "%s%u%09u\n", key, hi, lo);
+    return snprintf(buf, size, "%s%u\n", key, lo);
+}
+
+static int put_max(char* buf, size_t size, uint32_t v) {
+    if (v == CGROUP_MEM_UNLIMITED) return snprintf(buf, size, "max\n");
+    return snprintf(buf, size, "%u\n", v);
+}
+
+static int show_procs(cgroup_t* cg, char* buf, size_t size) {
+    int len = 0;
+    read_lock(&tasklist_lock);
+    for (int i = 0; i < proc_table_size && (size_t)len < size - 8; i++) {
+        process_t* p = proc_table[i];
+        if (p && p->pid && p->cgroup == cg)
+            len += snprintf(buf + len, size - len, "%d\n", p->pid);
+    }
+    read_unlock(&tasklist_lock);
+    return len;
+}
+
+static int show(cgroup_t* cg, int file, char* buf, size_t size) {
+    int len = 0;
+    switch (file) {
+    case CGF_PROCS:
+        return show_procs(cg, buf, size);
+    case CGF_CPU_WEIGHT:
+        return snprintf(buf, size, "%u\n", cg->weight);
+    case CGF_CPU_STAT:
+        len  = put_u64(buf, size, "usage_usec ", div_u64_rem(cgroup_cpu_usage(cg), NSEC_PER_USEC, NULL));
+        len += snprintf(buf + len, size - len, "nr_tasks %u\nnr_running %u\n",
+                        cg->nr_tasks, cg->nr_running);
+        return len;
+    case CGF_MEM_MAX:
+        return put_max(buf, size, cg->mem_max);
+    case CGF_MEM_CURRENT:
+        return snprintf(buf, size, "%u\n", cg->mem_usage);
+    case CGF_MEM_PEAK:
+        return snprintf(buf, size, "%u\n", cg->mem_peak);
+    case CGF_MEM_EVENTS:
+        return snprintf(buf, size, "max %u\n", cg->mem_events_max);
+    case CGF_MEM_STAT:
+        return snprintf(buf, size, "pages %u\nkernel %u\n",
+                        cg->mem_stat[CG_MEM_PAGE], cg->mem_stat[CG_MEM_HEAP]);
+    }
+    return 0;
+}
+
+static ssize_t cgfs_read(vnode_t* v, off_t off, size_t sz, void* buf) {
+    char* text = (char*)kmalloc(CGFS_TEXT_MAX);
+    if (!text) return -ENOMEM;
+    size_t len = (size_t)show(cg_of(v), file_index(v), text, CGFS_TEXT_MAX);
+    size_t n = 0;
+    if ((uint32_t)off < len) {
+        n = len - (uint32_t)off;
+        if (n > sz) n = sz;
+        kmemcpy(buf, text + off, n);
+    }
+    kfree(text);
+    return (ssize_t)n;
+}
+
+// 10進の数。K/M/G の接尾辞を許す。"max" は無制限
+static int parse_value(const char* s, size_t n, uint32_t* out) {
+    while (n && (s[n - 1] == '\n' || s[n - 1] == ' ')) n--;
+    if (n == 3 && s[0] == 'm' && s[1] == 'a' && s[2] == 'x') {
+        *out = CGROUP_MEM_UNLIMITED;
+        return 0;
+    }
+    uint64_t v = 0;
+    size_t i = 0;
+    if (!n) return -EINVAL;
+    for (; i < n && s[i] >= '0' && s[i] <= '9'; i++) {
+        v = v * 10 + (uint32_t)(s[i] - '0');
+        if (v > 0xFFFFFFFFull) return -EINVAL;
+    }
+    if (i == 0) return -EINVAL;
+    if (i < n) {
+        int shift = s[i] == 'K' || s[i] == 'k' ? 10 : s[i] == 'M' || s[i] == 'm' ? 20 :
+                    s[i] == 'G' || s[i] == 'g' ? 30 : -1;
+        if (shift < 0 || i + 1 != n) return -EINVAL;
+        v <<= shift;
+        if (v > 0xFFFFFFFFull) v = CGROUP_MEM_UNLIMITED;
+    }
+    *out = (uint32_t)v;
+    return 0;
+}
+
+static ssize_t cgfs_write(vnode_t* v, off_t off, size_t sz, const void* buf) {
+    cgroup_t* cg = cg_of(v);
+    int file = file_index(v);
+    uint32_t val;
+    if (off || parse_value((const char*)buf, sz, &val) < 0) return -EINVAL;
+
+    int ret;
+    switch (file) {
+    case CGF_PROCS:      ret = cgroup_attach(cg, (pid_t)val); break;
+    case CGF_CPU_WEIGHT: ret = cgroup_set_weight(cg, val); break;
+    case CGF_MEM_MAX:    ret = cgroup_set_mem_max(cg, val); break;
+    default:             ret = -EPERM; break;
+    }
+    return ret < 0 ? ret : (ssize_t)sz;
+}
+
+// ===== ディレクトリ =====
+static int cgfs_readdir(vnode_t* v, uint32_t idx, char* name_out) {
+    cgroup_t* cg = cg_of(v);
+    for (int i = 0; i < CGF_NR; i++) {
+        if (!file_visible(cg, i)) continue;
+        if (idx-- == 0) {
+            kstrcpy(name_out, cgfs_files[i].name);
+            return 0;
+        }
+    }
+    cgroup_lock();
+    cgroup_t* child = cgroup_child_at(cg, idx);
+    if (child) kstrcpy(name_out, child->name);
+    cgroup_unlock();
+    return child ? 0 : -1;
+}
+
+static vnode_t* cgfs_finddir(vnode_t* v, const char* name) {
+    cgfs_node_t* n = (cgfs_node_t*)v->data;
+    for (int i = 0; i < CGF_NR; i++) {
+        if (file_visible(n->cg, i) && kstrcmp(cgfs_files[i].name, name) == 0) return &n->files[i];
+    }
+    cgroup_lock();
+    cgroup_t* child = cgroup_find_child(n->cg, name);
+    cgfs_node_t* cn = child ? node_of(child) : NULL;
+    cgroup_unlock();
+    return cn ? &cn->dir : NULL;
+}
+
+static int cgfs_create(vnode_t* v, const char* name, uint32_t type) {
+    if (type != VFS_DIR) return -EPERM;
+    for (int i = 0; i < CGF_NR; i++) {
+        if (kstrcmp(cgfs_files[i].name, name) == 0) return -EEXIST;
+    }
+    return cgroup_mkdir(cg_of(v), name);
+}
+
+static int cgfs_unlink(vnode_t* v, const char* name) {
+    for (int i = 0; i < CGF_NR; i++) {
+        if (kstrcmp(cgfs_files[i].name, name) == 0) return -EPERM;
+    }
+    return cgroup_rmdir(cg_of(v), name);
+}
+
+static int cgfs_stat(vnode_t* v, stat_t* st) {
+    st->st_ino  = v->inode;
+    st->st_size = 0;
+    st->st_mode = v->type == VFS_DIR ? S_IFDIR : S_IFREG;
+    st->st_uid  = 0;
+    st->st_gid  = 0;
+    return 0;
+}
+
+// ===== cgroup.c から =====
+void cgroupfs_mount(const char* path) {
+    cgroup_lock();
+    cgfs_node_t* root = node_of(&cgroup_root);
+    cgroup_unlock();
+    if (root) vfs_mount(path, &root->dir);
+}
+
+// ディレクトリか中のファイルが開かれている (cgroup_task_lock の下で呼ばれる)
+int cgroupfs_busy(cgroup_t* cg) {
+    cgfs_node_t* n = (cgfs_node_t*)cg->fs_priv;
+    if (!n) return 0;
+    if (n->dir.ref_count) return 1;
+    for (int i = 0; i < CGF_NR; i++)
+        if (n->files[i].ref_count) return 1;
+    return 0;
+}
+
+void cgroupfs_release(cgroup_t* cg) {
+    kfree(cg->fs_priv);
+    cg->fs_priv = NULL;
+}
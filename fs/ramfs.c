@@ -1,6 +1,8 @@
 // fs/ramfs.c - メモリ上のファイルシステム
 #include "../include/kernel/vfs.h"
 #include "../include/kernel/mm.h"
+#include "../include/kernel/mutex.h"
+#include "../include/kernel/vma.h"
 #include "../include/kernel/types.h"
 
 #define RAMFS_MAX_CHILDREN 64
@@ -22,6 +24,10 @@ typedef struct ramfs_node {
 
 static uint32_t next_inode = 1;
 
+// ノードの中身・子の配列・inode 番号を守る。
+// krealloc でのコピーが長くなることがあるので眠るロックにする
+DEFINE_MUTEX(ramfs_mutex);
+
 // 文字列操作
 static size_t kstrlen(const char* s) { size_t n=0; while(s[n]) n++; return n; }
 static void   kstrcpy(char* d, const char* s) { while((*d++=*s++)); }
@@ -83,10 +89,14 @@ static ramfs_node_t* new_ramfs_node(const char* name, uint32_t type) {
 static ssize_t ramfs_read(vnode_t* v, off_t off, size_t sz, void* buf) {
     ramfs_node_t* n = (ramfs_node_t*)v->data;
     if (n->type != VFS_FILE) return -EISDIR;
-    if ((uint32_t)off >= n->size) return 0;
-    size_t avail = n->size - (uint32_t)off;
-    size_t to_read = (sz < avail) ? sz : avail;
-    kmemcpy(buf, n->data + off, to_read);
+    mutex_lock(&ramfs_mutex);
+    size_t to_read = 0;
+    if ((uint32_t)off < n->size) {
+        size_t avail = n->size - (uint32_t)off;
+        to_read = (sz < avail) ? sz : avail;
+        kmemcpy(buf, n->data + off, to_read);
+    }
+    mutex_unlock(&ramfs_mutex);
     return (ssize_t)to_read;
 }
 
@@ -94,6 +104,7 @@ static ssize_t ramfs_write(vnode_t* v, off_t off, size_t sz, const void* buf) {
     ramfs_node_t* n = (ramfs_node_t*)v->data;
     if (n->type != VFS_FILE) return -EISDIR;
 
+    mutex_lock(&ramfs_mutex);
     uint32_t needed = (uint32_t)off + (uint32_t)sz;
     if (needed > n->capacity) {
         uint32_t new_cap = needed + RAMFS_BLOCK_SIZE;
@@ -103,64 +114,95 @@ static ssize_t ramfs_write(vnode_t* v, off_t off, size_t sz, const void* buf) {
     kmemcpy(n->data + off, buf, sz);
     if (needed > n->size) n->size = needed;
     v->size = n->size;
+    mutex_unlock(&ramfs_mutex);
     return (ssize_t)sz;
 }
 
 static int ramfs_readdir(vnode_t* v, uint32_t idx, char* name_out) {
     ramfs_node_t* n = (ramfs_node_t*)v->data;
     if (n->type != VFS_DIR) return -ENOTDIR;
-    if ((int)idx >= n->nchildren) return -1;
-    kstrcpy(name_out, n->children[idx]->name);
-    return 0;
+    int ret = -1;
+    mutex_lock(&ramfs_mutex);
+    if ((int)idx < n->nchildren) {
+        kstrcpy(name_out, n->children[idx]->name);
+        ret = 0;
+    }
+    mutex_unlock(&ramfs_mutex);
+    return ret;
 }
 
 static vnode_t* ramfs_finddir(vnode_t* v, const char* name) {
     ramfs_node_t* n = (ramfs_node_t*)v->data;
     if (n->type != VFS_DIR) return NULL;
+    vnode_t* ret = NULL;
+    mutex_lock(&ramfs_mutex);
     for (int i = 0; i < n->nchildren; i++) {
-        if (kstrcmp(n->children[i]->name, name) == 0)
-            return &n->children[i]->vnode;
+        if (kstrcmp(n->children[i]->name, name) == 0) {
+            ret = &n->children[i]->vnode;
+            break;
+        }
     }
-    return NULL;
+    mutex_unlock(&ramfs_mutex);
+    return ret;
 }
 
 static int ramfs_create(vnode_t* v, const char* name, uint32_t type) {
     ramfs_node_t* parent = (ramfs_node_t*)v->data;
     if (parent->type != VFS_DIR) return -ENOTDIR;
-    if (parent->nchildren >= RAMFS_MAX_CHILDREN) return -ENOSPC;
 
-    ramfs_node_t* child = new_ramfs_node(name, type);
-    parent->children[parent->nchildren++] = child;
-    return 0;
+    int ret = 0;
+    mutex_lock(&ramfs_mutex);
+    if (parent->nchildren >= RAMFS_MAX_CHILDREN) {
+        ret = -ENOSPC;
+    } else {
+        ramfs_node_t* child = new_ramfs_node(name, type);
+        parent->children[parent->nchildren++] = child;
+    }
+    mutex_unlock(&ramfs_mutex);
+    return ret;
 }
 
 static int ramfs_unlink(vnode_t* v, const char* name) {
     ramfs_node_t* parent = (ramfs_node_t*)v->data;
+    int ret = -ENOENT;
+    mutex_lock(&ramfs_mutex);
     for (int i = 0; i < parent->nchildren; i++) {
         if (kstrcmp(parent->children[i]->name, name) == 0) {
+            // 開いている・マップしているファイルは消せない (ノードを参照しているため)
+            if (parent->children[i]->vnode.ref_count) {
+                ret = -EBUSY;
+                break;
+            }
             // TODO: 再帰削除
+            page_cache_invalidate(&parent->children[i]->vnode);
             kfree(parent->children[i]);
             parent->children[i] = parent->children[--parent->nchildren];
-            return 0;
+            ret = 0;
+            break;
         }
     }
-    return -ENOENT;
+    mutex_unlock(&ramfs_mutex);
+    return ret;
 }
 
 static int ramfs_stat(vnode_t* v, stat_t* st) {
     ramfs_node_t* n = (ramfs_node_t*)v->data;
+    mutex_lock(&ramfs_mutex);
     st->st_ino  = n->inode;
     st->st_size = n->size;
     st->st_mode = (n->type == VFS_DIR) ? S_IFDIR : S_IFREG;
     st->st_uid  = 0; st->st_gid = 0;
+    mutex_unlock(&ramfs_mutex);
     return 0;
 }
 
 static int ramfs_truncate(vnode_t* v, size_t size) {
     ramfs_node_t* n = (ramfs_node_t*)v->data;
+    mutex_lock(&ramfs_mutex);
     if (size == 0) { kfree(n->data); n->data = NULL; n->size = 0; n->capacity = 0; }
     else if (size < n->size) n->size = (uint32_t)size;
     v->size = n->size;
+    mutex_unlock(&ramfs_mutex);
     return 0;
 }
 
@@ -1,10 +1,17 @@
 // fs/vfs.c - 仮想ファイルシステム層
 #include "../include/kernel/vfs.h"
 #include "../include/kernel/mm.h"
+#include "../include/kernel/mutex.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/vma.h"
 #include "../include/kernel/types.h"
 
 static vnode_t* vfs_root = NULL;
 
+// マウントと「探して無ければ作る」を1つにまとめる (同じ名前を二重に作らない)。
+// 各 FS の中身は FS 側のロックで守る
+DEFINE_MUTEX(vfs_mutex);
+
 // ===== 文字列ユーティリティ =====
 static size_t kstrlen(const char* s) { size_t n=0; while(s[n]) n++; return n; }
 static void   kstrcpy(char* d, const char* s) { while((*d++=*s++)); }
@@ -24,14 +31,17 @@ static int    kstrncmp(const char*a, const char*b, size_t n) {
 void vfs_init(void) { vfs_root = NULL; }
 
 int vfs_mount(const char* path, vnode_t* fs_root) {
+    int ret = 0;
+    mutex_lock(&vfs_mutex);
     if (kstrcmp(path, "/") == 0) {
         vfs_root = fs_root;
-        return 0;
+    } else {
+        vnode_t* node = vfs_lookup(path);
+        if (node) node->mount_point = fs_root;
+        else      ret = -ENOENT;
     }
-    vnode_t* node = vfs_lookup(path);
-    if (!node) return -ENOENT;
-    node->mount_point = fs_root;
-    return 0;
+    mutex_unlock(&vfs_mutex);
+    return ret;
 }
 
 vnode_t* vfs_get_root(void) { return vfs_root; }
@@ -71,7 +81,8 @@ vnode_t* vfs_lookup(const char* path) {
 }
 
 // ===== file_t 操作 =====
-file_t* file_open(const char* path, int flags) {
+// O_CREAT のときは vfs_mutex を持って探し、無ければそのまま作る
+static vnode_t* lookup_or_create(const char* path, int flags) {
     vnode_t* node = vfs_lookup(path);
 
     if (!node) {
@@ -91,13 +102,27 @@ file_t* file_open(const char* path, int flags) {
         if (*slash == '/' && slash == path) fname = path + 1;
         if (parent->ops->create(parent, fname, VFS_FILE) < 0) return NULL;
         node = parent->ops->finddir(parent, fname);
-        if (!node) return NULL;
     }
+    return node;
+}
+
+file_t* file_open(const char* path, int flags) {
+    vnode_t* node;
+    if (flags & O_CREAT) {
+        mutex_lock(&vfs_mutex);
+        node = lookup_or_create(path, flags);
+        mutex_unlock(&vfs_mutex);
+    } else {
+        node = vfs_lookup(path);
+    }
+    if (!node) return NULL;
 
     if (node->ops && node->ops->open) node->ops->open(node, flags);
 
-    if (flags & O_TRUNC && node->ops && node->ops->truncate)
+    if (flags & O_TRUNC && node->ops && node->ops->truncate) {
         node->ops->truncate(node, 0);
+        page_cache_invalidate(node);
+    }
 
     file_t* f = (file_t*)kmalloc(sizeof(file_t));
     f->vnode  = node;
@@ -125,6 +150,7 @@ ssize_t file_read(file_t* f, void* buf, size_t size) {
     if (!f->vnode->ops || !f->vnode->ops->read) return -EIO;
     ssize_t n = f->vnode->ops->read(f->vnode, f->offset, size, buf);
     if (n > 0) f->offset += n;
+    if (n > 0 && current_proc) current_proc->rchar += (uint32_t)n;
     return n;
 }
 
@@ -133,6 +159,9 @@ ssize_t file_write(file_t* f, const void* buf, size_t size) {
     if (!f->vnode->ops || !f->vnode->ops->write) return -EIO;
     ssize_t n = f->vnode->ops->write(f->vnode, f->offset, size, buf);
     if (n > 0) f->offset += n;
+    if (n > 0 && current_proc) current_proc->wchar += (uint32_t)n;
+    // キャッシュ済みのページは古くなる (マップ済みのプロセスは古い内容のまま)
+    if (n > 0) page_cache_invalidate(f->vnode);
     return n;
 }
 
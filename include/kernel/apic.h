@@ -0,0 +1,26 @@
+// include/kernel/apic.h - ローカル APIC
+#pragma once
+#include "types.h"
+
+#define LAPIC_DEFAULT_BASE 0xFEE00000
+
+// 割り込みベクタ (PIC の 32-47 の後ろ)
+#define LAPIC_TIMER_VECTOR 48
+#define RESCHED_VECTOR     49
+#define TLB_FLUSH_VECTOR   50
+#define SPURIOUS_VECTOR    0xFF
+
+// ICR
+#define ICR_INIT       0x00000500
+#define ICR_STARTUP    0x00000600
+#define ICR_LEVEL      0x00008000
+#define ICR_ASSERT     0x00004000
+
+void    lapic_setup(uint32_t phys);
+int     lapic_present(void);
+void    lapic_init(void);
+uint8_t lapic_id(void);
+void    lapic_eoi(void);
+void    lapic_send_ipi(uint8_t apic_id, uint32_t icr);
+void    lapic_timer_calibrate(void);
+void    lapic_timer_start(void);
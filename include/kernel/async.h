@@ -0,0 +1,62 @@
+// include/kernel/async.h - カーネル内の非同期タスク (スタックを持たない状態機械)
+// タスクは継続 (次に呼ぶ関数) と自分の状態だけを持つ小さなオブジェクトで、
+// kasync スレッドが準備のできたものから1ステップずつ呼ぶ。
+// 待つときはカーネルスタックを抱えて眠る代わりに、完了したら呼ぶ継続を登録して戻る。
+// 完了の通知 (async_complete / async_event_signal) は割り込み文脈からも呼べる。
+#pragma once
+#include "types.h"
+#include "list.h"
+#include "timer.h"
+#include "spinlock.h"
+
+// 継続の戻り値
+#define ASYNC_DONE     0   // 終わり (タスクを解放する)
+#define ASYNC_PENDING  1   // 完了の通知を待つ (async_wait / async_sleep などを登録済み)
+#define ASYNC_AGAIN    2   // すぐにもう一度呼ぶ (他のタスクの後ろに回る)
+
+struct async_task;
+typedef int  (*async_fn_t)(struct async_task* t);
+typedef void (*async_done_fn_t)(struct async_task* t);
+
+typedef struct async_task {
+    async_fn_t       fn;        // 次に呼ぶ継続
+    void*            data;      // タスク固有の状態
+    int              step;      // 状態機械の位置 (自由に使ってよい)
+    int              result;    // 直前に完了した操作の結果
+    int              queued;    // 実行キューに入っている
+    async_done_fn_t  on_done;   // ASYNC_DONE を返した後、解放の直前に呼ぶ (NULL 可)
+    list_head_t      link;      // 実行キューかイベントの待ち
+    ktimer_t         timer;     // async_sleep
+} async_task_t;
+
+// 割り込みから起きる完了の通知先 (デバイスの「データが来た」など)
+typedef struct async_event {
+    spinlock_t  lock;
+    list_head_t waiters;
+} async_event_t;
+
+void          async_init(void);
+
+async_task_t* async_create(async_fn_t fn, void* data);
+void          async_spawn(async_task_t* t);
+// 継続を差し替える (次に実行キューから取り出されたときに fn が呼ばれる)
+static inline void async_then(async_task_t* t, async_fn_t fn) { t->fn = fn; }
+
+// result を渡して t を実行キューに戻す (割り込みからも呼べる)
+void          async_complete(async_task_t* t, int result);
+// n tick 後に next を続ける。継続からは ASYNC_PENDING を返す
+void          async_sleep(async_task_t* t, uint32_t n, async_fn_t next);
+
+void          async_event_init(async_event_t* ev);
+// ev が通知されたら next を続ける。継続からは ASYNC_PENDING を返す
+void          async_wait(async_event_t* ev, async_task_t* t, async_fn_t next);
+// 待っている先頭の1つ / 全部に result を渡して起こす。起こした数を返す
+int           async_event_signal(async_event_t* ev, int result);
+int           async_event_signal_all(async_event_t* ev, int result);
+// t がまだ ev を待っていれば外して1を返す (もう通知されていれば0)
+int           async_event_cancel(async_event_t* ev, async_task_t* t);
+
+// キーボードから1文字読む (drivers/tty.c)。文字が result に入って next が続く
+void          tty_getchar_async(async_task_t* t, async_fn_t next);
+
+uint32_t      async_nr_tasks(void);   // 生きているタスクの数
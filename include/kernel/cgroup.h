@@ -0,0 +1,90 @@
+// include/kernel/cgroup.h - コントロールグループ (CPU の重みとメモリの上限)
+// プロセスを木構造のグループに入れ、グループ単位で CPU の取り分とメモリの使用量を制御する。
+// 設定と使用量は /sys/fs/cgroup のファイル (fs/cgroupfs.c) で読み書きする。
+//   CPU: グループの取り分は cpu.weight に比例し、グループ内の走れるタスクで分け合う
+//        (CFS の vruntime の進み方を変える。タスクを増やしても他のグループは削られない)
+//   メモリ: 物理ページ (pmm_alloc) とカーネルヒープ (kmalloc) をグループに課金する。
+//        上限を超えるページの確保と brk の伸長は失敗させる。使用量は子孫の分も含む
+#pragma once
+#include "types.h"
+#include "list.h"
+#include "smp.h"
+
+#define CGROUP_MAX           64     // ルートを含むグループの数 (id は 1..CGROUP_MAX-1)
+#define CGROUP_NAME_LEN      32
+#define CGROUP_ROOT_ID       1
+#define CGROUP_WEIGHT_MIN    1
+#define CGROUP_WEIGHT_DFL    100
+#define CGROUP_WEIGHT_MAX    10000
+#define CGROUP_MEM_UNLIMITED 0xFFFFFFFFu
+
+// 課金の種類 (memory.stat の内訳)
+#define CG_MEM_PAGE  0              // 物理ページ
+#define CG_MEM_HEAP  1              // カーネルヒープのブロック
+
+struct process;
+
+typedef struct cgroup {
+    int            id;              // ページとヒープのブロックに所有者として記録する
+    char           name[CGROUP_NAME_LEN];
+    struct cgroup* parent;          // ルートは NULL
+    list_head_t    children;
+    list_head_t    sibling;
+    int            depth;           // ルートが 0
+    volatile uint32_t nr_tasks;     // 属しているプロセス (回収前のゾンビも含む)
+    volatile uint32_t nr_running;   // 子孫も含めた走れるタスクの数 (スケジューラが数える)
+    uint32_t       weight;          // cpu.weight
+
+    // 子孫も含めた CPU 時間 (ns)。update_curr がその CPU の実行キューのロックの下で足すので
+    // CPU ごとに分けておき、読むときに合計する
+    uint64_t       cpu_usage[MAX_CPUS];
+
+    // メモリ (バイト、子孫も含む)。cgroup_mem_lock で守る
+    uint32_t       mem_max;
+    uint32_t       mem_usage;
+    uint32_t       mem_peak;
+    uint32_t       mem_stat[2];     // CG_MEM_* ごとの内訳
+    uint32_t       mem_events_max;  // 上限で断った回数
+
+    void*          fs_priv;         // cgroupfs のノード
+} cgroup_t;
+
+extern cgroup_t cgroup_root;
+
+// cgroupfs を /sys/fs/cgroup にマウントする (ルートは起動時から使える)
+void      cgroup_init(void);
+
+// 木の操作 (cgroupfs から)。mkdir / rmdir の名前はグループ内で一意
+int       cgroup_mkdir(cgroup_t* parent, const char* name);
+int       cgroup_rmdir(cgroup_t* parent, const char* name);
+cgroup_t* cgroup_find_child(cgroup_t* parent, const char* name);
+cgroup_t* cgroup_child_at(cgroup_t* parent, uint32_t index);
+void      cgroup_lock(void);        // 木とグループの設定を守る (眠るロック)
+void      cgroup_unlock(void);
+
+// pid (0 なら呼び出したタスク) を cg に移す
+int       cgroup_attach(cgroup_t* cg, pid_t pid);
+int       cgroup_set_weight(cgroup_t* cg, uint32_t weight);
+int       cgroup_set_mem_max(cgroup_t* cg, uint32_t bytes);
+uint64_t  cgroup_cpu_usage(cgroup_t* cg);
+
+// プロセスの生成と解放 (proc.c)。新しいプロセスは作ったタスクのグループに入る
+void      cgroup_fork(struct process* p);
+void      cgroup_exit(struct process* p);
+
+// ===== メモリの課金 =====
+// 今課金する先 (割り込み・ソフト割り込みからの確保はどこにも課金しない: NULL)
+cgroup_t* cgroup_charge_target(void);
+// cg と祖先に bytes を課金する。どこかで上限を超えるなら課金せずに -ENOMEM
+// (force なら超えても課金する)。pmm_lock / heap_lock の内側で呼ぶ
+int       cgroup_charge(cgroup_t* cg, int type, uint32_t bytes, int force);
+void      cgroup_uncharge(int id, int type, uint32_t bytes);
+// 課金せずに、あと bytes 使えるかだけを見る (brk の伸長)
+int       cgroup_mem_check(cgroup_t* cg, uint32_t bytes);
+
+// ===== スケジューラ (sched.c から、実行キューのロックを持って) =====
+// 走れるタスクの数を delta (+1/-1) だけ増減する
+void      cgroup_runnable(cgroup_t* cg, int delta);
+// nice で重み付けした実行時間を、グループの重みと混み具合で vruntime の増分にする
+uint64_t  cgroup_scale_delta(cgroup_t* cg, uint64_t delta);
+void      cgroup_account_cpu(cgroup_t* cg, uint64_t delta);
@@ -0,0 +1,42 @@
+// include/kernel/fpu.h - FPU/SSE 状態の遅延切り替え
+// 切り替え時は CR0.TS を立てるだけで、最初に FPU 命令を使ったときの #NM で
+// 前の持ち主の状態を退避して自分の状態を戻す。FPU を使わないタスクは何も払わない。
+#pragma once
+#include "types.h"
+
+#define CR0_MP 0x00000002
+#define CR0_EM 0x00000004
+#define CR0_TS 0x00000008
+#define CR0_NE 0x00000020
+#define CR4_OSFXSR     0x00000200
+#define CR4_OSXMMEXCPT 0x00000400
+
+#define FPU_STATE_SIZE 512   // FXSAVE 領域 (FNSAVE なら先頭108バイトだけ使う)
+#define MXCSR_DEFAULT  0x1F80
+
+struct process;
+
+typedef struct {
+    uint8_t data[FPU_STATE_SIZE];
+} __attribute__((aligned(16))) fpu_state_t;
+
+static inline void clts(void) { asm volatile("clts" ::: "memory"); }
+
+static inline void stts(void) {
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    asm volatile("mov %0, %%cr0" :: "r"(cr0 | CR0_TS) : "memory");
+}
+
+void fpu_init(void);                   // BSP: CPUID を見て既定状態を作る
+void fpu_init_cpu(void);               // 各 CPU の CR0/CR4 設定
+void fpu_switch_to(struct process* next);
+void fpu_nm_trap(void);                // #NM (ベクタ7)
+int  fpu_fork(struct process* child, struct process* parent);
+void fpu_exit(struct process* p);
+void fpu_free(struct process* p);
+int  fpu_is_live(struct process* p);
+
+// カーネル内で SIMD を使う区間 (プリエンプション禁止)
+void kernel_fpu_begin(void);
+void kernel_fpu_end(void);
@@ -0,0 +1,44 @@
+// include/kernel/futex.h - futex (ユーザー空間の同期で眠る・起こす)
+// 競合しないロック・アンロックはユーザー空間のアトミック命令だけで済ませ、
+// 待つ必要があるときだけ futex で眠る。待ち合わせの鍵はワードの物理アドレスで、
+// 同じページを共有していれば (スレッドでも共有マップでも) 同じ鍵になる。
+#pragma once
+#include "types.h"
+#include "time.h"
+
+// op (Linux と同じ値)
+#define FUTEX_WAIT         0
+#define FUTEX_WAKE         1
+#define FUTEX_REQUEUE      3
+#define FUTEX_CMP_REQUEUE  4
+#define FUTEX_PRIVATE_FLAG 128   // 受け付けるが区別しない
+#define FUTEX_CMD_MASK     (~FUTEX_PRIVATE_FLAG)
+
+void futex_init(void);
+
+// WAIT: *uaddr == val なら起こされるかタイムアウト (tmo_ticks, 0 = 無期限) まで眠る
+//   値が違えば -EAGAIN、タイムアウトは -ETIMEDOUT
+// WAKE: uaddr で待っている最大 val 個を起こし、起こした数を返す
+// (CMP_)REQUEUE: val 個を起こし、残りの最大 val2 個を uaddr2 の待ちに移す
+//   CMP_REQUEUE は先に *uaddr == val3 を確かめる (違えば -EAGAIN)
+int  futex_wait(uint32_t* uaddr, uint32_t val, uint32_t tmo_ticks);
+int  futex_wake(uint32_t* uaddr, int nr);
+int  futex_requeue(uint32_t* uaddr, uint32_t* uaddr2, int nr_wake, int nr_requeue,
+                   int cmp, uint32_t val3);
+int  do_futex(uint32_t* uaddr, int op, uint32_t val, const timespec_t* timeout,
+              uint32_t val2, uint32_t* uaddr2, uint32_t val3);
+
+// libc の pthread_mutex_* / pthread_cond_* (libc/libc.c)
+// state: 0 = 空き, 1 = 保持 (待ちなし), 2 = 保持 (待ちあり)
+typedef struct {
+    volatile uint32_t state;
+} pthread_mutex_t;
+
+// seq は signal/broadcast のたびに進める。broadcast は待ちをまとめて mutex に移す
+typedef struct {
+    volatile uint32_t seq;
+    pthread_mutex_t*  mutex;
+} pthread_cond_t;
+
+#define PTHREAD_MUTEX_INITIALIZER { 0 }
+#define PTHREAD_COND_INITIALIZER  { 0, NULL }
@@ -16,6 +16,23 @@ typedef struct {
     uint32_t base;
 } PACKED gdt_ptr_t;
 
+// スレッドごとの TLS セグメント (GDT 8)。ユーザーは %gs に TLS_SEL を入れて使う
+#define GDT_TLS_ENTRY 8
+#define TLS_SEL       0x43
+
+// set_thread_area の引数 (Linux i386 の struct user_desc と同じ並び)
+typedef struct {
+    int32_t  entry_number;          // -1 ならカーネルが選んで書き戻す
+    uint32_t base_addr;
+    uint32_t limit;
+    uint32_t seg_32bit       : 1;
+    uint32_t contents        : 2;
+    uint32_t read_exec_only  : 1;
+    uint32_t limit_in_pages  : 1;
+    uint32_t seg_not_present : 1;
+    uint32_t useable         : 1;
+} user_desc_t;
+
 typedef struct {
     uint32_t prev_tss;
     uint32_t esp0;
@@ -28,5 +45,16 @@ typedef struct {
     uint16_t trap, iomap_base;
 } PACKED tss_entry_t;
 
+// sysenter / sysexit の MSR。sysexit は SYSENTER_CS+16 / +24 をユーザーの CS / SS にするので
+// GDT はカーネルコード (0x08)・カーネルデータ・ユーザーコード (0x1B)・ユーザーデータ (0x23) の順に並べる
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
 void gdt_init(void);
+void gdt_init_cpu(int cpu);
 void gdt_set_kernel_stack(uint32_t stack);
+void gdt_install_df_task(uint32_t eip, uint32_t esp);
+uint32_t gdt_faulting_esp(void);
+uint64_t gdt_tls_desc(const user_desc_t* u);
+void     gdt_load_tls(uint64_t desc);
@@ -0,0 +1,38 @@
+// include/kernel/gthread.h - グリーンスレッド (libc の gt_*)
+// 多数の軽いスレッドを少数のワーカー (カーネルスレッド) の上で動かす (M:N)。
+// 切り替えは協調的で、gt_yield・gt_sleep・ブロックする呼び出しのところでだけ起こる。
+// ブロックする呼び出し (gt_read など) は別の少数の I/O スレッドに肩代わりさせ、
+// ワーカーはその間に他のグリーンスレッドを動かす。
+#pragma once
+#include "types.h"
+#include "mm.h"
+
+// 記述子込みのスタックの大きさ。ワーカーはカーネルモードで動くので、
+// 割り込み・ソフト割り込み・割り込みの出口の schedule もこのスタックに積まれる。
+// カーネルスタックと同じ大きさのガードページ付きのスロットを使う (mm/kstack.c)
+#define GT_STACK_SIZE     KSTACK_SIZE
+#define GT_STACK_POOL_MAX 256    // 終わったスレッドのスタックを取っておく数
+#define GT_MAX_WORKERS    8
+#define GT_MAX_IO         4
+
+typedef struct gthread gthread_t;
+typedef void (*gt_fn_t)(void* arg);
+
+// nworkers 個のワーカーと nio 個の I/O スレッドを起こす。
+// 全員が呼び出し元の FD 表を共有する。既に動いていれば -EBUSY
+int        gt_init(int nworkers, int nio);
+// 全グリーンスレッドが終わるのを待ってワーカーと I/O スレッドを止める (gt_init を呼んだタスクから)
+void       gt_shutdown(void);
+
+// fn(arg) を動かすグリーンスレッドを作る (どこからでも呼べる)。fn から戻ると終わる
+gthread_t* gt_spawn(gt_fn_t fn, void* arg);
+gthread_t* gt_self(void);       // グリーンスレッドの外では NULL
+void       gt_yield(void);
+void       gt_sleep(uint32_t ms);
+void       gt_exit(void);
+
+// fn(arg) を I/O スレッドで実行し、終わるまでこのグリーンスレッドだけを止める。
+// グリーンスレッドの外ではその場で呼ぶ
+int        gt_blocking(int (*fn)(void*), void* arg);
+ssize_t    gt_read(int fd, void* buf, size_t count);
+ssize_t    gt_write(int fd, const void* buf, size_t count);
@@ -23,4 +23,5 @@ typedef struct {
 } regs_t;
 
 void idt_init(void);
+void idt_load(void);
 void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags);
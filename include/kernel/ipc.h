@@ -0,0 +1,49 @@
+// include/kernel/ipc.h - 同期メッセージ IPC (call / reply_wait)
+// 小さな固定長メッセージを送って返事を待つ。受け手が待っていれば
+// 実行キューを通さずに受け手へ直接切り替え、送り手の持ち時間をそのまま使わせる
+// (返事のときも同じで、往復は切り替え2回だけで済む)。
+#pragma once
+#include "types.h"
+#include "list.h"
+#include "spinlock.h"
+
+#define IPC_MSG_WORDS 8          // 32 バイト (w[0] を種類に使うのが慣例)
+
+typedef struct {
+    uint32_t w[IPC_MSG_WORDS];
+} ipc_msg_t;
+
+// ipc_endpoint_t.state
+#define IPC_IDLE        0
+#define IPC_RECEIVING   1        // 受け手: reply_wait で次のメッセージを待っている
+#define IPC_SENDING     2        // 送り手: 受け手の senders で順番待ち
+#define IPC_WAIT_REPLY  3        // 送り手: 受け取られて callers で返事待ち
+
+struct process;
+
+// process_t に埋め込む。lock は受け手としてのロックで、自分の state/from/buf と
+// 自分の senders / callers につながっている送り手の state/buf/link を守る
+typedef struct ipc_endpoint {
+    spinlock_t       lock;
+    volatile int     state;      // IPC_*
+    int              dead;       // 終了した (以後の call は -ESRCH)
+    int              err;        // 送り手: 返事の代わりに受け手の終了で起こされた
+    pid_t            from;       // 受け手: 受け取ったメッセージの送り主
+    ipc_msg_t        buf;        // 送り手: 送るメッセージ → 返事 / 受け手: 受け取ったメッセージ
+    list_head_t      senders;    // 受け手: まだ受け取っていない送り手
+    list_head_t      callers;    // 受け手: 受け取ってまだ返事していない送り手
+    list_head_t      link;       // 送り手: 相手の senders か callers につながる
+} ipc_endpoint_t;
+
+void ipc_task_init(struct process* p);
+// 終了するタスク: 待っている送り手を全員 -ESRCH で起こす
+void ipc_exit(struct process* p);
+
+// dest に msg を送り、返事を reply に受け取るまで眠る。
+// 相手がいない・終了したら -ESRCH。待っている間はシグナルで中断しない
+int   ipc_call(pid_t dest, const ipc_msg_t* msg, ipc_msg_t* reply);
+// to (> 0) に reply を返してから次のメッセージを待ち、msg に受け取って送り主の pid を返す。
+// to <= 0 なら返事をせずに待つだけ (最初の1回)。シグナルで起こされたら -EINTR
+pid_t ipc_reply_wait(pid_t to, const ipc_msg_t* reply, ipc_msg_t* msg);
+// 返事だけして待たない (受け手が終わる前など)。返事を待っていなければ -ESRCH
+int   ipc_reply(pid_t to, const ipc_msg_t* reply);
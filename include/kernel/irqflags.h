@@ -0,0 +1,18 @@
+// include/kernel/irqflags.h - 割り込みフラグ操作
+#pragma once
+#include "types.h"
+
+#define EFLAGS_IF 0x200
+
+static inline void local_irq_disable(void) { asm volatile("cli" ::: "memory"); }
+static inline void local_irq_enable(void)  { asm volatile("sti" ::: "memory"); }
+
+static inline uint32_t local_irq_save(void) {
+    uint32_t flags;
+    asm volatile("pushfl; popl %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void local_irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) asm volatile("sti" ::: "memory");
+}
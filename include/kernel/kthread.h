@@ -0,0 +1,12 @@
+// include/kernel/kthread.h - カーネルスレッド
+#pragma once
+#include "types.h"
+
+struct process;
+
+typedef int (*kthread_fn_t)(void* arg);
+
+// fn(arg) の戻り値が終了コードになる
+struct process* kthread_create(kthread_fn_t fn, void* arg, const char* name);
+int             kthread_should_stop(void);
+void            kthread_stop(struct process* p);
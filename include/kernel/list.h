@@ -0,0 +1,50 @@
+// include/kernel/list.h - 双方向循環リスト (侵入型)
+#pragma once
+#include "types.h"
+
+typedef struct list_head {
+    struct list_head* next;
+    struct list_head* prev;
+} list_head_t;
+
+#define LIST_HEAD_INIT(name) { &(name), &(name) }
+
+#define list_entry(ptr, type, member) \
+    ((type*)((char*)(ptr) - __builtin_offsetof(type, member)))
+
+// 走査中に pos を削除してよい版
+#define list_for_each_safe(pos, n, head) \
+    for (pos = (head)->next, n = pos->next; pos != (head); pos = n, n = pos->next)
+
+#define list_for_each(pos, head) \
+    for (pos = (head)->next; pos != (head); pos = pos->next)
+
+static inline void list_init(list_head_t* h) {
+    h->next = h->prev = h;
+}
+
+static inline int list_empty(const list_head_t* h) {
+    return h->next == h;
+}
+
+static inline void __list_add(list_head_t* n, list_head_t* prev, list_head_t* next) {
+    next->prev = n;
+    n->next    = next;
+    n->prev    = prev;
+    prev->next = n;
+}
+
+static inline void list_add(list_head_t* n, list_head_t* head) {
+    __list_add(n, head, head->next);
+}
+
+static inline void list_add_tail(list_head_t* n, list_head_t* head) {
+    __list_add(n, head->prev, head);
+}
+
+// 外した要素は空リストとして再初期化する
+static inline void list_del(list_head_t* e) {
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+    list_init(e);
+}
@@ -6,14 +6,28 @@
 
 // 物理メモリ管理
 void  pmm_init(uint32_t mem_size, uint32_t kernel_end);
-void* pmm_alloc(void);
-void  pmm_free(void* addr);
+void* pmm_alloc(void);          // 参照数1で返す。今のタスクのグループに課金する (上限なら NULL)
+void* pmm_alloc_kernel(void);   // 誰にも課金しない (カーネルヒープの領域。ヒープはブロックで課金する)
+void  pmm_free(void* addr);     // 参照数に関係なく解放する
+void  pmm_get(uint32_t phys);   // 参照を足す (CoW・ページキャッシュの共有)
+void  pmm_put(uint32_t phys);   // 参照を落とし、0になったら解放する
+void  pmm_put_batch(const uint32_t* phys, int n);
+uint32_t pmm_refcount(uint32_t phys);
+void  pmm_reparent(int from, int to);   // cgroup の id の付け替え
 
 // 仮想メモリ管理
 #define PAGE_PRESENT  0x001
 #define PAGE_WRITE    0x002
 #define PAGE_USER     0x004
+#define PAGE_NOCACHE  0x010  // PCD: MMIO 用
 #define PAGE_COW      0x200  // ソフトウェアビット: Copy-on-Write
+#define PAGE_SHARED   0x400  // ソフトウェアビット: ページキャッシュのページ (書き込み禁止のまま共有)
+
+// 下位 64MB (恒等マップ・カーネルヒープ) は全ディレクトリでページテーブルを共有する。
+// ユーザー空間はその上からカーネル空間の手前まで
+#define KERNEL_SHARED_PDES 16
+#define USER_SPACE_START   0x04000000
+#define USER_SPACE_END     0xC0000000
 
 typedef uint32_t page_t;
 
@@ -28,16 +42,38 @@ typedef struct {
 void              vmm_init(void);
 page_directory_t* vmm_create_directory(void);
 void              vmm_destroy_directory(page_directory_t* pd);
+int               vmm_free_user_tables(page_directory_t* pd, int pde, int max_tables);
 void              vmm_map(page_directory_t* pd, uint32_t virt, uint32_t phys, uint32_t flags);
 void              vmm_unmap(page_directory_t* pd, uint32_t virt);
 uint32_t          vmm_get_physical(page_directory_t* pd, uint32_t virt);
+uint32_t          vmm_get_pte(page_directory_t* pd, uint32_t virt);
 void              vmm_switch(page_directory_t* pd);
 page_directory_t* vmm_clone(page_directory_t* src);
 page_directory_t* vmm_get_kernel_directory(void);
 
+// 物理ページを一時的にカーネルから見えるようにする (CPU ごとのスロット、入れ子可)。
+// 恒等マップ内のページはそのまま返す。kmap 中は眠らないこと
+void* kmap(uint32_t phys);
+void  kunmap(void* addr);
+
 // カーネルヒープ
 void  heap_init(void);
-void* kmalloc(size_t size);
-void* kmalloc_aligned(size_t size, size_t align);
+void* kmalloc(size_t size);     // 今のタスクのグループに課金する (上限でも断らない)
+void* kmalloc_aligned(size_t size, size_t align);   // 課金しない
 void  kfree(void* ptr);
 void* krealloc(void* ptr, size_t new_size);
+void  heap_reparent(int from, int to);
+
+// オブジェクトキャッシュ
+typedef struct kmem_cache kmem_cache_t;
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align);
+void*         kmem_cache_alloc(kmem_cache_t* c);
+void          kmem_cache_free(kmem_cache_t* c, void* obj);
+
+// カーネルスタック (ガードページ付き, 全アドレス空間で共有される領域)
+#define KSTACK_SIZE        (2 * PAGE_SIZE)
+#define KSTACK_REGION_BASE 0xE0000000
+#define KSTACK_REGION_SIZE 0x04000000   // 64MB → 約5400本
+uint32_t kstack_alloc(void);
+void     kstack_free(uint32_t top);
+int      kstack_is_guard(uint32_t addr);
@@ -0,0 +1,30 @@
+// include/kernel/mutex.h - 眠るロック
+// 空いていなければ待ちキューで眠る。割り込みハンドラやスピンロック保持中は使えない。
+#pragma once
+#include "types.h"
+#include "spinlock.h"
+#include "wait.h"
+
+struct process;
+
+typedef struct {
+    volatile uint32_t locked;
+    struct process*   owner;
+    wait_queue_head_t wait;
+    lock_class_t*     cls;
+    uint64_t          held_since;
+} mutex_t;
+
+#define MUTEX_INIT_CLASS(name, cls) { 0, NULL, WAIT_QUEUE_HEAD_INIT((name).wait), &(cls), 0 }
+#define DEFINE_MUTEX(x) \
+    static lock_class_t x##_class = LOCK_CLASS_INIT(#x); \
+    static mutex_t x = MUTEX_INIT_CLASS(x, x##_class)
+
+void mutex_init(mutex_t* m, lock_class_t* cls);
+int  mutex_trylock(mutex_t* m);
+void mutex_lock(mutex_t* m);
+void mutex_unlock(mutex_t* m);
+
+static inline int mutex_is_locked(const mutex_t* m) {
+    return m->locked != 0;
+}
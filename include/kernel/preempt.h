@@ -0,0 +1,31 @@
+// include/kernel/preempt.h - プリエンプション禁止カウンタ
+// スピンロックを持っている間や CPU ごとのデータを触る間はカウンタを上げておき、
+// タイマー割り込みからの切り替えを 0 に戻るまで遅らせる。
+#pragma once
+#include "types.h"
+#include "smp.h"
+
+#define PREEMPT_COUNT_OFF __builtin_offsetof(cpu_t, preempt_count)
+
+// %fs 経由の1命令なので、割り込まれても別の CPU のカウンタを触らない
+static inline void preempt_disable(void) {
+    asm volatile("incl %%fs:%c0" :: "i"(PREEMPT_COUNT_OFF) : "memory");
+}
+
+static inline void preempt_enable_no_resched(void) {
+    asm volatile("decl %%fs:%c0" :: "i"(PREEMPT_COUNT_OFF) : "memory");
+}
+
+static inline int preempt_count(void) {
+    int n;
+    asm volatile("movl %%fs:%c1, %0" : "=r"(n) : "i"(PREEMPT_COUNT_OFF));
+    return n;
+}
+
+// 0 に戻ったとき、保留中の切り替えがあればここで行う (sched.c)
+void preempt_schedule(void);
+
+static inline void preempt_enable(void) {
+    preempt_enable_no_resched();
+    if (preempt_count() == 0) preempt_schedule();
+}
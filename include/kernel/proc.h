@@ -3,12 +3,32 @@
 #include "types.h"
 #include "mm.h"
 #include "vfs.h"
+#include "timer.h"
+#include "time.h"
+#include "sched.h"
+#include "list.h"
+#include "wait.h"
+#include "smp.h"
+#include "fpu.h"
+#include "idt.h"
+#include "ipc.h"
 
 #define MAX_FDS       32
-#define MAX_PROCS     64
 #define PROC_NAME_LEN 32
 #define USER_STACK_TOP 0xBFFFF000
 #define USER_STACK_PAGES 4
+#define PID_MAX       32768
+
+// process_t.flags
+#define PF_KTHREAD      0x01   // カーネルスレッド
+#define PF_KTHREAD_STOP 0x02   // kthread_stop() で停止要求済み
+#define PF_NO_MIGRATE   0x04   // 他の CPU へ移さない (idle, ksoftirqd)
+
+// clone の flags (Linux と同じ値)。指定しなければ fork と同じく写す
+#define CLONE_VM        0x00000100   // アドレス空間を共有 (スレッド)
+#define CLONE_FS        0x00000200   // 作業ディレクトリを共有
+#define CLONE_FILES     0x00000400   // FD 表を共有
+#define CLONE_SETTLS    0x00080000   // 子の TLS を tls 引数 (user_desc_t*) で設定
 
 typedef enum {
     PROC_UNUSED  = 0,
@@ -20,55 +40,220 @@ typedef enum {
 } proc_state_t;
 
 struct file; // 前方宣言
+struct mm;
+
+#define CACHE_LINE 64
+
+// 資源使用量の累計 (回収済みの子の分を親に足し込むのに使う)
+typedef struct proc_acct {
+    uint64_t       utime;          // ns
+    uint64_t       stime;          // ns
+    uint32_t       nvcsw;          // 自発的な切り替え (眠った)
+    uint32_t       nivcsw;         // 横取りされた切り替え
+    uint32_t       min_flt;
+    uint32_t       maj_flt;
+    uint64_t       rchar;          // read で読んだバイト数
+    uint64_t       wchar;          // write で書いたバイト数
+} proc_acct_t;
+
+// FD 表と作業ディレクトリ。CLONE_FILES / CLONE_FS で作ったスレッドとは同じものを指す
+typedef struct files_struct {
+    int            users;
+    spinlock_t     lock;               // 空き FD の確保と差し替え
+    file_t*        fds[MAX_FDS];       // ファイルディスクリプタ
+} files_struct_t;
+
+typedef struct fs_struct {
+    int            users;
+    char           cwd[256];           // 作業ディレクトリ
+} fs_struct_t;
+
+// めったに触らない大きなデータ (システムコール・fork のときだけ使う)。
+// process_t の外に置き、スケジューラが表をなめるときに巻き込まない
+typedef struct proc_cold {
+    files_struct_t* files;             // 終了後は NULL
+    fs_struct_t*   fs;
+    uint32_t       sig_mask;
+    uint32_t       sig_handlers[32];
+} proc_cold_t;
 
+// スケジューラが毎回触るフィールドを先頭のキャッシュラインに詰める。
+// 並びを変えるときはキャッシュライン境界 (コメント) を意識すること
 typedef struct process {
-    pid_t          pid;
-    pid_t          ppid;
+    // --- キャッシュライン 0: 切り替えと pick_next で触る ---
     proc_state_t   state;
+    uint32_t       flags;          // PF_*
+    int            cpu;            // 属する実行キュー
+    volatile int   on_cpu;         // どこかの CPU で実行中 (切り替え完了まで1)
+    int            on_rq;
+    int            policy;
+    uint32_t       esp;            // カーネルスタック上のESP
+    uint32_t       kernel_stack_top; // kstack_alloc() で確保 (下にガードページ)
+    page_directory_t* page_dir;
+    fpu_state_t*   fpu;            // 初めて使ったときに確保 (NULL なら未使用)
+    uint32_t       weight;
+    uint32_t       inv_weight;     // 2^32 / weight
+    uint64_t       vruntime;
+    uint64_t       exec_start;     // 今回の実行開始時刻 (ns)
 
-    // レジスタコンテキスト
-    uint32_t       esp;         // カーネルスタック上のESP
-    uint32_t       kernel_stack_top;
+    // --- キャッシュライン 1: tick・起床で触る ---
+    uint64_t       sum_exec_runtime;
+    uint64_t       prev_sum_exec;  // 今回のスライス開始時点の sum_exec_runtime
+    rb_node_t      run_node;
+    pid_t          pid;
+    int            nice;
+    uint32_t       pending_sigs;
+    int            timed_out;
+    uint64_t       dl_abs_deadline;
+    int64_t        dl_budget;      // 今周期の残り予算
 
-    // アドレス空間
-    page_directory_t* page_dir;
+    // --- ここから下はまれにしか触らない ---
+    // デッドラインスケジューリング (EDF + CBS)
+    rb_node_t      dl_node;
+    uint64_t       dl_runtime;     // 周期ごとの実行予算 (ns)
+    uint64_t       dl_deadline;    // 相対デッドライン (ns)
+    uint64_t       dl_period;      // 周期 (ns)
+    uint32_t       dl_bw;          // runtime/period
+    int            dl_throttled;   // 予算切れで次周期待ち
+    int            dl_missed;      // 今周期のミスを計上済み
+    uint32_t       dl_misses;      // デッドラインミス回数
+    uint32_t       dl_throttles;   // 予算超過で止められた回数
+    ktimer_t       dl_timer;       // 予算補充タイマー
+
+    // スリープ / タイムアウト
+    ktimer_t       timer;
 
-    // ファイルディスクリプタ
-    file_t*   fds[MAX_FDS];
+    // ユーザーアドレス空間 (カーネルスレッドは NULL で page_dir はカーネルのもの)
+    struct mm*     mm;
+    // TLS 用 GDT エントリの中身 (set_thread_area)。切り替えのたびに GDT に書く。0 なら無効
+    uint64_t       tls_desc;
+
+    // 同期 IPC (kernel/ipc.c)
+    ipc_endpoint_t ipc;
+    // 参照数: 表にある間の1 + proc_pin() した数。0 になったら記述子を解放する
+    int            usage;
+    // コントロールグループ (kernel/cgroup.c)。cg_runnable はグループの nr_running に数えている間1
+    struct cgroup* cgroup;
+    int            cg_runnable;
+
+    // 親子関係・表
+    pid_t          ppid;
+    int            slot;           // proc_table 内の位置
+    struct process* pid_next;      // pid ハッシュのチェーン
+    struct process* parent;
+    list_head_t    children;       // 子プロセス (sibling でつなぐ)
+    list_head_t    sibling;
 
     // 待機
     int            exit_code;
-    pid_t          wait_pid;    // waitしている対象
+    wait_queue_head_t wait_chldexit; // 子の終了を待つ (waitpid)
 
-    // シグナル
-    uint32_t       pending_sigs;
-    uint32_t       sig_mask;
-    uint32_t       sig_handlers[32];
+    // 資源使用量 (getrusage / times)。utime/stime は sum_exec_runtime を
+    // tick ごとのサンプル数 (ユーザー/カーネル) で按分して出す
+    uint32_t       utick;
+    uint32_t       stick;
+    uint32_t       nvcsw;
+    uint32_t       nivcsw;
+    uint32_t       min_flt;
+    uint32_t       maj_flt;
+    uint64_t       rchar;
+    uint64_t       wchar;
+    proc_acct_t    cacct;          // 回収した子 (とその子孫) の合計
 
-    // スリープ
-    uint32_t       sleep_until; // tick数
+    // カーネルスレッド (kthread_create)
+    int          (*kthread_fn)(void* arg);
+    void*          kthread_arg;
+
+    proc_cold_t*   cold;
 
     // プログラム名
     char           name[PROC_NAME_LEN];
+} __attribute__((aligned(CACHE_LINE))) process_t;
 
-    // 作業ディレクトリ
-    char           cwd[256];
-
-    // カーネルスタック (各プロセス専用)
-    uint8_t        kernel_stack[8192];
-} process_t;
-
-extern process_t* current_proc;
+extern process_t** proc_table;       // 空きは NULL
+extern int         proc_table_size;
+extern rwlock_t    tasklist_lock;        // 表・親子リスト・pid からの参照を守る
+// 実行中のプロセスは CPU ごと (%fs の per-CPU 領域)
+#define current_proc (this_cpu()->current)
 extern uint32_t   ticks;
 
 void proc_init(void);
 process_t* proc_create_kernel(void (*entry)(void), const char* name);
-process_t* proc_fork(void);
+process_t* proc_alloc_kernel(void (*entry)(void), const char* name);
+void       proc_start(process_t* p);
+pid_t      proc_spawn(const char* path, char* const argv[]);
+pid_t      proc_spawn_fn(int (*fn)(void*), void* arg, const char* name);
+process_t* proc_clone(uint32_t flags, regs_t* r, uint32_t child_stack, uint64_t tls_desc);
+uint32_t   proc_total_forks(void);   // 起動から作ったタスクの数
+void       proc_share_files(files_struct_t* files);
 int        proc_exec(const char* path, char* const argv[]);
 void       proc_exit(int code);
+// waitpid の options
+#define WNOHANG 1
+
+// 親が終わった子を引き取って回収するスレッド (korphan) を起こす
+void       proc_reaper_init(void);
 pid_t      proc_wait(pid_t pid, int* status);
+pid_t      proc_wait_timeout(pid_t pid, int* status, uint32_t ms);
+pid_t      proc_wait_nohang(pid_t pid, int* status);
 void       proc_sleep(uint32_t ms);
+int        proc_block_timeout(proc_state_t state, uint32_t timeout_ticks);
+int        proc_schedule_timeout(uint32_t timeout_ticks);
+process_t* proc_create_idle(int cpu);
+void       proc_wakeup(process_t* p);
 void       proc_yield(void);
 void       proc_kill(pid_t pid, int sig);
-void       scheduler_tick(void);
 process_t* proc_get(pid_t pid);
+// 記述子を解放させない (回収されても proc_unpin() まで残る)。
+// pid から引いたプロセスを tasklist_lock の外で使うときに
+void       proc_pin(process_t* p);
+void       proc_unpin(process_t* p);
+int        proc_getnice(pid_t pid);
+int        proc_setnice(pid_t pid, int nice);
+int        proc_sched_setattr(pid_t pid, const sched_attr_t* attr);
+int        proc_sched_getattr(pid_t pid, sched_attr_t* attr);
+
+// getrusage / times
+#define RUSAGE_SELF     0
+#define RUSAGE_CHILDREN (-1)
+
+// Linux i386 と同じ並び (使わない欄は 0)
+typedef struct rusage {
+    timeval_t ru_utime;
+    timeval_t ru_stime;
+    int32_t   ru_maxrss;
+    int32_t   ru_ixrss;
+    int32_t   ru_idrss;
+    int32_t   ru_isrss;
+    int32_t   ru_minflt;
+    int32_t   ru_majflt;
+    int32_t   ru_nswap;
+    int32_t   ru_inblock;   // 512 バイト単位
+    int32_t   ru_oublock;
+    int32_t   ru_msgsnd;
+    int32_t   ru_msgrcv;
+    int32_t   ru_nsignals;
+    int32_t   ru_nvcsw;
+    int32_t   ru_nivcsw;
+} rusage_t;
+
+typedef uint32_t clock_t;   // HZ 単位
+
+typedef struct tms {
+    clock_t tms_utime;
+    clock_t tms_stime;
+    clock_t tms_cutime;
+    clock_t tms_cstime;
+} tms_t;
+
+void       proc_acct_get(process_t* p, proc_acct_t* a);
+int        proc_getrusage(int who, rusage_t* ru);
+clock_t    proc_times(tms_t* t);
+
+// proc/pid.c
+void       pid_init(void);
+pid_t      pid_alloc(void);
+void       pid_free(pid_t pid);
+void       pid_hash_add(process_t* p);
+void       pid_hash_del(process_t* p);
+process_t* pid_lookup(pid_t pid);
@@ -0,0 +1,35 @@
+// include/kernel/rbtree.h - 赤黒木 (侵入型)
+#pragma once
+#include "types.h"
+
+#define RB_RED   0
+#define RB_BLACK 1
+
+typedef struct rb_node {
+    struct rb_node* parent;
+    struct rb_node* left;
+    struct rb_node* right;
+    int             color;
+} rb_node_t;
+
+typedef struct {
+    rb_node_t* root;
+} rb_root_t;
+
+#define RB_ROOT ((rb_root_t){ NULL })
+
+#define rb_entry(ptr, type, member) \
+    ((type*)((char*)(ptr) - __builtin_offsetof(type, member)))
+
+// 挿入: 呼び出し側で位置を探して link → insert_color
+static inline void rb_link_node(rb_node_t* node, rb_node_t* parent, rb_node_t** link) {
+    node->parent = parent;
+    node->left = node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+}
+
+void       rb_insert_color(rb_node_t* node, rb_root_t* root);
+void       rb_erase(rb_node_t* node, rb_root_t* root);
+rb_node_t* rb_first(const rb_root_t* root);
+rb_node_t* rb_next(const rb_node_t* node);
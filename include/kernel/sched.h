@@ -0,0 +1,90 @@
+// include/kernel/sched.h - スケジューラ (CFS)
+#pragma once
+#include "types.h"
+#include "rbtree.h"
+#include "spinlock.h"
+
+#define NICE_MIN    (-20)
+#define NICE_MAX    19
+#define NICE_0_LOAD 1024
+
+#define PRIO_PROCESS 0
+
+// スケジューリングポリシー (Linux 互換の番号)
+#define SCHED_NORMAL   0
+#define SCHED_DEADLINE 6
+
+// デッドライン帯域 (runtime/period) の固定小数点 (2^20 = 100%)
+#define DL_BW_SHIFT 20
+#define DL_BW_UNIT  (1u << DL_BW_SHIFT)
+#define DL_BW_LIMIT (DL_BW_UNIT / 100 * 95)   // 受け入れ上限 95%
+
+typedef struct sched_attr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t  sched_nice;
+    uint32_t sched_priority;
+    uint64_t sched_runtime;    // ns
+    uint64_t sched_deadline;   // ns (周期開始からの相対)
+    uint64_t sched_period;     // ns
+} sched_attr_t;
+
+// 全タスクが一巡する目標時間と、1回の実行の最小粒度
+#define SCHED_LATENCY_NS     20000000ull
+#define SCHED_MIN_GRAN_NS     4000000ull
+#define SCHED_WAKEUP_GRAN_NS  1000000ull
+#define SCHED_NR_LATENCY     (SCHED_LATENCY_NS / SCHED_MIN_GRAN_NS)
+
+struct process;
+struct cgroup;
+
+// 負荷分散の間隔 (tick)
+#define SCHED_BALANCE_TICKS 4
+
+// CPU ごとの実行キュー: READY のタスクを保持 (実行中のタスクは含まない)
+// デッドラインクラスは通常クラスより常に優先する
+typedef struct rq {
+    spinlock_t      lock;
+    int             cpu;
+    int             online;
+
+    // SCHED_DEADLINE: 絶対デッドライン順 (EDF)
+    rb_root_t       dl_tasks;
+    rb_node_t*      dl_leftmost;
+    uint32_t        dl_nr_running;
+    uint32_t        dl_total_bw;
+
+    // SCHED_NORMAL: vruntime 順 (CFS)
+    rb_root_t       tasks;
+    rb_node_t*      leftmost;
+    uint64_t        min_vruntime;
+    uint32_t        nr_running;
+    uint32_t        load_weight;
+    struct process* curr;
+    struct process* idle;
+    struct process* prev;          // 切り替え直後の前タスク (finish_task_switch 用)
+    int             need_resched;
+    uint32_t        balance_tick;
+    uint32_t        nr_migrations; // 他 CPU から引き取った数
+    uint32_t        nr_switches;   // コンテキストスイッチの回数
+} rq_t;
+
+void     sched_init(struct process* idle);
+void     sched_init_cpu(int cpu, struct process* idle);
+void     sched_fork(struct process* p);
+void     sched_wakeup(struct process* p);
+void     sched_set_nice(struct process* p, int nice);
+int      sched_task_setattr(struct process* p, const sched_attr_t* attr);
+void     sched_task_getattr(struct process* p, sched_attr_t* attr);
+void     sched_yield_current(void);
+void     sched_yield_to(struct process* next);
+void     sched_exit(struct process* p);
+void     sched_move_cgroup(struct process* p, struct cgroup* cg);
+uint32_t sched_nr_running(void);
+// 全 CPU の合計 (走っているタスクと実行キューのタスク、スイッチの回数)。ロックは取らない
+void     sched_stat_totals(uint32_t* nr_running, uint32_t* nr_switches);
+void     sched_irq_exit(void);
+void     schedule(void);
+void     scheduler_tick(int user_tick);
+void     finish_task_switch(void);
@@ -0,0 +1,45 @@
+// include/kernel/smp.h - マルチプロセッサ / CPU ごとのデータ
+#pragma once
+#include "types.h"
+
+#define MAX_CPUS 8
+
+// CPU ごとのデータを指すセグメント (GDT 7)。カーネル内では常に %fs に入れておく
+#define PERCPU_SEL 0x38
+
+// AP 起動用のリアルモードコードを置く物理アドレス (SIPI ベクタ = 0x08)
+#define TRAMPOLINE_BASE 0x8000
+
+struct process;
+
+typedef struct cpu {
+    struct cpu*     self;      // %fs:0
+    int             id;
+    uint8_t         apic_id;
+    volatile int    online;
+    struct process* current;
+    struct process* idle;
+    uint32_t        softirq_pending;
+    int             softirq_running;
+    int             preempt_count;  // 0 のときだけカーネル内でプリエンプトできる
+    struct process* fpu_owner;      // FPU レジスタに状態が載っているタスク
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+extern int   nr_cpus;
+
+static inline cpu_t* this_cpu(void) {
+    cpu_t* c;
+    asm volatile("movl %%fs:0, %0" : "=r"(c));
+    return c;
+}
+
+static inline int smp_processor_id(void) {
+    return this_cpu()->id;
+}
+
+void smp_init(void);
+void smp_send_resched(int cpu);
+// pgd を使っている他の CPU の TLB を捨てさせ、終わるまで待つ
+void smp_flush_tlb_others(void* pgd);
+void smp_tlb_flush_ipi(void);
@@ -0,0 +1,19 @@
+// include/kernel/softirq.h - ソフト割り込み (割り込みの後半処理)
+// ハード割り込みは raise_softirq() で印を付けて戻り、
+// 本体は EOI 後に割り込み許可のまま irq_exit() が実行する。
+#pragma once
+#include "types.h"
+
+enum {
+    TIMER_SOFTIRQ = 0,   // 満了したカーネルタイマー
+    INPUT_SOFTIRQ,       // キーボードのスキャンコード処理
+    NR_SOFTIRQS
+};
+
+typedef void (*softirq_fn_t)(void);
+
+void softirq_init(void);
+void open_softirq(int nr, softirq_fn_t fn);
+void raise_softirq(int nr);
+int  in_softirq(void);
+void irq_exit(void);
@@ -0,0 +1,353 @@
+// include/kernel/spinlock.h - スピンロック / チケットロック / rwlock / seqlock
+// どれも保持中はプリエンプション禁止。割り込みハンドラと共有するものは
+// _irqsave 版を使う。眠ってよい区間は mutex.h の mutex_t を使う。
+#pragma once
+#include "types.h"
+#include "irqflags.h"
+#include "preempt.h"
+#include "time.h"
+
+// ===== ロッククラスごとの統計 =====
+// 同じクラスのロックは統計を共有する (実行キューのロックなど)。
+// 統計の更新はそのロックを持ったまま行うので、インスタンスが複数あるクラスの値は近似。
+typedef struct lock_class {
+    const char*        name;
+    uint32_t           acquired;
+    uint32_t           contended;
+    uint64_t           wait_cycles;   // 取得までに回った時間 (TSC)
+    uint64_t           hold_cycles;   // 保持時間の合計 (TSC)
+    uint64_t           max_hold;
+    int                registered;
+    struct lock_class* next;
+} lock_class_t;
+
+#define LOCK_CLASS_INIT(n) { (n), 0, 0, 0, 0, 0, 0, NULL }
+
+extern int           lock_stat_enabled;   // TSC があるときだけ時間を測る
+extern lock_class_t* lock_classes;
+
+void lock_stat_acquired(lock_class_t* c, uint64_t wait_start);
+void lock_stat_contended(lock_class_t* c);
+void lock_stat_released(lock_class_t* c, uint64_t held_since);
+void lock_stat_reset(void);
+
+static inline uint64_t lock_stat_clock(void) {
+    return lock_stat_enabled ? rdtsc() : 0;
+}
+
+// ===== スピンロック (xchg) =====
+typedef struct {
+    volatile uint32_t locked;
+    lock_class_t*     cls;
+    uint64_t          held_since;
+} spinlock_t;
+
+#define SPINLOCK_INIT              { 0, NULL, 0 }
+#define SPINLOCK_INIT_CLASS(cls)   { 0, &(cls), 0 }
+#define DEFINE_SPINLOCK(x) \
+    static lock_class_t x##_class = LOCK_CLASS_INIT(#x); \
+    static spinlock_t x = SPINLOCK_INIT_CLASS(x##_class)
+
+static inline void spin_lock_init(spinlock_t* l) {
+    l->locked = 0;
+    l->cls    = NULL;
+}
+
+static inline void spin_lock_init_class(spinlock_t* l, lock_class_t* cls) {
+    l->locked = 0;
+    l->cls    = cls;
+}
+
+static inline int arch_spin_trylock(spinlock_t* l) {
+    uint32_t v = 1;
+    asm volatile("xchgl %0, %1" : "+r"(v), "+m"(l->locked) :: "memory");
+    return v == 0;
+}
+
+static inline int spin_trylock(spinlock_t* l) {
+    preempt_disable();
+    if (!arch_spin_trylock(l)) {
+        preempt_enable();
+        return 0;
+    }
+    if (l->cls) {
+        lock_stat_acquired(l->cls, 0);
+        l->held_since = lock_stat_clock();
+    }
+    return 1;
+}
+
+static inline void spin_lock(spinlock_t* l) {
+    preempt_disable();
+    uint64_t wait_start = 0;
+    if (!arch_spin_trylock(l)) {
+        if (l->cls) wait_start = lock_stat_clock();
+        do {
+            // 取れるまでは読むだけ (キャッシュラインを奪い合わない)
+            while (l->locked) asm volatile("pause");
+        } while (!arch_spin_trylock(l));
+        if (l->cls) lock_stat_contended(l->cls);
+    }
+    if (l->cls) {
+        lock_stat_acquired(l->cls, wait_start);
+        l->held_since = lock_stat_clock();
+    }
+}
+
+// 解放だけ行い、プリエンプション禁止は呼び出し側で戻す
+static inline void __spin_unlock(spinlock_t* l) {
+    if (l->cls) lock_stat_released(l->cls, l->held_since);
+    asm volatile("" ::: "memory");
+    l->locked = 0;
+}
+
+static inline void spin_unlock(spinlock_t* l) {
+    __spin_unlock(l);
+    preempt_enable();
+}
+
+static inline uint32_t spin_lock_irqsave(spinlock_t* l) {
+    uint32_t flags = local_irq_save();
+    spin_lock(l);
+    return flags;
+}
+
+// 割り込みを戻してから preempt_enable する (保留中の切り替えをここで拾える)
+static inline void spin_unlock_irqrestore(spinlock_t* l, uint32_t flags) {
+    __spin_unlock(l);
+    local_irq_restore(flags);
+    preempt_enable();
+}
+
+// ===== チケットロック =====
+// 待ち順に取れる (多数の CPU が奪い合うロック向け)
+typedef struct {
+    union {
+        volatile uint32_t head_tail;
+        struct {
+            volatile uint16_t owner;   // いま呼ばれている番号
+            volatile uint16_t next;    // 次に配る番号
+        };
+    };
+    lock_class_t* cls;
+    uint64_t      held_since;
+} ticketlock_t;
+
+#define TICKETLOCK_INIT            { { 0 }, NULL, 0 }
+#define TICKETLOCK_INIT_CLASS(cls) { { 0 }, &(cls), 0 }
+#define DEFINE_TICKETLOCK(x) \
+    static lock_class_t x##_class = LOCK_CLASS_INIT(#x); \
+    static ticketlock_t x = TICKETLOCK_INIT_CLASS(x##_class)
+
+static inline void ticket_lock(ticketlock_t* l) {
+    preempt_disable();
+    uint32_t t = 1u << 16;
+    asm volatile("lock; xaddl %0, %1" : "+r"(t), "+m"(l->head_tail) :: "memory");
+    uint16_t me = (uint16_t)(t >> 16);
+    uint64_t wait_start = 0;
+    if ((uint16_t)t != me) {
+        if (l->cls) wait_start = lock_stat_clock();
+        while (l->owner != me) asm volatile("pause");
+        if (l->cls) lock_stat_contended(l->cls);
+    }
+    asm volatile("" ::: "memory");
+    if (l->cls) {
+        lock_stat_acquired(l->cls, wait_start);
+        l->held_since = lock_stat_clock();
+    }
+}
+
+// 誰も並んでいないときだけ取る
+static inline int ticket_trylock(ticketlock_t* l) {
+    preempt_disable();
+    uint32_t old = l->head_tail;
+    if ((old >> 16) != (old & 0xFFFF)) {
+        preempt_enable();
+        return 0;
+    }
+    uint32_t prev;
+    asm volatile("lock; cmpxchgl %2, %1"
+                 : "=a"(prev), "+m"(l->head_tail)
+                 : "r"(old + (1u << 16)), "0"(old) : "memory");
+    if (prev != old) {
+        preempt_enable();
+        return 0;
+    }
+    if (l->cls) {
+        lock_stat_acquired(l->cls, 0);
+        l->held_since = lock_stat_clock();
+    }
+    return 1;
+}
+
+static inline void __ticket_unlock(ticketlock_t* l) {
+    if (l->cls) lock_stat_released(l->cls, l->held_since);
+    asm volatile("" ::: "memory");
+    l->owner++;
+}
+
+static inline void ticket_unlock(ticketlock_t* l) {
+    __ticket_unlock(l);
+    preempt_enable();
+}
+
+static inline uint32_t ticket_lock_irqsave(ticketlock_t* l) {
+    uint32_t flags = local_irq_save();
+    ticket_lock(l);
+    return flags;
+}
+
+static inline void ticket_unlock_irqrestore(ticketlock_t* l, uint32_t flags) {
+    __ticket_unlock(l);
+    local_irq_restore(flags);
+    preempt_enable();
+}
+
+// ===== 読み書きロック =====
+// cnt > 0: 読み手の数、-1: 書き手。読み手優先 (書き手は空くまで回る)
+typedef struct {
+    volatile int32_t cnt;
+    lock_class_t*    cls;
+    uint64_t         held_since;   // 書き手の保持開始
+} rwlock_t;
+
+#define RWLOCK_INIT            { 0, NULL, 0 }
+#define RWLOCK_INIT_CLASS(cls) { 0, &(cls), 0 }
+#define DEFINE_RWLOCK(x) \
+    static lock_class_t x##_class = LOCK_CLASS_INIT(#x); \
+    static rwlock_t x = RWLOCK_INIT_CLASS(x##_class)
+
+static inline int rw_cmpxchg(rwlock_t* l, int32_t old, int32_t new_val) {
+    int32_t prev;
+    asm volatile("lock; cmpxchgl %2, %1"
+                 : "=a"(prev), "+m"(l->cnt) : "r"(new_val), "0"(old) : "memory");
+    return prev == old;
+}
+
+static inline void read_lock(rwlock_t* l) {
+    preempt_disable();
+    uint64_t wait_start = 0;
+    int contended = 0;
+    while (1) {
+        int32_t v = l->cnt;
+        if (v >= 0 && rw_cmpxchg(l, v, v + 1)) break;
+        if (!contended && l->cls) wait_start = lock_stat_clock();
+        contended = 1;
+        asm volatile("pause");
+    }
+    if (l->cls) {
+        if (contended) lock_stat_contended(l->cls);
+        lock_stat_acquired(l->cls, wait_start);
+    }
+}
+
+static inline void __read_unlock(rwlock_t* l) {
+    asm volatile("lock; decl %0" : "+m"(l->cnt) :: "memory");
+}
+
+static inline void read_unlock(rwlock_t* l) {
+    __read_unlock(l);
+    preempt_enable();
+}
+
+static inline void write_lock(rwlock_t* l) {
+    preempt_disable();
+    uint64_t wait_start = 0;
+    if (!rw_cmpxchg(l, 0, -1)) {
+        if (l->cls) wait_start = lock_stat_clock();
+        do {
+            while (l->cnt != 0) asm volatile("pause");
+        } while (!rw_cmpxchg(l, 0, -1));
+        if (l->cls) lock_stat_contended(l->cls);
+    }
+    if (l->cls) {
+        lock_stat_acquired(l->cls, wait_start);
+        l->held_since = lock_stat_clock();
+    }
+}
+
+static inline void __write_unlock(rwlock_t* l) {
+    if (l->cls) lock_stat_released(l->cls, l->held_since);
+    asm volatile("" ::: "memory");
+    l->cnt = 0;
+}
+
+static inline void write_unlock(rwlock_t* l) {
+    __write_unlock(l);
+    preempt_enable();
+}
+
+static inline uint32_t read_lock_irqsave(rwlock_t* l) {
+    uint32_t flags = local_irq_save();
+    read_lock(l);
+    return flags;
+}
+
+static inline void read_unlock_irqrestore(rwlock_t* l, uint32_t flags) {
+    __read_unlock(l);
+    local_irq_restore(flags);
+    preempt_enable();
+}
+
+static inline uint32_t write_lock_irqsave(rwlock_t* l) {
+    uint32_t flags = local_irq_save();
+    write_lock(l);
+    return flags;
+}
+
+static inline void write_unlock_irqrestore(rwlock_t* l, uint32_t flags) {
+    __write_unlock(l);
+    local_irq_restore(flags);
+    preempt_enable();
+}
+
+// ===== seqlock =====
+// 読み手はロックを取らず、書き込み中 (seq が奇数) や途中で書き換わった場合に読み直す。
+// 割り込みで更新される 64bit 値などを i386 で破れずに読むのに使う
+typedef struct {
+    volatile uint32_t seq;
+    spinlock_t        lock;
+} seqlock_t;
+
+#define SEQLOCK_INIT { 0, SPINLOCK_INIT }
+
+static inline void seqlock_init(seqlock_t* s) {
+    s->seq = 0;
+    spin_lock_init(&s->lock);
+}
+
+static inline uint32_t read_seqbegin(const seqlock_t* s) {
+    uint32_t seq;
+    while ((seq = s->seq) & 1) asm volatile("pause");
+    asm volatile("" ::: "memory");
+    return seq;
+}
+
+static inline int read_seqretry(const seqlock_t* s, uint32_t start) {
+    asm volatile("" ::: "memory");
+    return s->seq != start;
+}
+
+static inline void write_seqlock(seqlock_t* s) {
+    spin_lock(&s->lock);
+    s->seq++;
+    asm volatile("" ::: "memory");
+}
+
+static inline void write_sequnlock(seqlock_t* s) {
+    asm volatile("" ::: "memory");
+    s->seq++;
+    spin_unlock(&s->lock);
+}
+
+static inline uint32_t write_seqlock_irqsave(seqlock_t* s) {
+    uint32_t flags = local_irq_save();
+    write_seqlock(s);
+    return flags;
+}
+
+static inline void write_sequnlock_irqrestore(seqlock_t* s, uint32_t flags) {
+    asm volatile("" ::: "memory");
+    s->seq++;
+    spin_unlock_irqrestore(&s->lock, flags);
+}
@@ -0,0 +1,57 @@
+// include/kernel/time.h - TSC クロックソース
+#pragma once
+#include "types.h"
+#include "timer.h"
+
+#define CLOCK_REALTIME  0
+#define CLOCK_MONOTONIC 1
+
+#define NSEC_PER_SEC  1000000000u
+#define NSEC_PER_USEC 1000u
+#define TICK_NSEC     (NSEC_PER_SEC / HZ)
+
+typedef struct timespec {
+    int32_t tv_sec;
+    int32_t tv_nsec;
+} timespec_t;
+
+typedef struct timeval {
+    int32_t tv_sec;
+    int32_t tv_usec;
+} timeval_t;
+
+static inline uint64_t rdtsc(void) {
+    uint64_t v;
+    asm volatile("rdtsc" : "=A"(v));
+    return v;
+}
+
+// 64bit ÷ 32bit (libgcc の __udivdi3 を使わない)
+static inline uint64_t div_u64_rem(uint64_t n, uint32_t d, uint32_t* rem) {
+    uint32_t hi = (uint32_t)(n >> 32), lo = (uint32_t)n;
+    uint32_t qhi = hi / d;
+    uint32_t qlo, r;
+    asm("divl %4" : "=a"(qlo), "=d"(r) : "a"(lo), "d"(hi % d), "rm"(d));
+    if (rem) *rem = r;
+    return ((uint64_t)qhi << 32) | qlo;
+}
+
+// (a * mul) >> shift  (shift <= 32)
+static inline uint64_t mul_u64_u32_shr(uint64_t a, uint32_t mul, int shift) {
+    uint64_t lo = (uint64_t)(uint32_t)a * mul;
+    uint64_t hi = (uint64_t)(uint32_t)(a >> 32) * mul;
+    return (lo >> shift) + (hi << (32 - shift));
+}
+
+// ns → tick (切り上げ)
+static inline uint32_t ns_to_ticks(uint64_t ns) {
+    return (uint32_t)div_u64_rem(ns + TICK_NSEC - 1, TICK_NSEC, NULL);
+}
+
+void     clock_init(void);
+uint64_t ktime_get_ns(void);
+uint32_t tsc_get_khz(void);
+void     clock_tick(void);
+int      ktime_gettime(int clk, timespec_t* ts);
+int      ktime_nanosleep(const timespec_t* req, timespec_t* rem);
+void     udelay(uint32_t us);
@@ -0,0 +1,40 @@
+// include/kernel/timer.h - カーネルタイマー (最小ヒープ)
+#pragma once
+#include "types.h"
+
+#define HZ 100  // PIT 割り込み周波数
+
+#define ETIMEDOUT 110
+
+// tick 比較 (ラップアラウンド対応)
+#define time_after(a, b)  ((int32_t)((b) - (a)) < 0)
+#define time_before(a, b) time_after(b, a)
+
+// 秒と端数に分けて掛ける (ms * HZ は 32bit を越えることがある)
+static inline uint32_t ms_to_ticks(uint32_t ms) {
+    return ms / 1000 * HZ + ((ms % 1000) * HZ + 999) / 1000;
+}
+
+typedef void (*timer_fn_t)(void* data);
+
+typedef struct ktimer {
+    uint32_t   expires;   // 満了 tick
+    timer_fn_t fn;
+    void*      data;
+    int        heap_idx;  // ヒープ内の位置 (-1 = 未登録)
+} ktimer_t;
+
+void     timer_init(void);
+void     timer_setup(ktimer_t* t, timer_fn_t fn, void* data);
+void     timer_add(ktimer_t* t, uint32_t expires);
+int      timer_cancel(ktimer_t* t);
+int      timer_pending(const ktimer_t* t);
+void     timer_run(uint32_t now);
+int      timer_next_expiry(uint32_t* expires);
+
+// tickless idle (kernel/tick.c)
+void     tick_nohz_idle_enter(void);
+void     tick_nohz_idle_exit(void);
+void     tick_nohz_irq(void);
+void     tick_irq_enter(void);
+void     do_timer(void);
@@ -27,7 +27,11 @@ typedef int32_t            off_t;
 #define EINTR   4
 #define EIO     5
 #define ENXIO   6
+#define E2BIG   7
+#define ENOEXEC 8
 #define EBADF   9
+#define ECHILD  10
+#define EAGAIN  11
 #define ENOMEM  12
 #define EACCES  13
 #define EFAULT  14
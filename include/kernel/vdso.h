@@ -0,0 +1,50 @@
+// include/kernel/vdso.h - ユーザーに読ませるカーネルのページ (vDSO データ)
+// 全プロセスの同じ場所に読み取り専用で2枚マップする:
+//   VDSO_DATA_ADDR … 全体で1枚。tick・TSC の較正値・全体の数をカーネルが tick ごとに書く
+//   VDSO_PROC_ADDR … アドレス空間ごとに1枚。pid など
+// ユーザー側は userland/lib/vdso.c の vdso_* で読み、時刻や pid にトラップを使わない。
+// データのページは seqlock で公開する: 書き手は seq を奇数にしてから書き、偶数に戻す。
+// 読み手は seq が偶数で、読む前後で変わっていなければ読んだ値を使う
+#pragma once
+#include "types.h"
+
+#define VDSO_DATA_ADDR  0xB0000000
+#define VDSO_PROC_ADDR  0xB0001000
+#define VDSO_END        0xB0002000
+
+typedef struct vdso_data {
+    volatile uint32_t seq;          // 奇数なら書き込み中
+    uint32_t hz;
+    uint32_t ticks;                 // 起動からの tick
+    uint32_t tsc_ok;                // 0 なら時刻は tick の粒度
+    uint32_t tsc_khz;
+    uint32_t tsc_mult;              // ns = ((rdtsc - tsc_base) * tsc_mult) >> tsc_shift
+    uint32_t tsc_shift;
+    uint32_t pad;
+    uint64_t tsc_base;
+    uint64_t boot_epoch_ns;         // CLOCK_REALTIME = 単調時刻 + これ
+
+    // 全体の数 (tick ごとに取り直す)
+    uint32_t nr_running;            // 走っているか実行キューにいるタスク (idle を除く)
+    uint32_t nr_switches;           // 起動からのコンテキストスイッチ
+    uint32_t nr_forks;              // 起動から作ったプロセス・スレッド
+} vdso_data_t;
+
+typedef struct vdso_proc {
+    pid_t    pid;
+    uint32_t shared;                // CLONE_VM のスレッドがいる (pid はスレッドごとなので使えない)
+} vdso_proc_t;
+
+// ===== カーネル側 (kernel/vdso.c) =====
+struct mm;
+
+void vdso_init(void);
+// TSC の較正が済んだら (clock.c)
+void vdso_set_clock(int tsc_ok, uint32_t khz, uint32_t mult, uint32_t shift,
+                    uint64_t tsc_base, uint64_t boot_epoch_ns);
+// ticks を進めたら (BSP の tick 処理から、割り込み禁止で)
+void vdso_update(void);
+// mm に2枚をマップする (exec と fork の後)。pid はそのアドレス空間の持ち主
+int  vdso_mm_setup(struct mm* mm, pid_t pid);
+// mm を CLONE_VM のスレッドと共有し始めた
+void vdso_mm_shared(struct mm* mm);
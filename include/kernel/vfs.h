@@ -44,6 +44,7 @@ typedef struct vnode {
     void*        data;       // FS固有データ
     struct vnode* mount_point; // マウント先
     uint32_t     ref_count;
+    uint32_t     nrpages;    // ページキャッシュに載っているページ数
 } vnode_t;
 
 typedef struct {
@@ -0,0 +1,55 @@
+// include/kernel/vma.h - ユーザーアドレス空間 (VMA) とページキャッシュ
+// exec はマップする範囲を VMA に登録するだけで、ページはフォルトしたときに用意する。
+// 書き込まないファイルのページはページキャッシュの1枚を全プロセスで共有する。
+#pragma once
+#include "types.h"
+#include "mm.h"
+#include "vfs.h"
+#include "mutex.h"
+
+// vm_area_t.flags
+#define VM_READ   0x01
+#define VM_WRITE  0x02
+#define VM_EXEC   0x04
+#define VM_STACK  0x08
+
+typedef struct vm_area {
+    uint32_t        start;      // ページ境界
+    uint32_t        end;        // [start, end)
+    uint32_t        flags;      // VM_*
+    vnode_t*        file;       // NULL なら無名 (ゼロ埋め)
+    uint32_t        file_off;   // start に対応するファイル位置 (ページ境界)
+    uint32_t        file_end;   // ファイルから読む範囲の終わり (仮想アドレス)。ここから先はゼロ
+    struct vm_area* next;       // start 順
+} vm_area_t;
+
+typedef struct mm {
+    page_directory_t* pgd;
+    vm_area_t*        mmap;
+    uint32_t          start_brk;
+    uint32_t          brk;
+    int               users;    // この mm を使っているプロセス数 (CLONE_VM のスレッドを含む)
+    mutex_t           lock;     // VMA リストとページテーブルの変更
+    struct mm*        reap_next; // 後始末待ちのリスト (kreaper)
+} mm_t;
+
+void       vma_init(void);
+mm_t*      mm_create(void);
+mm_t*      mm_dup(mm_t* old);
+void       mm_get(mm_t* mm);
+void       mm_put(mm_t* mm);
+// 後始末スレッド (kreaper) を起こす。それまでの mm_put はその場で解放する
+void       mm_reaper_init(void);
+int        mm_map(mm_t* mm, uint32_t start, uint32_t end, uint32_t flags,
+                  vnode_t* file, uint32_t file_off, uint32_t file_end);
+vm_area_t* mm_find_vma(mm_t* mm, uint32_t addr);
+uint32_t   mm_brk(mm_t* mm, uint32_t addr);
+
+// ページフォルト: 処理できたら0、不正なアクセスなら -EFAULT
+int        vmm_handle_fault(uint32_t addr, uint32_t err);
+
+// ページキャッシュ (mm/filemap.c)
+void       page_cache_init(void);
+uint32_t   page_cache_get(vnode_t* v, uint32_t index, int* major);
+void       page_cache_invalidate(vnode_t* v);
+uint32_t   page_cache_nr_pages(void);
@@ -0,0 +1,59 @@
+// include/kernel/wait.h - 待ちキュー
+// 条件が成り立つまでタスクを眠らせ、条件を変えた側が wake_up で起こす。
+// wait_event 系マクロは proc.h (current_proc, proc_block_timeout) を必要とする。
+#pragma once
+#include "types.h"
+#include "list.h"
+#include "irqflags.h"
+#include "spinlock.h"
+#include "timer.h"
+
+struct process;
+
+typedef struct {
+    struct process* task;
+    list_head_t     link;
+} wait_queue_entry_t;
+
+typedef struct {
+    spinlock_t  lock;
+    list_head_t head;
+} wait_queue_head_t;
+
+#define WAIT_QUEUE_HEAD_INIT(name) { SPINLOCK_INIT, LIST_HEAD_INIT((name).head) }
+
+void init_waitqueue_head(wait_queue_head_t* wq);
+void add_wait_queue(wait_queue_head_t* wq, wait_queue_entry_t* w);
+void remove_wait_queue(wait_queue_head_t* wq, wait_queue_entry_t* w);
+void wake_up(wait_queue_head_t* wq);      // 先頭の1タスクだけ起こす
+void wake_up_all(wait_queue_head_t* wq);
+
+// キューに入って BLOCKED にしてから条件を見るので、他の CPU から間に来た
+// wake_up は状態を RUNNING に戻し、schedule() はそのまま戻ってくる。
+// timeout は tick 数 (0 = 無期限)。条件成立なら非0、タイムアウトなら0。
+#define wait_event_timeout(wq, cond, timeout) ({                          \
+    uint32_t __tmo = (timeout);                                           \
+    uint32_t __end = ticks + __tmo;                                       \
+    int __ok = 1;                                                         \
+    wait_queue_entry_t __w;                                               \
+    __w.task = current_proc;                                              \
+    list_init(&__w.link);                                                 \
+    uint32_t __flags = local_irq_save();                                  \
+    while (1) {                                                           \
+        add_wait_queue(&(wq), &__w);                                      \
+        current_proc->state = PROC_BLOCKED;                               \
+        if (cond) break;                                                  \
+        uint32_t __left = 0;                                              \
+        if (__tmo) {                                                      \
+            if (!time_before(ticks, __end)) { __ok = 0; break; }          \
+            __left = __end - ticks;                                       \
+        }                                                                 \
+        proc_schedule_timeout(__left);                                    \
+    }                                                                     \
+    current_proc->state = PROC_RUNNING;                                   \
+    remove_wait_queue(&(wq), &__w);                                       \
+    local_irq_restore(__flags);                                           \
+    __ok;                                                                 \
+})
+
+#define wait_event(wq, cond) ((void)wait_event_timeout(wq, cond, 0))
@@ -0,0 +1,22 @@
+// include/kernel/workqueue.h - ワークキュー (眠ってよい後半処理)
+#pragma once
+#include "types.h"
+#include "list.h"
+
+struct work;
+typedef void (*work_fn_t)(struct work* w);
+
+typedef struct work {
+    list_head_t entry;
+    work_fn_t   fn;
+    int         pending;   // キューに入っている
+} work_t;
+
+#define INIT_WORK(w, f) do {            \
+    list_init(&(w)->entry);             \
+    (w)->fn      = (f);                 \
+    (w)->pending = 0;                   \
+} while (0)
+
+void workqueue_init(void);
+int  schedule_work(work_t* w);   // 割り込みからも呼べる。既に入っていれば0
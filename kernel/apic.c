@@ -0,0 +1,85 @@
+// kernel/apic.c - ローカル APIC (IPI とCPUごとのタイマー)
+#include "../include/kernel/apic.h"
+#include "../include/kernel/mm.h"
+#include "../include/kernel/timer.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/types.h"
+
+#define LAPIC_ID         0x020
+#define LAPIC_TPR        0x080
+#define LAPIC_EOI        0x0B0
+#define LAPIC_SVR        0x0F0
+#define LAPIC_ICR_LO     0x300
+#define LAPIC_ICR_HI     0x310
+#define LAPIC_LVT_TIMER  0x320
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR  0x390
+#define LAPIC_TIMER_DIV  0x3E0
+
+#define SVR_ENABLE       0x100
+#define ICR_PENDING      0x1000
+#define TIMER_PERIODIC   0x20000
+#define TIMER_DIV_16     0x3
+#define CALIBRATE_US     10000
+
+static volatile uint32_t* lapic = NULL;
+static uint32_t lapic_ticks_per_hz = 0;   // 1 tick 分のタイマーカウント
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t val) {
+    lapic[reg / 4] = val;
+    (void)lapic[LAPIC_ID / 4];   // 書き込みを確定させる
+}
+
+// MMIO をキャッシュ無効でアイデンティティマップ (上位のPDEなので全空間で共有)
+void lapic_setup(uint32_t phys) {
+    vmm_map(vmm_get_kernel_directory(), phys, phys,
+            PAGE_PRESENT | PAGE_WRITE | PAGE_NOCACHE);
+    lapic = (volatile uint32_t*)phys;
+}
+
+int lapic_present(void) {
+    return lapic != NULL;
+}
+
+// 各 CPU で呼ぶ
+void lapic_init(void) {
+    lapic_write(LAPIC_SVR, SVR_ENABLE | SPURIOUS_VECTOR);
+    lapic_write(LAPIC_TPR, 0);
+}
+
+uint8_t lapic_id(void) {
+    return (uint8_t)(lapic_read(LAPIC_ID) >> 24);
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_EOI, 0);
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint32_t icr) {
+    lapic_write(LAPIC_ICR_HI, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LO, icr);
+    while (lapic_read(LAPIC_ICR_LO) & ICR_PENDING) asm volatile("pause");
+}
+
+// BSP で1回だけ: 10ms でいくつ減るかを測る
+void lapic_timer_calibrate(void) {
+    lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, 0x10000);   // マスクしたまま数える
+    lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+    udelay(CALIBRATE_US);
+    uint32_t elapsed = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    lapic_ticks_per_hz = elapsed / (HZ * CALIBRATE_US / 1000000);
+}
+
+// AP の周期 tick (BSP は PIT を使う)
+void lapic_timer_start(void) {
+    lapic_write(LAPIC_TIMER_DIV, TIMER_DIV_16);
+    lapic_write(LAPIC_LVT_TIMER, TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+    lapic_write(LAPIC_TIMER_INIT, lapic_ticks_per_hz);
+}
@@ -0,0 +1,143 @@
+// kernel/async.c - 非同期タスクの実行 (kasync スレッド)
+// 実行キューは1本で、継続を呼ぶのは kasync スレッドだけ。
+// 継続の途中で完了の通知が来ても (割り込み・他の CPU)、タスクはキューに積まれるだけで
+// 今の継続が戻るまで次は呼ばれない。
+#include "../include/kernel/async.h"
+#include "../include/kernel/kthread.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/wait.h"
+#include "../include/kernel/mm.h"
+#include "../include/kernel/types.h"
+
+static list_head_t       async_runq = LIST_HEAD_INIT(async_runq);
+static wait_queue_head_t async_wq   = WAIT_QUEUE_HEAD_INIT(async_wq);
+DEFINE_SPINLOCK(async_lock);
+static lock_class_t      async_event_class = LOCK_CLASS_INIT("async_event");
+static kmem_cache_t*     async_cache;
+static volatile uint32_t async_count;
+
+async_task_t* async_create(async_fn_t fn, void* data) {
+    async_task_t* t = (async_task_t*)kmem_cache_alloc(async_cache);
+    if (!t) return NULL;
+    t->fn      = fn;
+    t->data    = data;
+    t->step    = 0;
+    t->result  = 0;
+    t->queued  = 0;
+    t->on_done = NULL;
+    list_init(&t->link);
+    timer_setup(&t->timer, NULL, t);
+    asm volatile("lock; incl %0" : "+m"(async_count) :: "memory");
+    return t;
+}
+
+void async_complete(async_task_t* t, int result) {
+    uint32_t flags = spin_lock_irqsave(&async_lock);
+    t->result = result;
+    if (!t->queued) {
+        t->queued = 1;
+        list_add_tail(&t->link, &async_runq);
+    }
+    spin_unlock_irqrestore(&async_lock, flags);
+    wake_up(&async_wq);
+}
+
+void async_spawn(async_task_t* t) {
+    async_complete(t, 0);
+}
+
+static void async_timer_fn(void* data) {
+    async_complete((async_task_t*)data, 0);
+}
+
+void async_sleep(async_task_t* t, uint32_t n, async_fn_t next) {
+    t->fn = next;
+    timer_setup(&t->timer, async_timer_fn, t);
+    timer_add(&t->timer, ticks + (n ? n : 1));
+}
+
+void async_event_init(async_event_t* ev) {
+    spin_lock_init_class(&ev->lock, &async_event_class);
+    list_init(&ev->waiters);
+}
+
+void async_wait(async_event_t* ev, async_task_t* t, async_fn_t next) {
+    t->fn = next;
+    uint32_t flags = spin_lock_irqsave(&ev->lock);
+    list_add_tail(&t->link, &ev->waiters);
+    spin_unlock_irqrestore(&ev->lock, flags);
+}
+
+int async_event_cancel(async_event_t* ev, async_task_t* t) {
+    uint32_t flags = spin_lock_irqsave(&ev->lock);
+    int waiting = 0;
+    list_head_t* pos;
+    list_for_each(pos, &ev->waiters) {
+        if (pos == &t->link) { waiting = 1; break; }
+    }
+    if (waiting) list_del(&t->link);
+    spin_unlock_irqrestore(&ev->lock, flags);
+    return waiting;
+}
+
+static int event_signal(async_event_t* ev, int result, int max) {
+    int n = 0;
+    while (n < max) {
+        uint32_t flags = spin_lock_irqsave(&ev->lock);
+        if (list_empty(&ev->waiters)) {
+            spin_unlock_irqrestore(&ev->lock, flags);
+            break;
+        }
+        async_task_t* t = list_entry(ev->waiters.next, async_task_t, link);
+        list_del(&t->link);
+        spin_unlock_irqrestore(&ev->lock, flags);
+        async_complete(t, result);
+        n++;
+    }
+    return n;
+}
+
+int async_event_signal(async_event_t* ev, int result) {
+    return event_signal(ev, result, 1);
+}
+
+int async_event_signal_all(async_event_t* ev, int result) {
+    return event_signal(ev, result, 0x7FFFFFFF);
+}
+
+uint32_t async_nr_tasks(void) {
+    return async_count;
+}
+
+static void async_free(async_task_t* t) {
+    if (t->on_done) t->on_done(t);
+    kmem_cache_free(async_cache, t);
+    asm volatile("lock; decl %0" : "+m"(async_count) :: "memory");
+}
+
+static int async_thread(void* arg) {
+    (void)arg;
+    while (!kthread_should_stop()) {
+        wait_event(async_wq, !list_empty(&async_runq) || kthread_should_stop());
+
+        uint32_t flags = spin_lock_irqsave(&async_lock);
+        while (!list_empty(&async_runq)) {
+            async_task_t* t = list_entry(async_runq.next, async_task_t, link);
+            list_del(&t->link);
+            t->queued = 0;
+            spin_unlock_irqrestore(&async_lock, flags);
+
+            int r = t->fn(t);
+            if (r == ASYNC_DONE)       async_free(t);
+            else if (r == ASYNC_AGAIN) async_complete(t, t->result);
+            flags = spin_lock_irqsave(&async_lock);
+        }
+        spin_unlock_irqrestore(&async_lock, flags);
+    }
+    return 0;
+}
+
+void async_init(void) {
+    async_cache = kmem_cache_create("async_task", sizeof(async_task_t), 16);
+    kthread_create(async_thread, NULL, "kasync");
+}
@@ -0,0 +1,291 @@
+// kernel/cgroup.c - コントロールグループの木・メモリの課金・スケジューラとのつなぎ
+// ルートは静的に置き、起動直後から全タスクが属する。子グループは cgroupfs の mkdir で作る。
+// ページとヒープのブロックには課金したグループの id を記録しておき、解放時にそこから引く。
+// グループを消すときは記録を親の id に付け替える (使用量は元から親にも足してある)
+#include "../include/kernel/cgroup.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/sched.h"
+#include "../include/kernel/mm.h"
+#include "../include/kernel/mutex.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/softirq.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/types.h"
+
+#define CGROUP_MAX_DEPTH 8
+// vruntime の増分を掛け合わせても 64bit に収まるよう、1段ごとにこれで抑える
+#define CG_DELTA_MAX     (1ull << 40)
+
+cgroup_t cgroup_root = {
+    .id       = CGROUP_ROOT_ID,
+    .name     = "/",
+    .children = LIST_HEAD_INIT(cgroup_root.children),
+    .sibling  = LIST_HEAD_INIT(cgroup_root.sibling),
+    .weight   = CGROUP_WEIGHT_DFL,
+    .mem_max  = CGROUP_MEM_UNLIMITED,
+};
+
+// id → グループ。消したグループの id は付け替えが終わるまで親を指す
+static cgroup_t* cgroup_table[CGROUP_MAX] = { [CGROUP_ROOT_ID] = &cgroup_root };
+
+// 木の形と設定 (mkdir / rmdir / attach は眠ることがある)
+DEFINE_MUTEX(cgroup_mutex);
+// nr_tasks と process_t.cgroup の差し替え (fork と rmdir の競合を防ぐ)
+DEFINE_SPINLOCK(cgroup_task_lock);
+// 使用量と上限。pmm_lock / heap_lock の内側で取る末端のロック
+DEFINE_SPINLOCK(cgroup_mem_lock);
+
+extern void cgroupfs_mount(const char* path);
+extern int  cgroupfs_busy(cgroup_t* cg);
+extern void cgroupfs_release(cgroup_t* cg);
+
+static void kstrcpy(char* d, const char* s) { while ((*d++ = *s++)); }
+static size_t kstrlen(const char* s) { size_t n = 0; while (s[n]) n++; return n; }
+static int kstrcmp(const char* a, const char* b) {
+    while (*a && *a == *b) { a++; b++; }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+static void kmemset(void* d, int v, size_t n) {
+    uint8_t* p = (uint8_t*)d; for (size_t i = 0; i < n; i++) p[i] = (uint8_t)v;
+}
+
+static inline void atomic_add(volatile uint32_t* v, int d) {
+    asm volatile("lock; addl %1, %0" : "+m"(*v) : "ir"(d) : "memory");
+}
+
+void cgroup_init(void) {
+    cgroupfs_mount("/sys/fs/cgroup");
+}
+
+void cgroup_lock(void)   { mutex_lock(&cgroup_mutex); }
+void cgroup_unlock(void) { mutex_unlock(&cgroup_mutex); }
+
+// ===== 木 =====
+static inline cgroup_t* cgroup_of(list_head_t* link) {
+    return list_entry(link, cgroup_t, sibling);
+}
+
+// cgroup_mutex を持って呼ぶ
+cgroup_t* cgroup_find_child(cgroup_t* parent, const char* name) {
+    list_head_t* pos;
+    list_for_each(pos, &parent->children) {
+        if (kstrcmp(cgroup_of(pos)->name, name) == 0) return cgroup_of(pos);
+    }
+    return NULL;
+}
+
+cgroup_t* cgroup_child_at(cgroup_t* parent, uint32_t index) {
+    list_head_t* pos;
+    list_for_each(pos, &parent->children) {
+        if (index-- == 0) return cgroup_of(pos);
+    }
+    return NULL;
+}
+
+int cgroup_mkdir(cgroup_t* parent, const char* name) {
+    size_t len = kstrlen(name);
+    if (!len || len >= CGROUP_NAME_LEN) return -EINVAL;
+    for (size_t i = 0; i < len; i++) if (name[i] == '/') return -EINVAL;
+    if (parent->depth + 1 > CGROUP_MAX_DEPTH) return -ENOSPC;
+
+    cgroup_t* cg = (cgroup_t*)kmalloc(sizeof(cgroup_t));
+    if (!cg) return -ENOMEM;
+    kmemset(cg, 0, sizeof(cgroup_t));
+    kstrcpy(cg->name, name);
+    cg->parent  = parent;
+    cg->depth   = parent->depth + 1;
+    cg->weight  = CGROUP_WEIGHT_DFL;
+    cg->mem_max = CGROUP_MEM_UNLIMITED;
+    list_init(&cg->children);
+
+    int ret = 0;
+    mutex_lock(&cgroup_mutex);
+    if (cgroup_find_child(parent, name)) {
+        ret = -EEXIST;
+    } else {
+        ret = -ENOSPC;
+        uint32_t flags = spin_lock_irqsave(&cgroup_mem_lock);
+        for (int id = CGROUP_ROOT_ID + 1; id < CGROUP_MAX; id++) {
+            if (cgroup_table[id]) continue;
+            cg->id = id;
+            cgroup_table[id] = cg;
+            ret = 0;
+            break;
+        }
+        spin_unlock_irqrestore(&cgroup_mem_lock, flags);
+        if (!ret) list_add_tail(&cg->sibling, &parent->children);
+    }
+    mutex_unlock(&cgroup_mutex);
+    if (ret) kfree(cg);
+    return ret;
+}
+
+// 子もタスクも無く、ファイルが開かれていないグループだけ消せる
+int cgroup_rmdir(cgroup_t* parent, const char* name) {
+    mutex_lock(&cgroup_mutex);
+    cgroup_t* cg = cgroup_find_child(parent, name);
+    if (!cg) {
+        mutex_unlock(&cgroup_mutex);
+        return -ENOENT;
+    }
+    uint32_t flags = spin_lock_irqsave(&cgroup_task_lock);
+    int busy = cg->nr_tasks || !list_empty(&cg->children) || cgroupfs_busy(cg);
+    if (!busy) list_del(&cg->sibling);
+    spin_unlock_irqrestore(&cgroup_task_lock, flags);
+    if (busy) {
+        mutex_unlock(&cgroup_mutex);
+        return -EBUSY;
+    }
+
+    // 残っている課金を親に付け替える。その間に解放されたものは親から引く
+    flags = spin_lock_irqsave(&cgroup_mem_lock);
+    cgroup_table[cg->id] = parent;
+    spin_unlock_irqrestore(&cgroup_mem_lock, flags);
+    pmm_reparent(cg->id, parent->id);
+    heap_reparent(cg->id, parent->id);
+    flags = spin_lock_irqsave(&cgroup_mem_lock);
+    cgroup_table[cg->id] = NULL;
+    spin_unlock_irqrestore(&cgroup_mem_lock, flags);
+
+    cgroupfs_release(cg);
+    mutex_unlock(&cgroup_mutex);
+    kfree(cg);
+    return 0;
+}
+
+// ===== タスク =====
+void cgroup_fork(process_t* p) {
+    uint32_t flags = spin_lock_irqsave(&cgroup_task_lock);
+    cgroup_t* cg = (current_proc && current_proc->cgroup) ? current_proc->cgroup : &cgroup_root;
+    p->cgroup      = cg;
+    p->cg_runnable = 0;
+    cg->nr_tasks++;
+    spin_unlock_irqrestore(&cgroup_task_lock, flags);
+}
+
+void cgroup_exit(process_t* p) {
+    if (!p->cgroup) return;
+    uint32_t flags = spin_lock_irqsave(&cgroup_task_lock);
+    p->cgroup->nr_tasks--;
+    spin_unlock_irqrestore(&cgroup_task_lock, flags);
+}
+
+// 移す前に課金した分は元のグループに残る (解放されたときに元から引く)
+int cgroup_attach(cgroup_t* cg, pid_t pid) {
+    read_lock(&tasklist_lock);
+    process_t* p = pid ? proc_get(pid) : current_proc;
+    if (p) proc_pin(p);
+    read_unlock(&tasklist_lock);
+    if (!p) return -ESRCH;
+
+    int ret = 0;
+    mutex_lock(&cgroup_mutex);
+    uint32_t flags = spin_lock_irqsave(&cgroup_task_lock);
+    if (p->pid == 0 || p->state == PROC_ZOMBIE) {
+        ret = -EINVAL;
+    } else if (p->cgroup != cg) {
+        p->cgroup->nr_tasks--;
+        cg->nr_tasks++;
+        sched_move_cgroup(p, cg);
+    }
+    spin_unlock_irqrestore(&cgroup_task_lock, flags);
+    mutex_unlock(&cgroup_mutex);
+    proc_unpin(p);
+    return ret;
+}
+
+int cgroup_set_weight(cgroup_t* cg, uint32_t weight) {
+    if (cg == &cgroup_root) return -EPERM;
+    if (weight < CGROUP_WEIGHT_MIN || weight > CGROUP_WEIGHT_MAX) return -EINVAL;
+    cg->weight = weight;
+    return 0;
+}
+
+// 既に上限を超えている分は取り上げない (以後の確保が失敗するだけ)
+int cgroup_set_mem_max(cgroup_t* cg, uint32_t bytes) {
+    if (cg == &cgroup_root) return -EPERM;
+    uint32_t flags = spin_lock_irqsave(&cgroup_mem_lock);
+    cg->mem_max = bytes;
+    spin_unlock_irqrestore(&cgroup_mem_lock, flags);
+    return 0;
+}
+
+uint64_t cgroup_cpu_usage(cgroup_t* cg) {
+    uint64_t sum = 0;
+    for (int i = 0; i < MAX_CPUS; i++) sum += cg->cpu_usage[i];
+    return sum;
+}
+
+// ===== メモリ =====
+cgroup_t* cgroup_charge_target(void) {
+    process_t* p = current_proc;
+    if (!p || in_softirq()) return NULL;
+    return p->cgroup;
+}
+
+// cgroup_mem_lock を持って呼ぶ。bytes を足すと上限を超えるグループ (無ければ NULL)
+static cgroup_t* over_limit(cgroup_t* cg, uint32_t bytes) {
+    for (; cg; cg = cg->parent) {
+        if (cg->mem_usage >= cg->mem_max || cg->mem_max - cg->mem_usage < bytes) return cg;
+    }
+    return NULL;
+}
+
+int cgroup_charge(cgroup_t* cg, int type, uint32_t bytes, int force) {
+    uint32_t flags = spin_lock_irqsave(&cgroup_mem_lock);
+    cgroup_t* over = force ? NULL : over_limit(cg, bytes);
+    if (over) {
+        over->mem_events_max++;
+        spin_unlock_irqrestore(&cgroup_mem_lock, flags);
+        return -ENOMEM;
+    }
+    for (; cg; cg = cg->parent) {
+        cg->mem_usage      += bytes;
+        cg->mem_stat[type] += bytes;
+        if (cg->mem_usage > cg->mem_peak) cg->mem_peak = cg->mem_usage;
+    }
+    spin_unlock_irqrestore(&cgroup_mem_lock, flags);
+    return 0;
+}
+
+void cgroup_uncharge(int id, int type, uint32_t bytes) {
+    uint32_t flags = spin_lock_irqsave(&cgroup_mem_lock);
+    for (cgroup_t* cg = cgroup_table[id]; cg; cg = cg->parent) {
+        cg->mem_usage      -= cg->mem_usage      < bytes ? cg->mem_usage      : bytes;
+        cg->mem_stat[type] -= cg->mem_stat[type] < bytes ? cg->mem_stat[type] : bytes;
+    }
+    spin_unlock_irqrestore(&cgroup_mem_lock, flags);
+}
+
+int cgroup_mem_check(cgroup_t* cg, uint32_t bytes) {
+    if (!cg) return 0;
+    uint32_t flags = spin_lock_irqsave(&cgroup_mem_lock);
+    cgroup_t* over = over_limit(cg, bytes);
+    if (over) over->mem_events_max++;
+    spin_unlock_irqrestore(&cgroup_mem_lock, flags);
+    return over ? -ENOMEM : 0;
+}
+
+// ===== スケジューラ =====
+// ルートの数は使わないので数えない (ルートのタスクは手間がかからない)
+void cgroup_runnable(cgroup_t* cg, int delta) {
+    for (; cg && cg->parent; cg = cg->parent) atomic_add(&cg->nr_running, delta);
+}
+
+// 各段で「そのグループの取り分 (weight/100 タスク分) を走れるタスクで等分した」重みとして扱う。
+// 同じ実時間でも、混んでいるグループや重みの小さいグループのタスクほど vruntime が速く進む
+uint64_t cgroup_scale_delta(cgroup_t* cg, uint64_t delta) {
+    for (; cg && cg->parent; cg = cg->parent) {
+        uint32_t nr = cg->nr_running;
+        if (nr < 1) nr = 1;
+        if (nr == 1 && cg->weight == CGROUP_WEIGHT_DFL) continue;
+        if (delta > CG_DELTA_MAX) delta = CG_DELTA_MAX;
+        delta = div_u64_rem(delta * nr * CGROUP_WEIGHT_DFL, cg->weight, NULL);
+    }
+    return delta;
+}
+
+void cgroup_account_cpu(cgroup_t* cg, uint64_t delta) {
+    int cpu = smp_processor_id();
+    for (; cg; cg = cg->parent) cg->cpu_usage[cpu] += delta;
+}
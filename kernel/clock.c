@@ -0,0 +1,181 @@
+// kernel/clock.c - TSC クロックソース / clock_gettime / nanosleep
+#include "../include/kernel/time.h"
+#include "../include/kernel/timer.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/vdso.h"
+#include "../include/kernel/types.h"
+#include "../kernel/io.h"
+
+#define PIT_HZ         1193180
+#define CALIBRATE_MS   50
+#define TSC_SHIFT      22
+#define SPIN_MAX_NS    50000   // nanosleep の残りがこれ以下なら TSC で回って待つ
+
+extern void kprintf(const char* fmt, ...);
+
+static int      tsc_ok    = 0;
+static uint32_t tsc_khz   = 0;
+static uint32_t tsc_mult  = 0;  // ns = (cycles * tsc_mult) >> TSC_SHIFT
+static uint64_t tsc_base  = 0;
+static uint64_t boot_epoch_ns = 0;  // 起動時の RTC 時刻
+static uint64_t tick_last_ns  = 0;  // 直前のタイマー割り込みの時刻
+static seqlock_t tick_seq     = SEQLOCK_INIT;  // tick_last_ns は 64bit なので読み書きが割れる
+
+static int cpu_has_tsc(void) {
+    uint32_t a = 1, b, c, d;
+    asm volatile("cpuid" : "+a"(a), "=b"(b), "=c"(c), "=d"(d));
+    return (d >> 4) & 1;
+}
+
+// PIT チャンネル2 を CALIBRATE_MS だけ回して TSC の周波数を測る
+static uint32_t tsc_calibrate(void) {
+    uint32_t count = PIT_HZ / 1000 * CALIBRATE_MS;
+
+    // ゲートON, スピーカー出力OFF
+    outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+    outb(0x43, 0xB0);                  // ch2, lo/hi, モード0
+    outb(0x42, count & 0xFF);
+    outb(0x42, (count >> 8) & 0xFF);
+
+    uint64_t start = rdtsc();
+    while (!(inb(0x61) & 0x20));       // OUT2 が立つまで待つ
+    uint64_t end = rdtsc();
+
+    return (uint32_t)div_u64_rem(end - start, CALIBRATE_MS, NULL);
+}
+
+// ===== RTC (CMOS) =====
+static uint8_t cmos_read(uint8_t reg) {
+    outb(0x70, reg);
+    return inb(0x71);
+}
+
+static uint32_t bcd(uint8_t v, int is_bcd) {
+    return is_bcd ? (uint32_t)((v & 0x0F) + (v >> 4) * 10) : v;
+}
+
+// 1970-01-01 からの日数 (proleptic Gregorian)
+static int32_t days_from_civil(int32_t y, uint32_t m, uint32_t d) {
+    y -= m <= 2;
+    int32_t  era = (y >= 0 ? y : y - 399) / 400;
+    uint32_t yoe = (uint32_t)(y - era * 400);
+    uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+static uint32_t rtc_read_epoch(void) {
+    while (cmos_read(0x0A) & 0x80);   // 更新中は待つ
+    uint8_t sec = cmos_read(0x00), min = cmos_read(0x02), hour = cmos_read(0x04);
+    uint8_t day = cmos_read(0x07), mon = cmos_read(0x08), year = cmos_read(0x09);
+    uint8_t regb = cmos_read(0x0B);
+    int is_bcd = !(regb & 0x04);
+
+    int pm = hour & 0x80;
+    uint32_t h = bcd(hour & 0x7F, is_bcd);
+    if (!(regb & 0x02) && pm) h = (h % 12) + 12;   // 12時間制
+
+    int32_t days = days_from_civil(2000 + (int32_t)bcd(year, is_bcd),
+                                   bcd(mon, is_bcd), bcd(day, is_bcd));
+    return (uint32_t)days * 86400 + h * 3600 + bcd(min, is_bcd) * 60 + bcd(sec, is_bcd);
+}
+
+// ===== 公開API =====
+void clock_init(void) {
+    boot_epoch_ns = (uint64_t)rtc_read_epoch() * NSEC_PER_SEC;
+
+    tsc_ok = cpu_has_tsc();
+    if (!tsc_ok) {
+        kprintf("[CLOCK] no TSC, using %d Hz ticks\n", HZ);
+        vdso_set_clock(0, 0, 0, TSC_SHIFT, 0, boot_epoch_ns);
+        return;
+    }
+    tsc_khz  = tsc_calibrate();
+    tsc_mult = (uint32_t)div_u64_rem((uint64_t)1000000 << TSC_SHIFT, tsc_khz, NULL);
+    tsc_base = rdtsc() - div_u64_rem((uint64_t)ticks * TICK_NSEC * tsc_khz, 1000000, NULL);
+    kprintf("[CLOCK] TSC %d.%03d MHz\n", tsc_khz / 1000, tsc_khz % 1000);
+    vdso_set_clock(1, tsc_khz, tsc_mult, TSC_SHIFT, tsc_base, boot_epoch_ns);
+    lock_stat_enabled = 1;
+}
+
+uint32_t tsc_get_khz(void) { return tsc_khz; }
+
+// 割り込みを使わないビジーウェイト (AP 起動など)
+void udelay(uint32_t us) {
+    if (!tsc_ok) {
+        // TSC が無ければ I/O ポート 0x80 への書き込み (~1us) で代用
+        while (us--) outb(0x80, 0);
+        return;
+    }
+    uint64_t end = rdtsc() + div_u64_rem((uint64_t)us * tsc_khz, 1000, NULL);
+    while (rdtsc() < end) asm volatile("pause");
+}
+
+// 起動からの単調増加ナノ秒
+uint64_t ktime_get_ns(void) {
+    if (!tsc_ok) return (uint64_t)ticks * TICK_NSEC;
+    return mul_u64_u32_shr(rdtsc() - tsc_base, tsc_mult, TSC_SHIFT);
+}
+
+// タイマー割り込みごとに呼ぶ (nanosleep の tick 位相合わせ用)
+void clock_tick(void) {
+    uint32_t flags = write_seqlock_irqsave(&tick_seq);
+    tick_last_ns = ktime_get_ns();
+    write_sequnlock_irqrestore(&tick_seq, flags);
+}
+
+static uint64_t last_tick_ns(void) {
+    uint64_t ns;
+    uint32_t seq;
+    do {
+        seq = read_seqbegin(&tick_seq);
+        ns  = tick_last_ns;
+    } while (read_seqretry(&tick_seq, seq));
+    return ns;
+}
+
+static void ns_to_timespec(uint64_t ns, timespec_t* ts) {
+    uint32_t rem;
+    ts->tv_sec  = (int32_t)div_u64_rem(ns, NSEC_PER_SEC, &rem);
+    ts->tv_nsec = (int32_t)rem;
+}
+
+int ktime_gettime(int clk, timespec_t* ts) {
+    if (!ts) return -EFAULT;
+    uint64_t now = ktime_get_ns();
+    if (clk == CLOCK_REALTIME) now += boot_epoch_ns;
+    else if (clk != CLOCK_MONOTONIC) return -EINVAL;
+    ns_to_timespec(now, ts);
+    return 0;
+}
+
+// tick 単位で眠れる分は眠り、1tick 未満の残りだけ TSC を見てスピンする
+int ktime_nanosleep(const timespec_t* req, timespec_t* rem) {
+    if (!req || req->tv_nsec < 0 || req->tv_nsec >= (int32_t)NSEC_PER_SEC || req->tv_sec < 0)
+        return -EINVAL;
+
+    uint64_t now      = ktime_get_ns();
+    uint64_t deadline = now + (uint64_t)req->tv_sec * NSEC_PER_SEC + (uint32_t)req->tv_nsec;
+
+    while (now < deadline) {
+        // k tick 後の割り込みが deadline を越えない最大の k
+        uint64_t last = last_tick_ns();
+        uint64_t base = (now - last < TICK_NSEC) ? last : now;
+        uint32_t k = (uint32_t)div_u64_rem(deadline - base, TICK_NSEC, NULL);
+        // 回るのは短い残りだけ。それより長い端数は 1 tick 寝て切り上げる
+        if (tsc_ok && deadline - now <= SPIN_MAX_NS) {
+            while (ktime_get_ns() < deadline) asm volatile("pause");
+            break;
+        }
+        proc_block_timeout(PROC_SLEEPING, k ? k : 1);
+        now = ktime_get_ns();
+
+        if (current_proc->pending_sigs && now < deadline) {
+            if (rem) ns_to_timespec(deadline - now, rem);
+            return -EINTR;
+        }
+    }
+    if (rem) rem->tv_sec = rem->tv_nsec = 0;
+    return 0;
+}
@@ -0,0 +1,155 @@
+// kernel/fpu.c - FPU/SSE 状態の遅延切り替え
+#include "../include/kernel/fpu.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/smp.h"
+#include "../include/kernel/mm.h"
+#include "../include/kernel/preempt.h"
+#include "../include/kernel/irqflags.h"
+#include "../include/kernel/types.h"
+
+extern void kprintf(const char* fmt, ...);
+
+static int           has_fxsr = 0;
+static fpu_state_t   fpu_init_state;   // fninit 直後の状態 (新しいタスク用)
+static kmem_cache_t* fpu_cache = NULL;
+
+static void fpu_save(fpu_state_t* st) {
+    if (has_fxsr) asm volatile("fxsave %0" : "=m"(*st));
+    else          asm volatile("fnsave %0; fwait" : "=m"(*st));
+}
+
+static void fpu_restore(const fpu_state_t* st) {
+    if (has_fxsr) asm volatile("fxrstor %0" :: "m"(*st));
+    else          asm volatile("frstor %0" :: "m"(*st));
+}
+
+static void kmemcpy(void* dst, const void* src, size_t n) {
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+    for (size_t i = 0; i < n; i++) d[i] = s[i];
+}
+
+void fpu_init_cpu(void) {
+    uint32_t cr0, cr4;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 &= ~CR0_EM;
+    cr0 |= CR0_MP | CR0_NE | CR0_TS;
+    asm volatile("mov %0, %%cr0" :: "r"(cr0));
+    if (has_fxsr) {
+        asm volatile("mov %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+        asm volatile("mov %0, %%cr4" :: "r"(cr4));
+    }
+    this_cpu()->fpu_owner = NULL;
+}
+
+void fpu_init(void) {
+    uint32_t a = 1, b, c, d;
+    asm volatile("cpuid" : "+a"(a), "=b"(b), "=c"(c), "=d"(d));
+    has_fxsr = (d >> 24) & 1;
+    int has_sse = (d >> 25) & 1;
+
+    fpu_init_cpu();
+
+    // 既定の状態を1つ作っておき、初めて FPU を使うタスクにはそれを読ませる
+    clts();
+    asm volatile("fninit");
+    if (has_sse) {
+        uint32_t mxcsr = MXCSR_DEFAULT;
+        asm volatile("ldmxcsr %0" :: "m"(mxcsr));
+    }
+    fpu_save(&fpu_init_state);
+    stts();
+
+    fpu_cache = kmem_cache_create("fpu_state", sizeof(fpu_state_t), 16);
+    kprintf("[FPU] %s, lazy switching\n", has_sse ? "SSE (fxsave)" : (has_fxsr ? "fxsave" : "x87 (fnsave)"));
+}
+
+// schedule() から、実行キューのロックを持って呼ぶ。
+// 次のタスクの状態がまだレジスタに残っていればそのまま使わせる
+void fpu_switch_to(process_t* next) {
+    if (this_cpu()->fpu_owner == next) clts();
+    else stts();
+}
+
+// 割り込み禁止で入る
+void fpu_nm_trap(void) {
+    cpu_t* cpu = this_cpu();
+    process_t* cur = cpu->current;
+    clts();
+    if (cpu->fpu_owner == cur) return;
+
+    if (cpu->fpu_owner) fpu_save(cpu->fpu_owner->fpu);
+    cpu->fpu_owner = NULL;
+
+    if (!cur->fpu) {
+        cur->fpu = (fpu_state_t*)kmem_cache_alloc(fpu_cache);
+        if (!cur->fpu) {
+            kprintf("[FPU] out of memory for %s (pid %d)\n", cur->name, cur->pid);
+            stts();
+            return;
+        }
+        kmemcpy(cur->fpu, &fpu_init_state, sizeof(fpu_state_t));
+    }
+    fpu_restore(cur->fpu);
+    cpu->fpu_owner = cur;
+}
+
+// 親の状態がレジスタにしか無ければ先に書き出してから写す
+int fpu_fork(process_t* child, process_t* parent) {
+    child->fpu = NULL;
+    if (!parent->fpu) return 0;
+
+    child->fpu = (fpu_state_t*)kmem_cache_alloc(fpu_cache);
+    if (!child->fpu) return -ENOMEM;
+
+    uint32_t flags = local_irq_save();
+    if (this_cpu()->fpu_owner == parent) {
+        clts();
+        fpu_save(parent->fpu);
+        // fnsave はレジスタを初期化するので読み直す
+        if (!has_fxsr) fpu_restore(parent->fpu);
+    }
+    local_irq_restore(flags);
+    kmemcpy(child->fpu, parent->fpu, sizeof(fpu_state_t));
+    return 0;
+}
+
+// 終了するタスクの状態はもう要らない (退避しない)
+void fpu_exit(process_t* p) {
+    uint32_t flags = local_irq_save();
+    if (this_cpu()->fpu_owner == p) {
+        this_cpu()->fpu_owner = NULL;
+        stts();
+    }
+    local_irq_restore(flags);
+}
+
+void fpu_free(process_t* p) {
+    if (p->fpu) kmem_cache_free(fpu_cache, p->fpu);
+    p->fpu = NULL;
+}
+
+// 最新の状態が p->cpu のレジスタにしか無い (他の CPU へ移すと失われる)
+int fpu_is_live(process_t* p) {
+    return cpus[p->cpu].fpu_owner == p;
+}
+
+// カーネル内で SIMD を使う前後に呼ぶ。持ち主の状態は退避して持ち主なしにする
+void kernel_fpu_begin(void) {
+    preempt_disable();
+    uint32_t flags = local_irq_save();
+    cpu_t* cpu = this_cpu();
+    clts();
+    if (cpu->fpu_owner) {
+        fpu_save(cpu->fpu_owner->fpu);
+        cpu->fpu_owner = NULL;
+    }
+    asm volatile("fninit");
+    local_irq_restore(flags);
+}
+
+void kernel_fpu_end(void) {
+    stts();
+    preempt_enable();
+}
@@ -0,0 +1,255 @@
+// kernel/futex.c - futex
+// 待っているタスクは鍵 (ワードの物理アドレス) のハッシュで選んだバケツにつなぐ。
+// 値の確認とキューへの追加をバケツのロックの下で行うので、
+// ユーザー空間で値を変えてから WAKE するまでの間に眠っても取りこぼさない。
+#include "../include/kernel/futex.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/vma.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/irqflags.h"
+#include "../include/kernel/list.h"
+#include "../include/kernel/types.h"
+
+#define FUTEX_HASH 256
+
+typedef struct {
+    spinlock_t  lock;
+    list_head_t head;
+} futex_bucket_t;
+
+// 待っているタスク (待つ側のスタック上)。起こされるとリストから外れて空になる
+typedef struct {
+    volatile uint32_t key;      // REQUEUE で書き換わる
+    int               pinned;   // key のページの参照を持っている (REQUEUE で付け替わる)
+    process_t*        task;
+    list_head_t       link;
+} futex_q_t;
+
+typedef struct {
+    uint32_t phys;              // ワードの物理アドレス
+    int      pinned;            // ユーザーページは鍵を使う間解放させない
+} futex_key_t;
+
+static futex_bucket_t futex_hash[FUTEX_HASH];
+static lock_class_t   futex_lock_class = LOCK_CLASS_INIT("futex_bucket");
+
+void futex_init(void) {
+    for (int i = 0; i < FUTEX_HASH; i++) {
+        spin_lock_init_class(&futex_hash[i].lock, &futex_lock_class);
+        list_init(&futex_hash[i].head);
+    }
+}
+
+static futex_bucket_t* bucket_of(uint32_t key) {
+    return &futex_hash[((key >> 2) * 0x9E3779B1u) >> 24];
+}
+
+// ユーザープロセスはユーザー空間のワード、カーネルスレッドはカーネル空間のワードだけ。
+// ユーザーページは無ければフォルトして用意し、CoW は先に分けておく
+// (待っている間に書き込みでページが替わると WAKE 側と鍵がずれる)
+static int get_key(uint32_t* uaddr, futex_key_t* k) {
+    uint32_t addr = (uint32_t)uaddr;
+    if (addr & 3) return -EINVAL;
+    mm_t* mm = current_proc->mm;
+
+    if (!mm) {
+        // カーネルのマップは全ディレクトリで共通で、動かない
+        if (addr >= USER_SPACE_START && addr < USER_SPACE_END) return -EFAULT;
+        k->phys   = vmm_get_physical(vmm_get_kernel_directory(), addr);
+        k->pinned = 0;
+        return k->phys ? 0 : -EFAULT;
+    }
+    if (addr < USER_SPACE_START || addr >= USER_SPACE_END) return -EFAULT;
+
+    for (int tries = 0; tries < 2; tries++) {
+        mutex_lock(&mm->lock);
+        uint32_t pte = vmm_get_pte(mm->pgd, addr);
+        if ((pte & PAGE_PRESENT) && !(pte & PAGE_COW)) {
+            pmm_get(pte & ~0xFFF);
+            mutex_unlock(&mm->lock);
+            k->phys   = (pte & ~0xFFF) | (addr & 0xFFF);
+            k->pinned = 1;
+            return 0;
+        }
+        mutex_unlock(&mm->lock);
+        if (vmm_handle_fault(addr, (pte & PAGE_PRESENT) ? 2 : 0) < 0) return -EFAULT;
+    }
+    return -EFAULT;
+}
+
+static void put_key(futex_key_t* k) {
+    if (k->pinned) pmm_put(k->phys & ~0xFFF);
+}
+
+// 物理ページから読むのでフォルトしない (スピンロックを持ったまま読める)
+static uint32_t key_read(const futex_key_t* k) {
+    uint8_t* page = (uint8_t*)kmap(k->phys & ~0xFFF);
+    uint32_t v = *(volatile uint32_t*)(page + (k->phys & 0xFFF));
+    kunmap(page);
+    return v;
+}
+
+// バケツのロックを持って呼ぶ
+static void wake_q(futex_q_t* q) {
+    process_t* t = q->task;
+    list_del(&q->link);
+    proc_wakeup(t);
+}
+
+int futex_wait(uint32_t* uaddr, uint32_t val, uint32_t tmo_ticks) {
+    futex_key_t key;
+    int ret = get_key(uaddr, &key);
+    if (ret < 0) return ret;
+
+    // ページの参照は q に渡し、抜けるときに今つながっている鍵の分を落とす
+    futex_q_t q;
+    q.key    = key.phys;
+    q.pinned = key.pinned;
+    q.task   = current_proc;
+    list_init(&q.link);
+
+    uint32_t end   = ticks + tmo_ticks;
+    uint32_t flags = local_irq_save();
+    futex_bucket_t* b = bucket_of(q.key);
+    spin_lock(&b->lock);
+    if (key_read(&key) != val) {
+        spin_unlock(&b->lock);
+        local_irq_restore(flags);
+        put_key(&key);
+        return -EAGAIN;
+    }
+    list_add_tail(&q.link, &b->head);
+
+    while (1) {
+        current_proc->state = PROC_BLOCKED;
+        spin_unlock(&b->lock);
+        uint32_t left = 0;
+        if (tmo_ticks) left = time_before(ticks, end) ? end - ticks : 1;
+        int timed_out = proc_schedule_timeout(left);
+        current_proc->state = PROC_RUNNING;
+
+        // REQUEUE で別のバケツに移されていることがある
+        while (1) {
+            b = bucket_of(q.key);
+            spin_lock(&b->lock);
+            if (b == bucket_of(q.key)) break;
+            spin_unlock(&b->lock);
+        }
+        if (list_empty(&q.link)) { ret = 0; break; }
+        if (timed_out || current_proc->pending_sigs) {
+            list_del(&q.link);
+            ret = timed_out ? -ETIMEDOUT : -EINTR;
+            break;
+        }
+        // それ以外の理由で起きた: もう一度眠る
+    }
+    key.phys   = q.key;
+    key.pinned = q.pinned;
+    spin_unlock(&b->lock);
+    local_irq_restore(flags);
+    put_key(&key);
+    return ret;
+}
+
+int futex_wake(uint32_t* uaddr, int nr) {
+    futex_key_t key;
+    int ret = get_key(uaddr, &key);
+    if (ret < 0) return ret;
+
+    futex_bucket_t* b = bucket_of(key.phys);
+    int n = 0;
+    list_head_t *pos, *tmp;
+    uint32_t flags = spin_lock_irqsave(&b->lock);
+    list_for_each_safe(pos, tmp, &b->head) {
+        if (n >= nr) break;
+        futex_q_t* q = list_entry(pos, futex_q_t, link);
+        if (q->key != key.phys) continue;
+        wake_q(q);
+        n++;
+    }
+    spin_unlock_irqrestore(&b->lock, flags);
+    put_key(&key);
+    return n;
+}
+
+// 条件変数の broadcast 用: 全員起こすと mutex に殺到するので1つだけ起こし、
+// 残りは mutex の待ちに付け替える (mutex が空いたら順に起きる)
+int futex_requeue(uint32_t* uaddr, uint32_t* uaddr2, int nr_wake, int nr_requeue,
+                  int cmp, uint32_t val3) {
+    futex_key_t k1, k2;
+    int ret = get_key(uaddr, &k1);
+    if (ret < 0) return ret;
+    ret = get_key(uaddr2, &k2);
+    if (ret < 0) {
+        put_key(&k1);
+        return ret;
+    }
+
+    futex_bucket_t* b1 = bucket_of(k1.phys);
+    futex_bucket_t* b2 = bucket_of(k2.phys);
+    // 2つのバケツはアドレス順に取る
+    uint32_t flags = local_irq_save();
+    spin_lock(b1 < b2 ? &b1->lock : &b2->lock);
+    if (b1 != b2) spin_lock(b1 < b2 ? &b2->lock : &b1->lock);
+
+    if (cmp && key_read(&k1) != val3) {
+        ret = -EAGAIN;
+    } else {
+        int woken = 0, moved = 0;
+        list_head_t *pos, *tmp;
+        list_for_each_safe(pos, tmp, &b1->head) {
+            futex_q_t* q = list_entry(pos, futex_q_t, link);
+            if (q->key != k1.phys) continue;
+            if (woken < nr_wake) {
+                wake_q(q);
+                woken++;
+            } else if (moved < nr_requeue) {
+                // 待ち手の持つ参照を k2 のページに付け替える (k1 はこちらも持っているので
+                // ここで0にはならない)。uaddr2 のページが外されても鍵が別のワードを指さない
+                if (k2.pinned) pmm_get(k2.phys & ~0xFFF);
+                if (q->pinned) pmm_put(q->key & ~0xFFF);
+                list_del(&q->link);
+                q->key    = k2.phys;
+                q->pinned = k2.pinned;
+                list_add_tail(&q->link, &b2->head);
+                moved++;
+            } else {
+                break;
+            }
+        }
+        ret = woken + moved;
+    }
+
+    if (b1 != b2) spin_unlock(b1 < b2 ? &b2->lock : &b1->lock);
+    spin_unlock(b1 < b2 ? &b1->lock : &b2->lock);
+    local_irq_restore(flags);
+    put_key(&k2);
+    put_key(&k1);
+    return ret;
+}
+
+// futex(2) と同じ引数。timeout は相対時間 (NULL = 無期限)
+int do_futex(uint32_t* uaddr, int op, uint32_t val, const timespec_t* timeout,
+             uint32_t val2, uint32_t* uaddr2, uint32_t val3) {
+    switch (op & FUTEX_CMD_MASK) {
+    case FUTEX_WAIT: {
+        uint32_t tmo = 0;
+        if (timeout) {
+            if (timeout->tv_sec < 0 || timeout->tv_nsec < 0 || (uint32_t)timeout->tv_nsec >= NSEC_PER_SEC)
+                return -EINVAL;
+            uint64_t ns = (uint64_t)(uint32_t)timeout->tv_sec * NSEC_PER_SEC + (uint32_t)timeout->tv_nsec;
+            tmo = ns_to_ticks(ns);
+            if (!tmo) tmo = 1;
+        }
+        return futex_wait(uaddr, val, tmo);
+    }
+    case FUTEX_WAKE:
+        return futex_wake(uaddr, (int)val);
+    case FUTEX_REQUEUE:
+        return futex_requeue(uaddr, uaddr2, (int)val, (int)val2, 0, 0);
+    case FUTEX_CMP_REQUEUE:
+        return futex_requeue(uaddr, uaddr2, (int)val, (int)val2, 1, val3);
+    default:
+        return -ENOSYS;
+    }
+}
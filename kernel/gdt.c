@@ -1,69 +1,166 @@
-// kernel/gdt.c - グローバルディスクリプタテーブル
+// kernel/gdt.c - グローバルディスクリプタテーブル (CPU ごと)
 #include "../include/kernel/gdt.h"
+#include "../include/kernel/smp.h"
 #include "../include/kernel/types.h"
 
-#define GDT_ENTRIES 6
+#define GDT_ENTRIES 9
 
-static gdt_entry_t gdt[GDT_ENTRIES];
-static gdt_ptr_t   gdt_ptr;
-static tss_entry_t tss;
+// CPU ごとに GDT と TSS を持つ (TSS の esp0 と per-CPU セグメントのベースが違う)
+static gdt_entry_t gdt[MAX_CPUS][GDT_ENTRIES];
+static gdt_ptr_t   gdt_ptr[MAX_CPUS];
+static tss_entry_t tss[MAX_CPUS];
+static tss_entry_t df_tss;   // ダブルフォルト用タスク (GDT 6 = 0x30)
+
+// sysenter の入口が最初に踏むスタック (CPU ごと)。一番上にこの CPU の TSS の esp0 の場所を置き、
+// 入口はそこからタスクのカーネルスタックに乗り換える (切り替えのたびに MSR を書かずに済む)
+#define SYSENTER_STACK_WORDS 32
+static uint32_t sysenter_stack[MAX_CPUS][SYSENTER_STACK_WORDS];
 
 extern void flush_tss(void);
+extern void sysenter_entry(void);   // kernel/isr_stubs.S
 
-static void gdt_set_entry(int n, uint32_t base, uint32_t limit, uint8_t access, uint8_t gran) {
-    gdt[n].base_low    = (base & 0xFFFF);
-    gdt[n].base_middle = (base >> 16) & 0xFF;
-    gdt[n].base_high   = (base >> 24) & 0xFF;
-    gdt[n].limit_low   = (limit & 0xFFFF);
-    gdt[n].granularity = ((limit >> 16) & 0x0F) | (gran & 0xF0);
-    gdt[n].access      = access;
+static void gdt_set_entry(gdt_entry_t* g, int n, uint32_t base, uint32_t limit,
+                          uint8_t access, uint8_t gran) {
+    g[n].base_low    = (base & 0xFFFF);
+    g[n].base_middle = (base >> 16) & 0xFF;
+    g[n].base_high   = (base >> 24) & 0xFF;
+    g[n].limit_low   = (limit & 0xFFFF);
+    g[n].granularity = ((limit >> 16) & 0x0F) | (gran & 0xF0);
+    g[n].access      = access;
 }
 
-static void tss_setup(uint16_t ss0, uint32_t esp0) {
-    uint32_t base  = (uint32_t)&tss;
+static void tss_setup(int cpu, uint16_t ss0, uint32_t esp0) {
+    tss_entry_t* t = &tss[cpu];
+    uint32_t base  = (uint32_t)t;
     uint32_t limit = base + sizeof(tss_entry_t);
 
-    gdt_set_entry(5, base, limit, 0x89, 0x00);
+    gdt_set_entry(gdt[cpu], 5, base, limit, 0x89, 0x00);
 
     for (int i = 0; i < (int)sizeof(tss_entry_t); i++)
-        ((uint8_t*)&tss)[i] = 0;
+        ((uint8_t*)t)[i] = 0;
 
-    tss.ss0  = ss0;
-    tss.esp0 = esp0;
-    tss.iomap_base = sizeof(tss_entry_t);
+    t->ss0  = ss0;
+    t->esp0 = esp0;
+    t->iomap_base = sizeof(tss_entry_t);
 }
 
 void gdt_set_kernel_stack(uint32_t stack) {
-    tss.esp0 = stack;
+    tss[smp_processor_id()].esp0 = stack;
+}
+
+// ダブルフォルトはタスクゲート経由で別スタックに切り替える。
+// カーネルスタックが溢れた状態でも確実にハンドラへ入れる。
+// ページング有効化後、AP 起動前に呼ぶ (cr3 は現在のものを使う)
+void gdt_install_df_task(uint32_t eip, uint32_t esp) {
+    uint32_t base  = (uint32_t)&df_tss;
+    uint32_t limit = base + sizeof(tss_entry_t);
+
+    for (int i = 0; i < (int)sizeof(tss_entry_t); i++)
+        ((uint8_t*)&df_tss)[i] = 0;
+
+    asm volatile("mov %%cr3, %0" : "=r"(df_tss.cr3));
+    df_tss.eip    = eip;
+    df_tss.eflags = 0x2;        // IF=0
+    df_tss.esp    = esp;
+    df_tss.cs     = 0x08;
+    df_tss.ss     = df_tss.ds = df_tss.es = df_tss.gs = 0x10;
+    df_tss.fs     = PERCPU_SEL; // ハンドラから this_cpu() を使う
+    df_tss.ss0    = 0x10;
+    df_tss.esp0   = esp;
+    df_tss.iomap_base = sizeof(tss_entry_t);
+
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++)
+        gdt_set_entry(gdt[cpu], 6, base, limit, 0x89, 0x00);
+}
+
+// タスク切り替えで保存された、フォルト時点のESP
+uint32_t gdt_faulting_esp(void) {
+    return tss[smp_processor_id()].esp;
 }
 
-static void gdt_flush(void) {
+static void gdt_flush(gdt_ptr_t* ptr) {
     asm volatile(
         "lgdt %0\n"
-        "ljmp $0x08, $.reload_cs\n"
-        ".reload_cs:\n"
+        "ljmp $0x08, $1f\n"
+        "1:\n"
         "mov $0x10, %%ax\n"
         "mov %%ax, %%ds\n"
         "mov %%ax, %%es\n"
-        "mov %%ax, %%fs\n"
         "mov %%ax, %%gs\n"
         "mov %%ax, %%ss\n"
-        :: "m"(gdt_ptr) : "eax"
+        "mov %1, %%ax\n"
+        "mov %%ax, %%fs\n"
+        :: "m"(*ptr), "i"(PERCPU_SEL) : "eax"
     );
 }
 
-void gdt_init(void) {
-    gdt_ptr.limit = (sizeof(gdt_entry_t) * GDT_ENTRIES) - 1;
-    gdt_ptr.base  = (uint32_t)&gdt;
+// user_desc からユーザー用データセグメント (DPL 3) の記述子を作る。空なら0
+uint64_t gdt_tls_desc(const user_desc_t* u) {
+    if (u->seg_not_present || (!u->base_addr && !u->limit)) return 0;
+    union { gdt_entry_t e; uint64_t raw; } d;
+    gdt_set_entry(&d.e, 0, u->base_addr, u->limit,
+                  u->read_exec_only ? 0xF0 : 0xF2,
+                  (uint8_t)((u->seg_32bit ? 0x40 : 0) | (u->limit_in_pages ? 0x80 : 0) |
+                            (u->useable ? 0x10 : 0)));
+    return d.raw;
+}
 
-    gdt_set_entry(0, 0, 0,          0x00, 0x00); // NULL
-    gdt_set_entry(1, 0, 0xFFFFFFFF, 0x9A, 0xCF); // カーネルコード
-    gdt_set_entry(2, 0, 0xFFFFFFFF, 0x92, 0xCF); // カーネルデータ
-    gdt_set_entry(3, 0, 0xFFFFFFFF, 0xFA, 0xCF); // ユーザーコード
-    gdt_set_entry(4, 0, 0xFFFFFFFF, 0xF2, 0xCF); // ユーザーデータ
+// 切り替え先の TLS をこの CPU の GDT に書く。
+// %gs の隠れたベースは、ユーザーに戻るときの pop %gs で読み直される
+void gdt_load_tls(uint64_t desc) {
+    uint64_t* e = (uint64_t*)&gdt[smp_processor_id()][GDT_TLS_ENTRY];
+    if (*e != desc) *e = desc;
+}
+
+static inline void wrmsr(uint32_t msr, uint32_t lo, uint32_t hi) {
+    asm volatile("wrmsr" :: "c"(msr), "a"(lo), "d"(hi));
+}
+
+// CPUID の SEP を見る。初期の Pentium Pro (family 6, model < 3, stepping < 3) は
+// SEP を立てるのに sysenter を持っていない
+static int cpu_has_sysenter(void) {
+    uint32_t a = 1, b, c, d;
+    asm volatile("cpuid" : "+a"(a), "=b"(b), "=c"(c), "=d"(d));
+    if (!((d >> 11) & 1)) return 0;
+    uint32_t family = (a >> 8) & 0xF, model = (a >> 4) & 0xF, stepping = a & 0xF;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+// この CPU の sysenter を有効にする。使えない CPU では int 0x80 だけになる
+static void sysenter_setup(int cpu) {
+    if (!cpu_has_sysenter()) return;
+    uint32_t* top = &sysenter_stack[cpu][SYSENTER_STACK_WORDS - 1];
+    *top = (uint32_t)&tss[cpu].esp0;
+    wrmsr(MSR_SYSENTER_CS,  0x08, 0);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)top, 0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry, 0);
+}
 
-    tss_setup(0x10, 0);
+// 各 CPU で1回呼ぶ (BSP は gdt_init から)
+void gdt_init_cpu(int cpu) {
+    gdt_entry_t* g = gdt[cpu];
+    gdt_ptr[cpu].limit = (sizeof(gdt_entry_t) * GDT_ENTRIES) - 1;
+    gdt_ptr[cpu].base  = (uint32_t)g;
 
-    gdt_flush();
+    cpus[cpu].self = &cpus[cpu];
+    cpus[cpu].id   = cpu;
+
+    gdt_set_entry(g, 0, 0, 0,          0x00, 0x00); // NULL
+    gdt_set_entry(g, 1, 0, 0xFFFFFFFF, 0x9A, 0xCF); // カーネルコード
+    gdt_set_entry(g, 2, 0, 0xFFFFFFFF, 0x92, 0xCF); // カーネルデータ
+    gdt_set_entry(g, 3, 0, 0xFFFFFFFF, 0xFA, 0xCF); // ユーザーコード
+    gdt_set_entry(g, 4, 0, 0xFFFFFFFF, 0xF2, 0xCF); // ユーザーデータ
+    // 7: この CPU の cpu_t (バイト単位リミット)
+    gdt_set_entry(g, 7, (uint32_t)&cpus[cpu], sizeof(cpu_t) - 1, 0x92, 0x40);
+    gdt_set_entry(g, GDT_TLS_ENTRY, 0, 0, 0x00, 0x00); // 8: TLS (切り替えで書き換え)
+
+    tss_setup(cpu, 0x10, 0);
+
+    gdt_flush(&gdt_ptr[cpu]);
     flush_tss();
+    sysenter_setup(cpu);
+}
+
+void gdt_init(void) {
+    gdt_init_cpu(0);
 }
@@ -1,5 +1,6 @@
 // kernel/idt.c - 割り込みディスクリプタテーブル
 #include "../include/kernel/idt.h"
+#include "../include/kernel/apic.h"
 #include "../include/kernel/types.h"
 #include "../kernel/io.h"
 
@@ -22,7 +23,8 @@ extern void irq3(void); extern void irq4(void); extern void irq5(void);
 extern void irq6(void); extern void irq7(void); extern void irq8(void);
 extern void irq9(void); extern void irq10(void);extern void irq11(void);
 extern void irq12(void);extern void irq13(void);extern void irq14(void);
-extern void irq15(void);
+extern void irq15(void);extern void irq16(void);extern void irq17(void);extern void irq18(void);
+extern void irq_spurious(void);
 
 void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags) {
     idt[num].offset_low  = base & 0xFFFF;
@@ -117,6 +119,12 @@ void idt_init(void) {
     idt_set_gate(46, (uint32_t)irq14, 0x08, 0x8E);
     idt_set_gate(47, (uint32_t)irq15, 0x08, 0x8E);
 
+    // ローカル APIC
+    idt_set_gate(LAPIC_TIMER_VECTOR, (uint32_t)irq16, 0x08, 0x8E);
+    idt_set_gate(RESCHED_VECTOR,     (uint32_t)irq17, 0x08, 0x8E);
+    idt_set_gate(TLB_FLUSH_VECTOR,   (uint32_t)irq18, 0x08, 0x8E);
+    idt_set_gate(SPURIOUS_VECTOR,    (uint32_t)irq_spurious, 0x08, 0x8E);
+
     // システムコール (int 0x80) - DPL=3でユーザーから呼べる
     idt_set_gate(128, (uint32_t)isr128, 0x08, 0xEE);
 
@@ -127,3 +135,8 @@ void idt_init(void) {
     ps2_init();
 
 }
+
+// AP は BSP と同じ IDT を使う
+void idt_load(void) {
+    asm volatile("lidt %0" :: "m"(idt_ptr));
+}
@@ -0,0 +1,195 @@
+// kernel/ipc.c - 同期メッセージ IPC
+// 受け手が reply_wait で待っていれば、送り手はメッセージを受け手の endpoint に写して
+// sched_yield_to() で受け手へ直接切り替える。返事も同じ道を逆にたどる。
+// 受け手が忙しければ送り手は senders に並び、次の reply_wait がそこから取る。
+// メッセージはいったんカーネル側 (endpoint の buf) に写すので、
+// 相手のアドレス空間を開かずに済む。
+#include "../include/kernel/ipc.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/sched.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/irqflags.h"
+#include "../include/kernel/list.h"
+#include "../include/kernel/types.h"
+
+static lock_class_t ipc_lock_class = LOCK_CLASS_INIT("ipc->lock");
+
+static inline process_t* sender_of(list_head_t* link) {
+    return list_entry(link, process_t, ipc.link);
+}
+
+void ipc_task_init(process_t* p) {
+    ipc_endpoint_t* ep = &p->ipc;
+    spin_lock_init_class(&ep->lock, &ipc_lock_class);
+    ep->state = IPC_IDLE;
+    ep->dead  = 0;
+    ep->err   = 0;
+    ep->from  = 0;
+    list_init(&ep->senders);
+    list_init(&ep->callers);
+    list_init(&ep->link);
+}
+
+// ep->lock を持って呼ぶ。返事 (または -ESRCH) を渡して送り手を起こす
+static void finish_call(process_t* s, int err) {
+    list_del(&s->ipc.link);
+    s->ipc.err   = err;
+    s->ipc.state = IPC_IDLE;
+    proc_wakeup(s);
+}
+
+void ipc_exit(process_t* p) {
+    ipc_endpoint_t* ep = &p->ipc;
+    uint32_t flags = spin_lock_irqsave(&ep->lock);
+    ep->dead = 1;
+    while (!list_empty(&ep->senders)) finish_call(sender_of(ep->senders.next), -ESRCH);
+    while (!list_empty(&ep->callers)) finish_call(sender_of(ep->callers.next), -ESRCH);
+    spin_unlock_irqrestore(&ep->lock, flags);
+}
+
+int ipc_call(pid_t dest, const ipc_msg_t* msg, ipc_msg_t* reply) {
+    process_t* self = current_proc;
+    ipc_endpoint_t* me = &self->ipc;
+    // 呼び出し側のバッファはロックの外で読み書きする (フォルトしうる)
+    ipc_msg_t m = *msg;
+
+    read_lock(&tasklist_lock);
+    process_t* d = proc_get(dest);
+    if (d && d != self) proc_pin(d);
+    read_unlock(&tasklist_lock);
+    if (!d || d == self) return -ESRCH;
+    ipc_endpoint_t* ep = &d->ipc;
+
+    // 割り込みは切り替えるまで禁止のまま (BLOCKED で横取りされると受け手を起こせない)
+    uint32_t flags = spin_lock_irqsave(&ep->lock);
+    if (ep->dead) {
+        spin_unlock_irqrestore(&ep->lock, flags);
+        proc_unpin(d);
+        return -ESRCH;
+    }
+    me->err = 0;
+    int handoff = ep->state == IPC_RECEIVING;
+    if (handoff) {
+        // 受け手が待っている: その場で渡して返事待ちに
+        ep->buf   = m;
+        ep->from  = self->pid;
+        ep->state = IPC_IDLE;
+        me->state = IPC_WAIT_REPLY;
+        list_add_tail(&me->link, &ep->callers);
+    } else {
+        me->buf   = m;
+        me->state = IPC_SENDING;
+        list_add_tail(&me->link, &ep->senders);
+    }
+    self->state = PROC_BLOCKED;
+    spin_unlock(&ep->lock);
+    if (handoff) sched_yield_to(d);
+    else         schedule();
+
+    // 返事 (か受け手の終了) まで眠る。それ以外で起こされたら眠り直す
+    while (1) {
+        spin_lock(&ep->lock);
+        if (me->state == IPC_IDLE) break;
+        self->state = PROC_BLOCKED;
+        spin_unlock(&ep->lock);
+        schedule();
+    }
+    int err = me->err;
+    m = me->buf;
+    spin_unlock_irqrestore(&ep->lock, flags);
+    proc_unpin(d);
+
+    if (err) return err;
+    *reply = m;
+    return 0;
+}
+
+// ep->lock を持って呼ぶ。返事を待っている to に m を渡して返す (起こすのは呼び出し側)。
+// 起こした後に相手が終わって回収されても使えるよう固定しておく (使い終わったら proc_unpin)
+static process_t* take_caller(ipc_endpoint_t* ep, pid_t to, const ipc_msg_t* m) {
+    list_head_t* pos;
+    list_for_each(pos, &ep->callers) {
+        process_t* c = sender_of(pos);
+        if (c->pid != to) continue;
+        proc_pin(c);
+        list_del(&c->ipc.link);
+        c->ipc.buf   = *m;
+        c->ipc.err   = 0;
+        c->ipc.state = IPC_IDLE;
+        return c;
+    }
+    return NULL;
+}
+
+int ipc_reply(pid_t to, const ipc_msg_t* reply) {
+    ipc_endpoint_t* ep = &current_proc->ipc;
+    ipc_msg_t m = *reply;
+    uint32_t flags = spin_lock_irqsave(&ep->lock);
+    process_t* c = take_caller(ep, to, &m);
+    spin_unlock_irqrestore(&ep->lock, flags);
+    if (!c) return -ESRCH;
+    proc_wakeup(c);
+    proc_unpin(c);
+    return 0;
+}
+
+pid_t ipc_reply_wait(pid_t to, const ipc_msg_t* reply, ipc_msg_t* msg) {
+    process_t* self = current_proc;
+    ipc_endpoint_t* ep = &self->ipc;
+    ipc_msg_t m;
+    if (to > 0) m = *reply;
+
+    uint32_t flags = spin_lock_irqsave(&ep->lock);
+    process_t* c = NULL;
+    if (to > 0 && !(c = take_caller(ep, to, &m))) {
+        spin_unlock_irqrestore(&ep->lock, flags);
+        return -ESRCH;
+    }
+
+    pid_t from;
+    if (!list_empty(&ep->senders)) {
+        // 並んでいる送り手がいれば眠らずに受け取る (返事した相手は普通に起こす)
+        process_t* s = sender_of(ep->senders.next);
+        list_del(&s->ipc.link);
+        s->ipc.state = IPC_WAIT_REPLY;
+        list_add_tail(&s->ipc.link, &ep->callers);
+        m    = s->ipc.buf;
+        from = s->pid;
+        spin_unlock_irqrestore(&ep->lock, flags);
+        if (c) {
+            proc_wakeup(c);
+            proc_unpin(c);
+        }
+        *msg = m;
+        return from;
+    }
+
+    ep->state   = IPC_RECEIVING;
+    self->state = PROC_BLOCKED;
+    spin_unlock(&ep->lock);
+    if (c) {
+        // 返事を待っていた相手に直接切り替える (次のメッセージはそこから来ることが多い)
+        sched_yield_to(c);
+        proc_unpin(c);
+    } else {
+        schedule();
+    }
+
+    while (1) {
+        spin_lock(&ep->lock);
+        if (ep->state != IPC_RECEIVING) break;
+        if (self->pending_sigs) {
+            ep->state = IPC_IDLE;
+            spin_unlock_irqrestore(&ep->lock, flags);
+            return -EINTR;
+        }
+        self->state = PROC_BLOCKED;
+        spin_unlock(&ep->lock);
+        schedule();
+    }
+    m    = ep->buf;
+    from = ep->from;
+    spin_unlock_irqrestore(&ep->lock, flags);
+    *msg = m;
+    return from;
+}
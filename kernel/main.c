@@ -3,8 +3,18 @@
 #include "../include/kernel/gdt.h"
 #include "../include/kernel/idt.h"
 #include "../include/kernel/mm.h"
+#include "../include/kernel/vma.h"
+#include "../include/kernel/futex.h"
 #include "../include/kernel/proc.h"
 #include "../include/kernel/vfs.h"
+#include "../include/kernel/timer.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/softirq.h"
+#include "../include/kernel/workqueue.h"
+#include "../include/kernel/async.h"
+#include "../include/kernel/cgroup.h"
+#include "../include/kernel/vdso.h"
+#include "../include/kernel/smp.h"
 
 // Multiboot
 #define MBOOT_MAGIC 0x2BADB002
@@ -28,6 +38,8 @@ extern void serial_init(void);
 extern void serial_write(char c);
 extern void serial_puts(const char* s);
 extern void pit_init(void);
+extern void df_init(void);
+extern void keyboard_init(void);
 extern void kprintf(const char* fmt, ...);
 extern void isr_handler(regs_t* r);
 extern void syscall_dispatch(regs_t* r);
@@ -38,6 +50,10 @@ extern void ramfs_write_file(vnode_t* parent, const char* name, const char* data
 extern vnode_t* tty_get_vnode(void);
 extern file_t*  file_open(const char* path, int flags);
 
+// userland/initfs_bins.S に埋め込んだユーザープログラム
+extern const char initfs_hello[], initfs_hello_end[];
+extern const char initfs_sysbench[], initfs_sysbench_end[];
+
 
 // isr_handler から syscall をディスパッチ
 // (irq.c の isr_handler を上書き)
@@ -64,6 +80,24 @@ static void build_initfs(void) {
     ramfs_mkdir(root, "tmp");
     ramfs_mkdir(root, "dev");
     ramfs_mkdir(root, "proc");
+    ramfs_mkdir(root, "sys");
+
+    // /sys/fs/cgroup (cgroup_init が cgroupfs をマウントする)
+    vnode_t* sys = root->ops->finddir(root, "sys");
+    if (sys) {
+        ramfs_mkdir(sys, "fs");
+        vnode_t* sysfs = sys->ops->finddir(sys, "fs");
+        if (sysfs) ramfs_mkdir(sysfs, "cgroup");
+    }
+
+    // /bin/hello (ELF ローダーで動くユーザープログラム)
+    // /bin/sysbench (int 0x80 と sysenter の往復時間の比較)
+    vnode_t* bin = root->ops->finddir(root, "bin");
+    if (bin) {
+        ramfs_write_file(bin, "hello", initfs_hello, (size_t)(initfs_hello_end - initfs_hello));
+        ramfs_write_file(bin, "sysbench", initfs_sysbench,
+                         (size_t)(initfs_sysbench_end - initfs_sysbench));
+    }
 
     // /home/user
     vnode_t* home = root->ops->finddir(root, "home");
@@ -134,7 +168,7 @@ static void init_process(void) {
         f->offset = 0;
         f->ref    = 1;
         tty_vn->ref_count++;
-        current_proc->fds[i] = f;
+        current_proc->cold->files->fds[i] = f;
     }
 
     // motd表示
@@ -192,18 +226,45 @@ void kernel_main(uint32_t magic, mboot_info_t* mbi) {
 
     kprintf("[INIT] VMM...\n");
     vmm_init();
+    df_init();
 
     kprintf("[INIT] Heap...\n");
     heap_init();
 
+    kprintf("[INIT] Timers...\n");
+    timer_init();
+
+    kprintf("[INIT] VMA + page cache...\n");
+    vma_init();
+    vdso_init();
+
     kprintf("[INIT] VFS + ramfs...\n");
     build_initfs();
+    cgroup_init();
 
     kprintf("[INIT] PIT (100Hz)...\n");
     pit_init();
 
+    kprintf("[INIT] Clocksource (TSC)...\n");
+    clock_init();
+
+    kprintf("[INIT] FPU/SSE...\n");
+    fpu_init();
+
     kprintf("[INIT] Process manager...\n");
     proc_init();
+    futex_init();
+
+    kprintf("[INIT] Softirq + workqueue...\n");
+    softirq_init();
+    workqueue_init();
+    mm_reaper_init();
+    proc_reaper_init();
+    async_init();
+    keyboard_init();
+
+    kprintf("[INIT] SMP...\n");
+    smp_init();
 
     kprintf("[BOOT] Kernel initialized! Starting init...\n\n");
 
@@ -212,8 +273,14 @@ void kernel_main(uint32_t magic, mboot_info_t* mbi) {
     (void)init;
 
     // idleループ (スケジューラが割り込みで動く)
+    // 実行可能なプロセスが無ければ次のタイマー満了までPITを止める
     asm volatile("sti");
     while (1) {
-        asm volatile("hlt");
+        asm volatile("cli");
+        tick_nohz_idle_enter();
+        asm volatile("sti; hlt");   // sti直後のhltは割り込みを取りこぼさない
+        asm volatile("cli");
+        tick_nohz_idle_exit();
+        asm volatile("sti");
     }
 }
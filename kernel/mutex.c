@@ -0,0 +1,50 @@
+// kernel/mutex.c - 眠るロック
+#include "../include/kernel/mutex.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/types.h"
+
+void mutex_init(mutex_t* m, lock_class_t* cls) {
+    m->locked = 0;
+    m->owner  = NULL;
+    m->cls    = cls;
+    init_waitqueue_head(&m->wait);
+}
+
+static int mutex_try_acquire(mutex_t* m) {
+    uint32_t v = 1;
+    asm volatile("xchgl %0, %1" : "+r"(v), "+m"(m->locked) :: "memory");
+    if (v) return 0;
+    m->owner = current_proc;
+    return 1;
+}
+
+int mutex_trylock(mutex_t* m) {
+    if (!mutex_try_acquire(m)) return 0;
+    if (m->cls) {
+        lock_stat_acquired(m->cls, 0);
+        m->held_since = lock_stat_clock();
+    }
+    return 1;
+}
+
+// 待ちキューに入ってから取り直すので、その間の mutex_unlock は取りこぼさない
+void mutex_lock(mutex_t* m) {
+    uint64_t wait_start = 0;
+    if (!mutex_try_acquire(m)) {
+        if (m->cls) wait_start = lock_stat_clock();
+        wait_event(m->wait, mutex_try_acquire(m));
+        if (m->cls) lock_stat_contended(m->cls);
+    }
+    if (m->cls) {
+        lock_stat_acquired(m->cls, wait_start);
+        m->held_since = lock_stat_clock();
+    }
+}
+
+void mutex_unlock(mutex_t* m) {
+    if (m->cls) lock_stat_released(m->cls, m->held_since);
+    m->owner = NULL;
+    asm volatile("" ::: "memory");
+    m->locked = 0;
+    wake_up(&m->wait);
+}
@@ -0,0 +1,181 @@
+// kernel/rbtree.c - 赤黒木
+#include "../include/kernel/rbtree.h"
+
+static void rotate_left(rb_node_t* x, rb_root_t* root) {
+    rb_node_t* y = x->right;
+    x->right = y->left;
+    if (y->left) y->left->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)                 root->root = y;
+    else if (x == x->parent->left)  x->parent->left = y;
+    else                            x->parent->right = y;
+    y->left = x;
+    x->parent = y;
+}
+
+static void rotate_right(rb_node_t* x, rb_root_t* root) {
+    rb_node_t* y = x->left;
+    x->left = y->right;
+    if (y->right) y->right->parent = x;
+    y->parent = x->parent;
+    if (!x->parent)                 root->root = y;
+    else if (x == x->parent->right) x->parent->right = y;
+    else                            x->parent->left = y;
+    y->right = x;
+    x->parent = y;
+}
+
+void rb_insert_color(rb_node_t* n, rb_root_t* root) {
+    rb_node_t* p;
+    while ((p = n->parent) && p->color == RB_RED) {
+        rb_node_t* g = p->parent;
+        if (p == g->left) {
+            rb_node_t* u = g->right;
+            if (u && u->color == RB_RED) {
+                p->color = u->color = RB_BLACK;
+                g->color = RB_RED;
+                n = g;
+                continue;
+            }
+            if (n == p->right) { rotate_left(p, root); n = p; p = n->parent; }
+            p->color = RB_BLACK;
+            g->color = RB_RED;
+            rotate_right(g, root);
+        } else {
+            rb_node_t* u = g->left;
+            if (u && u->color == RB_RED) {
+                p->color = u->color = RB_BLACK;
+                g->color = RB_RED;
+                n = g;
+                continue;
+            }
+            if (n == p->left) { rotate_right(p, root); n = p; p = n->parent; }
+            p->color = RB_BLACK;
+            g->color = RB_RED;
+            rotate_left(g, root);
+        }
+    }
+    root->root->color = RB_BLACK;
+}
+
+static int is_black(const rb_node_t* n) { return !n || n->color == RB_BLACK; }
+
+// 削除後の修正 (x は NULL のこともあるので親を別に持つ)
+static void erase_fixup(rb_node_t* x, rb_node_t* parent, rb_root_t* root) {
+    while (x != root->root && is_black(x)) {
+        if (x == parent->left) {
+            rb_node_t* w = parent->right;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rotate_left(parent, root);
+                w = parent->right;
+            }
+            if (is_black(w->left) && is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (is_black(w->right)) {
+                    w->left->color = RB_BLACK;
+                    w->color = RB_RED;
+                    rotate_right(w, root);
+                    w = parent->right;
+                }
+                w->color = parent->color;
+                parent->color = RB_BLACK;
+                if (w->right) w->right->color = RB_BLACK;
+                rotate_left(parent, root);
+                x = root->root;
+                break;
+            }
+        } else {
+            rb_node_t* w = parent->left;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rotate_right(parent, root);
+                w = parent->left;
+            }
+            if (is_black(w->left) && is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+            } else {
+                if (is_black(w->left)) {
+                    w->right->color = RB_BLACK;
+                    w->color = RB_RED;
+                    rotate_left(w, root);
+                    w = parent->left;
+                }
+                w->color = parent->color;
+                parent->color = RB_BLACK;
+                if (w->left) w->left->color = RB_BLACK;
+                rotate_right(parent, root);
+                x = root->root;
+                break;
+            }
+        }
+    }
+    if (x) x->color = RB_BLACK;
+}
+
+static void replace_child(rb_node_t* old, rb_node_t* new, rb_node_t* parent, rb_root_t* root) {
+    if (!parent)                  root->root = new;
+    else if (parent->left == old) parent->left = new;
+    else                          parent->right = new;
+}
+
+void rb_erase(rb_node_t* z, rb_root_t* root) {
+    rb_node_t* x;
+    rb_node_t* parent;
+    int color;
+
+    if (!z->left || !z->right) {
+        x      = z->left ? z->left : z->right;
+        parent = z->parent;
+        color  = z->color;
+        replace_child(z, x, parent, root);
+        if (x) x->parent = parent;
+    } else {
+        // 後継ノード y で z を置き換える
+        rb_node_t* y = z->right;
+        while (y->left) y = y->left;
+        color = y->color;
+        x     = y->right;
+
+        if (y->parent == z) {
+            parent = y;
+        } else {
+            parent = y->parent;
+            parent->left = x;
+            if (x) x->parent = parent;
+            y->right = z->right;
+            z->right->parent = y;
+        }
+        replace_child(z, y, z->parent, root);
+        y->parent = z->parent;
+        y->left   = z->left;
+        z->left->parent = y;
+        y->color  = z->color;
+    }
+
+    if (color == RB_BLACK) erase_fixup(x, parent, root);
+}
+
+rb_node_t* rb_first(const rb_root_t* root) {
+    rb_node_t* n = root->root;
+    if (!n) return NULL;
+    while (n->left) n = n->left;
+    return n;
+}
+
+rb_node_t* rb_next(const rb_node_t* n) {
+    if (n->right) {
+        n = n->right;
+        while (n->left) n = n->left;
+        return (rb_node_t*)n;
+    }
+    while (n->parent && n == n->parent->right) n = n->parent;
+    return n->parent;
+}
@@ -0,0 +1,230 @@
+// kernel/smp.c - MP テーブルの探索と AP の起動
+#include "../include/kernel/smp.h"
+#include "../include/kernel/apic.h"
+#include "../include/kernel/gdt.h"
+#include "../include/kernel/idt.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/sched.h"
+#include "../include/kernel/preempt.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/types.h"
+
+extern void kprintf(const char* fmt, ...);
+
+extern char trampoline_start[], trampoline_end[];
+extern char tr_cr3[], tr_stack[], tr_entry[], tr_cpu[];
+
+cpu_t cpus[MAX_CPUS];
+int   nr_cpus = 1;
+
+// ===== MP テーブル (Intel MultiProcessor Specification 1.4) =====
+typedef struct {
+    char     sig[4];        // "_MP_"
+    uint32_t config;        // 構成テーブルの物理アドレス
+    uint8_t  length;        // 16 バイト単位
+    uint8_t  rev;
+    uint8_t  checksum;
+    uint8_t  features[5];
+} PACKED mp_fp_t;
+
+typedef struct {
+    char     sig[4];        // "PCMP"
+    uint16_t length;
+    uint8_t  rev;
+    uint8_t  checksum;
+    char     oem[20];
+    uint32_t oem_table;
+    uint16_t oem_size;
+    uint16_t count;
+    uint32_t lapic_addr;
+    uint16_t ext_length;
+    uint8_t  ext_checksum;
+    uint8_t  reserved;
+} PACKED mp_conf_t;
+
+typedef struct {
+    uint8_t  type;          // 0 = プロセッサ
+    uint8_t  apic_id;
+    uint8_t  apic_ver;
+    uint8_t  flags;         // bit0: 有効, bit1: BSP
+    uint32_t signature;
+    uint32_t features;
+    uint8_t  reserved[8];
+} PACKED mp_proc_t;
+
+#define MP_PROC     0
+#define MP_PROC_EN  0x01
+#define MP_PROC_BSP 0x02
+
+static uint8_t ap_apic_ids[MAX_CPUS];
+static int     nr_ap_ids = 0;
+
+static int checksum_ok(const void* p, uint32_t len) {
+    const uint8_t* b = (const uint8_t*)p;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) sum += b[i];
+    return sum == 0;
+}
+
+static mp_fp_t* mp_scan(uint32_t base, uint32_t len) {
+    for (uint32_t a = base; a + sizeof(mp_fp_t) <= base + len; a += 16) {
+        mp_fp_t* fp = (mp_fp_t*)a;
+        if (fp->sig[0] == '_' && fp->sig[1] == 'M' && fp->sig[2] == 'P' &&
+            fp->sig[3] == '_' && checksum_ok(fp, fp->length * 16))
+            return fp;
+    }
+    return NULL;
+}
+
+// BIOS データ領域 (物理 0x400-) の読み出し
+// 定数アドレスのままだと gcc が NULL 付近の参照として警告するので asm で隠す
+static uint16_t bda_read16(uint32_t addr) {
+    asm volatile("" : "+r"(addr));
+    return *(volatile uint16_t*)addr;
+}
+
+// EBDA の先頭1KB → 基本メモリ末尾1KB → BIOS ROM の順に探す
+static mp_fp_t* mp_find(void) {
+    mp_fp_t* fp;
+    uint32_t ebda = (uint32_t)bda_read16(0x40E) << 4;
+    if (ebda && (fp = mp_scan(ebda, 1024))) return fp;
+    uint32_t basemem = (uint32_t)bda_read16(0x413) * 1024;
+    if (basemem && (fp = mp_scan(basemem - 1024, 1024))) return fp;
+    return mp_scan(0xF0000, 0x10000);
+}
+
+// LAPIC の物理アドレスを返す (見つからなければ0)
+static uint32_t mp_parse(void) {
+    mp_fp_t* fp = mp_find();
+    if (!fp || !fp->config) return 0;
+    // 既定構成 (features[0] != 0) は扱わない
+    mp_conf_t* conf = (mp_conf_t*)fp->config;
+    if ((uint32_t)conf >= 4 * 1024 * 1024) return 0;   // アイデンティティマップ外
+    if (conf->sig[0] != 'P' || conf->sig[1] != 'C' || conf->sig[2] != 'M' ||
+        conf->sig[3] != 'P' || !checksum_ok(conf, conf->length))
+        return 0;
+
+    uint8_t* e   = (uint8_t*)(conf + 1);
+    uint8_t* end = (uint8_t*)conf + conf->length;
+    while (e < end) {
+        if (*e != MP_PROC) { e += 8; continue; }
+        mp_proc_t* proc = (mp_proc_t*)e;
+        if ((proc->flags & MP_PROC_EN) && !(proc->flags & MP_PROC_BSP) &&
+            nr_ap_ids < MAX_CPUS - 1)
+            ap_apic_ids[nr_ap_ids++] = proc->apic_id;
+        e += sizeof(mp_proc_t);
+    }
+    return conf->lapic_addr;
+}
+
+// ===== AP =====
+static void ap_main(int cpu) {
+    gdt_init_cpu(cpu);
+    idt_load();
+    lapic_init();
+    fpu_init_cpu();
+
+    process_t* idle = cpus[cpu].idle;
+    current_proc = idle;
+    sched_init_cpu(cpu, idle);
+    lapic_timer_start();
+
+    cpus[cpu].online = 1;
+    kprintf("[SMP] CPU%d (APIC %d) online\n", cpu, cpus[cpu].apic_id);
+
+    // AP の idle: LAPIC タイマーと IPI で起きる
+    while (1) asm volatile("sti; hlt");
+}
+
+static void tr_set(char* field, uint32_t val) {
+    *(uint32_t*)(TRAMPOLINE_BASE + (field - trampoline_start)) = val;
+}
+
+// INIT → SIPI → SIPI (2回目は1回目で起きなかったときだけ)
+static int ap_boot(int cpu) {
+    uint8_t apic = cpus[cpu].apic_id;
+    uint32_t vec = TRAMPOLINE_BASE >> 12;
+
+    tr_set(tr_cr3,   (uint32_t)vmm_get_kernel_directory());
+    tr_set(tr_stack, cpus[cpu].idle->kernel_stack_top);
+    tr_set(tr_entry, (uint32_t)ap_main);
+    tr_set(tr_cpu,   (uint32_t)cpu);
+
+    lapic_send_ipi(apic, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    udelay(10000);
+    lapic_send_ipi(apic, ICR_STARTUP | vec);
+    udelay(200);
+    if (!cpus[cpu].online) lapic_send_ipi(apic, ICR_STARTUP | vec);
+
+    for (int i = 0; i < 100 && !cpus[cpu].online; i++) udelay(1000);
+    return cpus[cpu].online;
+}
+
+// BSP のスケジューラを初期化した後に呼ぶ
+void smp_init(void) {
+    uint32_t lapic_phys = mp_parse();
+    if (!lapic_phys) {
+        kprintf("[SMP] no MP table, running on 1 CPU\n");
+        return;
+    }
+    lapic_setup(lapic_phys);
+    lapic_init();
+    cpus[0].apic_id = lapic_id();
+    lapic_timer_calibrate();
+
+    uint8_t* dst = (uint8_t*)TRAMPOLINE_BASE;
+    for (char* s = trampoline_start; s < trampoline_end; s++) *dst++ = (uint8_t)*s;
+
+    for (int i = 0; i < nr_ap_ids; i++) {
+        int cpu = nr_cpus;
+        cpus[cpu].apic_id = ap_apic_ids[i];
+        cpus[cpu].idle    = proc_create_idle(cpu);
+        if (!cpus[cpu].idle) break;
+        if (ap_boot(cpu)) nr_cpus++;
+        else kprintf("[SMP] APIC %d did not start\n", ap_apic_ids[i]);
+    }
+    kprintf("[SMP] %d CPU(s) online\n", nr_cpus);
+}
+
+// ===== TLB シュートダウン =====
+// 要求は CPU ごとのフラグで出し、相手が CR3 を読み直して0に戻すのを待つ。
+// 待っている間も自分宛ての要求は片付ける (お互いに割り込み禁止で待っても詰まらない)
+static volatile int tlb_flush_pending[MAX_CPUS];
+
+void smp_tlb_flush_ipi(void) {
+    int cpu = smp_processor_id();
+    if (!tlb_flush_pending[cpu]) return;
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3) :: "memory");
+    tlb_flush_pending[cpu] = 0;
+}
+
+void smp_flush_tlb_others(void* pgd) {
+    if (nr_cpus == 1) return;
+    preempt_disable();
+    int self = smp_processor_id();
+    int sent[MAX_CPUS];
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        sent[cpu] = 0;
+        if (cpu == self || !cpus[cpu].online) continue;
+        // これから切り替えてくる CPU は CR3 の読み込みで捨てるので要らない
+        process_t* cur = cpus[cpu].current;
+        if (!cur || (void*)cur->page_dir != pgd) continue;
+        tlb_flush_pending[cpu] = 1;
+        lapic_send_ipi(cpus[cpu].apic_id, TLB_FLUSH_VECTOR);
+        sent[cpu] = 1;
+    }
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        while (sent[cpu] && tlb_flush_pending[cpu]) {
+            smp_tlb_flush_ipi();
+            asm volatile("pause");
+        }
+    }
+    preempt_enable();
+}
+
+// 別の CPU に再スケジュールを促す
+void smp_send_resched(int cpu) {
+    if (cpu == smp_processor_id() || !cpus[cpu].online) return;
+    lapic_send_ipi(cpus[cpu].apic_id, RESCHED_VECTOR);
+}
@@ -0,0 +1,82 @@
+// kernel/softirq.c - ソフト割り込み
+#include "../include/kernel/softirq.h"
+#include "../include/kernel/kthread.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/smp.h"
+#include "../include/kernel/wait.h"
+#include "../include/kernel/timer.h"
+#include "../include/kernel/irqflags.h"
+#include "../include/kernel/types.h"
+
+// 1回の irq_exit で繰り返す上限。超えた分は ksoftirqd に回す
+#define MAX_SOFTIRQ_RESTART 4
+
+// 保留ビットと実行中フラグは CPU ごと (cpu_t)。割り込みは BSP に来るので
+// ksoftirqd も BSP に固定する
+static softirq_fn_t softirq_vec[NR_SOFTIRQS];
+
+static process_t* ksoftirqd = NULL;
+static wait_queue_head_t ksoftirqd_wait = WAIT_QUEUE_HEAD_INIT(ksoftirqd_wait);
+
+void open_softirq(int nr, softirq_fn_t fn) {
+    softirq_vec[nr] = fn;
+}
+
+void raise_softirq(int nr) {
+    uint32_t flags = local_irq_save();
+    this_cpu()->softirq_pending |= (1u << nr);
+    local_irq_restore(flags);
+}
+
+// ソフト割り込み処理中はプリエンプションしない
+int in_softirq(void) {
+    return this_cpu()->softirq_running;
+}
+
+// 割り込み禁止で呼ぶ。各ハンドラは割り込み許可で走る
+static void do_softirq(void) {
+    cpu_t* cpu = this_cpu();
+    cpu->softirq_running = 1;
+    for (int restart = 0; cpu->softirq_pending && restart < MAX_SOFTIRQ_RESTART; restart++) {
+        uint32_t pending = cpu->softirq_pending;
+        cpu->softirq_pending = 0;
+
+        local_irq_enable();
+        for (int nr = 0; pending; nr++, pending >>= 1) {
+            if ((pending & 1) && softirq_vec[nr]) softirq_vec[nr]();
+        }
+        local_irq_disable();
+    }
+    cpu->softirq_running = 0;
+
+    // 割り込みが続いて処理しきれない分はスレッドで
+    if (cpu->softirq_pending && ksoftirqd && cpu->id == 0) wake_up(&ksoftirqd_wait);
+}
+
+// ハード割り込みの出口 (EOI 後、割り込み禁止) で呼ぶ
+void irq_exit(void) {
+    cpu_t* cpu = this_cpu();
+    if (cpu->softirq_pending && !cpu->softirq_running) do_softirq();
+}
+
+static int ksoftirqd_fn(void* arg) {
+    (void)arg;
+    while (!kthread_should_stop()) {
+        wait_event(ksoftirqd_wait, this_cpu()->softirq_pending || kthread_should_stop());
+        uint32_t flags = local_irq_save();
+        if (!this_cpu()->softirq_running) do_softirq();
+        local_irq_restore(flags);
+    }
+    return 0;
+}
+
+static void timer_softirq(void) {
+    timer_run(ticks);
+}
+
+void softirq_init(void) {
+    open_softirq(TIMER_SOFTIRQ, timer_softirq);
+    // AP 起動前に呼ぶので BSP のキューに入る
+    ksoftirqd = kthread_create(ksoftirqd_fn, NULL, "ksoftirqd");
+    if (ksoftirqd) ksoftirqd->flags |= PF_NO_MIGRATE;
+}
@@ -0,0 +1,47 @@
+// kernel/spinlock.c - ロッククラスの統計 (lockstat)
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/types.h"
+
+int           lock_stat_enabled = 0;
+lock_class_t* lock_classes      = NULL;
+
+// クラス一覧自体のロック (統計は取らない)
+static spinlock_t class_list_lock = SPINLOCK_INIT;
+
+// 最初に取られたときに一覧へ登録する
+static void lock_class_register(lock_class_t* c) {
+    uint32_t flags = spin_lock_irqsave(&class_list_lock);
+    if (!c->registered) {
+        c->registered = 1;
+        c->next = lock_classes;
+        lock_classes = c;
+    }
+    spin_unlock_irqrestore(&class_list_lock, flags);
+}
+
+// wait_start は回り始めた時刻 (すぐ取れたら0)
+void lock_stat_acquired(lock_class_t* c, uint64_t wait_start) {
+    if (!c->registered) lock_class_register(c);
+    c->acquired++;
+    if (wait_start) c->wait_cycles += lock_stat_clock() - wait_start;
+}
+
+void lock_stat_contended(lock_class_t* c) {
+    c->contended++;
+}
+
+void lock_stat_released(lock_class_t* c, uint64_t held_since) {
+    if (!held_since) return;
+    uint64_t held = lock_stat_clock() - held_since;
+    c->hold_cycles += held;
+    if (held > c->max_hold) c->max_hold = held;
+}
+
+void lock_stat_reset(void) {
+    uint32_t flags = spin_lock_irqsave(&class_list_lock);
+    for (lock_class_t* c = lock_classes; c; c = c->next) {
+        c->acquired = c->contended = 0;
+        c->wait_cycles = c->hold_cycles = c->max_hold = 0;
+    }
+    spin_unlock_irqrestore(&class_list_lock, flags);
+}
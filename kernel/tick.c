@@ -0,0 +1,91 @@
+// kernel/tick.c - tickless idle (ダイナミックティック)
+#include "../include/kernel/timer.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/sched.h"
+#include "../include/kernel/smp.h"
+#include "../include/kernel/softirq.h"
+#include "../include/kernel/vdso.h"
+#include "../include/kernel/types.h"
+
+#define PIT_HZ      1193180
+#define PIT_DIVISOR (PIT_HZ / HZ)
+// PIT のカウンタは16bitなので一度に止められるのは数tickまで
+#define NOHZ_MAX_TICKS (0xFFFF / PIT_DIVISOR)
+
+extern void     pit_init(void);
+extern void     pit_set_oneshot(uint16_t count);
+extern uint16_t pit_read_count(void);
+extern void     clock_tick(void);
+
+static int      nohz_active = 0;  // ワンショット設定中
+static uint32_t nohz_ticks  = 0;  // 設定した tick 数
+static uint32_t nohz_residual = 0; // 1tick未満の端数 (PITカウント)
+
+// 時刻を進める (BSP の PIT 割り込みだけが呼ぶ)
+void do_timer(void) {
+    ticks++;
+    clock_tick();
+    vdso_update();
+    // 満了したタイマーの処理 (スリープ解除など) は割り込みの出口で
+    raise_softirq(TIMER_SOFTIRQ);
+}
+
+// tick を止められるのは PIT を持つ BSP だけ (AP は LAPIC タイマーで周期動作)
+
+// idleループから割り込み禁止で呼ぶ
+void tick_nohz_idle_enter(void) {
+    if (smp_processor_id() != 0) return;
+    if (nohz_active || sched_nr_running()) return;
+
+    uint32_t delta = NOHZ_MAX_TICKS;
+    uint32_t next;
+    if (timer_next_expiry(&next)) {
+        if (!time_after(next, ticks + 1)) return; // 次のtickで満了
+        if (next - ticks < delta) delta = next - ticks;
+    }
+    if (delta <= 1) return;
+
+    nohz_ticks  = delta;
+    nohz_active = 1;
+    pit_set_oneshot((uint16_t)(delta * PIT_DIVISOR));
+}
+
+static void nohz_account(uint32_t elapsed_counts) {
+    elapsed_counts += nohz_residual;
+    ticks         += elapsed_counts / PIT_DIVISOR;
+    nohz_residual  = elapsed_counts % PIT_DIVISOR;
+    nohz_active    = 0;
+    pit_init();
+    vdso_update();
+}
+
+// タイマー割り込み: ワンショットが満了した
+// 最後の1tickは scheduler_tick() が数える
+void tick_nohz_irq(void) {
+    if (smp_processor_id() != 0 || !nohz_active) return;
+    nohz_account((nohz_ticks - 1) * PIT_DIVISOR);
+}
+
+// ワンショットを止めて周期 tick に戻し、経過分だけ ticks を進める
+static void nohz_stop(void) {
+    uint32_t programmed = nohz_ticks * PIT_DIVISOR;
+    uint32_t remaining  = pit_read_count();
+    if (remaining > programmed) remaining = programmed;
+    nohz_account(programmed - remaining);
+}
+
+// タイマー以外の割り込みで起きた: 経過分だけ ticks を進める
+void tick_nohz_idle_exit(void) {
+    if (smp_processor_id() != 0 || !nohz_active) return;
+    nohz_stop();
+    timer_run(ticks);
+}
+
+// タイマー以外の割り込みの入口で (Linux の tick_irq_enter)。
+// ハンドラが起こしたタスクへ出口で切り替わると idle の tick_nohz_idle_exit まで戻らないので、
+// 先に周期 tick に戻しておく。満了したタイマーは出口のソフト割り込みで処理する
+void tick_irq_enter(void) {
+    if (smp_processor_id() != 0 || !nohz_active) return;
+    nohz_stop();
+    raise_softirq(TIMER_SOFTIRQ);
+}
@@ -0,0 +1,126 @@
+// kernel/timer.c - カーネルタイマー (満了時刻順の最小ヒープ)
+#include "../include/kernel/timer.h"
+#include "../include/kernel/mm.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/types.h"
+
+#define TIMER_HEAP_INIT 64
+
+static ktimer_t** heap     = NULL;
+static int        heap_len = 0;
+static int        heap_cap = 0;
+static spinlock_t timer_lock = SPINLOCK_INIT;
+
+static void heap_set(int idx, ktimer_t* t) {
+    heap[idx] = t;
+    t->heap_idx = idx;
+}
+
+static void sift_up(int idx) {
+    ktimer_t* t = heap[idx];
+    while (idx > 0) {
+        int parent = (idx - 1) / 2;
+        if (!time_before(t->expires, heap[parent]->expires)) break;
+        heap_set(idx, heap[parent]);
+        idx = parent;
+    }
+    heap_set(idx, t);
+}
+
+static void sift_down(int idx) {
+    ktimer_t* t = heap[idx];
+    while (1) {
+        int child = idx * 2 + 1;
+        if (child >= heap_len) break;
+        if (child + 1 < heap_len &&
+            time_before(heap[child + 1]->expires, heap[child]->expires))
+            child++;
+        if (!time_before(heap[child]->expires, t->expires)) break;
+        heap_set(idx, heap[child]);
+        idx = child;
+    }
+    heap_set(idx, t);
+}
+
+static void heap_remove(int idx) {
+    ktimer_t* t = heap[idx];
+    t->heap_idx = -1;
+    if (--heap_len == idx) return;
+
+    // 末尾要素で穴を埋めて位置を直す
+    heap_set(idx, heap[heap_len]);
+    if (idx > 0 && time_before(heap[idx]->expires, heap[(idx - 1) / 2]->expires))
+        sift_up(idx);
+    else
+        sift_down(idx);
+}
+
+void timer_init(void) {
+    heap     = (ktimer_t**)kmalloc(sizeof(ktimer_t*) * TIMER_HEAP_INIT);
+    heap_cap = TIMER_HEAP_INIT;
+    heap_len = 0;
+}
+
+void timer_setup(ktimer_t* t, timer_fn_t fn, void* data) {
+    t->expires  = 0;
+    t->fn       = fn;
+    t->data     = data;
+    t->heap_idx = -1;
+}
+
+int timer_pending(const ktimer_t* t) {
+    return t->heap_idx >= 0;
+}
+
+// 登録済みなら満了時刻を変更する
+// ヒープ操作は timer_lock を取って行う (timer_run はソフト割り込みから呼ばれる)
+void timer_add(ktimer_t* t, uint32_t expires) {
+    uint32_t flags = spin_lock_irqsave(&timer_lock);
+    if (timer_pending(t)) heap_remove(t->heap_idx);
+
+    if (heap_len == heap_cap) {
+        int new_cap = heap_cap ? heap_cap * 2 : TIMER_HEAP_INIT;
+        heap = (ktimer_t**)krealloc(heap, sizeof(ktimer_t*) * new_cap);
+        heap_cap = new_cap;
+    }
+
+    t->expires = expires;
+    heap_set(heap_len++, t);
+    sift_up(t->heap_idx);
+    spin_unlock_irqrestore(&timer_lock, flags);
+}
+
+// 登録されていたら1を返す
+int timer_cancel(ktimer_t* t) {
+    uint32_t flags = spin_lock_irqsave(&timer_lock);
+    int ret = timer_pending(t);
+    if (ret) heap_remove(t->heap_idx);
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return ret;
+}
+
+// 最も早い満了時刻 (タイマーが無ければ0を返す)
+int timer_next_expiry(uint32_t* expires) {
+    uint32_t flags = spin_lock_irqsave(&timer_lock);
+    int ret = heap_len > 0;
+    if (ret) *expires = heap[0]->expires;
+    spin_unlock_irqrestore(&timer_lock, flags);
+    return ret;
+}
+
+// 満了したタイマーだけを処理する (O(満了数 * log n))
+// コールバックはロックを外し、呼び出し元の割り込み状態のまま呼ぶ
+void timer_run(uint32_t now) {
+    while (1) {
+        uint32_t flags = spin_lock_irqsave(&timer_lock);
+        if (heap_len == 0 || time_after(heap[0]->expires, now)) {
+            spin_unlock_irqrestore(&timer_lock, flags);
+            break;
+        }
+        ktimer_t* t = heap[0];
+        heap_remove(0);
+        spin_unlock_irqrestore(&timer_lock, flags);
+        // コールバック内での再登録を許す
+        t->fn(t->data);
+    }
+}
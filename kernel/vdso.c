@@ -0,0 +1,110 @@
+// kernel/vdso.c - ユーザーに読ませるカーネルのページ (include/kernel/vdso.h)
+#include "../include/kernel/vdso.h"
+#include "../include/kernel/vma.h"
+#include "../include/kernel/mm.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/sched.h"
+#include "../include/kernel/timer.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/types.h"
+
+extern void kprintf(const char* fmt, ...);
+
+// カーネルイメージの中の1ページ (恒等マップなので物理アドレスも同じ)。
+// ページまるごとユーザーに見えるので、他の変数が同じページに載らないよう埋める
+static union {
+    vdso_data_t d;
+    uint8_t     raw[PAGE_SIZE];
+} vdso_page __attribute__((aligned(PAGE_SIZE)));
+
+#define vdso_data (&vdso_page.d)
+
+// 書き手どうしの排他 (seq はユーザーに見えるページ側にある)
+DEFINE_SPINLOCK(vdso_lock);
+
+static uint32_t vdso_write_begin(void) {
+    uint32_t flags = spin_lock_irqsave(&vdso_lock);
+    vdso_data->seq++;
+    asm volatile("" ::: "memory");
+    return flags;
+}
+
+static void vdso_write_end(uint32_t flags) {
+    asm volatile("" ::: "memory");
+    vdso_data->seq++;
+    spin_unlock_irqrestore(&vdso_lock, flags);
+}
+
+void vdso_init(void) {
+    vdso_data->hz    = HZ;
+    vdso_data->ticks = ticks;
+    // マップのたびに参照を足し、アドレス空間の後始末で落とす。カーネルの分を1つ持っておき、
+    // 最後のプロセスが消えてもイメージのページが空きに戻らないようにする
+    pmm_get((uint32_t)&vdso_page);
+    kprintf("[VDSO] data at 0x%x, per-process page at 0x%x\n", VDSO_DATA_ADDR, VDSO_PROC_ADDR);
+}
+
+void vdso_set_clock(int tsc_ok, uint32_t khz, uint32_t mult, uint32_t shift,
+                    uint64_t tsc_base, uint64_t boot_epoch_ns) {
+    uint32_t flags = vdso_write_begin();
+    vdso_data->tsc_ok        = (uint32_t)tsc_ok;
+    vdso_data->tsc_khz       = khz;
+    vdso_data->tsc_mult      = mult;
+    vdso_data->tsc_shift     = shift;
+    vdso_data->tsc_base      = tsc_base;
+    vdso_data->boot_epoch_ns = boot_epoch_ns;
+    vdso_write_end(flags);
+}
+
+void vdso_update(void) {
+    uint32_t nr_running, nr_switches;
+    sched_stat_totals(&nr_running, &nr_switches);
+
+    uint32_t flags = vdso_write_begin();
+    vdso_data->ticks       = ticks;
+    vdso_data->nr_running  = nr_running;
+    vdso_data->nr_switches = nr_switches;
+    vdso_data->nr_forks    = proc_total_forks();
+    vdso_write_end(flags);
+}
+
+// ===== アドレス空間へのマップ =====
+// データのページは全員で共有し、プロセスのページはアドレス空間ごとに作る。
+// fork の子は vmm_clone で親のプロセスのページを共有しているので、自分のものに差し替える
+int vdso_mm_setup(mm_t* mm, pid_t pid) {
+    uint32_t phys = (uint32_t)pmm_alloc();
+    if (!phys) return -ENOMEM;
+    vdso_proc_t* vp = (vdso_proc_t*)kmap(phys);
+    for (uint32_t i = 0; i < PAGE_SIZE / 4; i++) ((uint32_t*)vp)[i] = 0;
+    vp->pid    = pid;
+    vp->shared = 0;
+    kunmap(vp);
+
+    mutex_lock(&mm->lock);
+    if (!mm_find_vma(mm, VDSO_DATA_ADDR)) {
+        int ret = mm_map(mm, VDSO_DATA_ADDR, VDSO_END, VM_READ, NULL, 0, 0);
+        if (ret < 0) {
+            mutex_unlock(&mm->lock);
+            pmm_put(phys);
+            return ret;
+        }
+        pmm_get((uint32_t)&vdso_page);
+        vmm_map(mm->pgd, VDSO_DATA_ADDR, (uint32_t)&vdso_page, PAGE_USER);
+    }
+    uint32_t old = vmm_get_pte(mm->pgd, VDSO_PROC_ADDR);
+    vmm_map(mm->pgd, VDSO_PROC_ADDR, phys, PAGE_USER);
+    mutex_unlock(&mm->lock);
+    if (old & PAGE_PRESENT) pmm_put(old & ~0xFFF);
+    return 0;
+}
+
+void vdso_mm_shared(mm_t* mm) {
+    mutex_lock(&mm->lock);
+    uint32_t phys = vmm_get_physical(mm->pgd, VDSO_PROC_ADDR);
+    if (phys) {
+        vdso_proc_t* vp = (vdso_proc_t*)kmap(phys);
+        vp->shared = 1;
+        kunmap(vp);
+    }
+    mutex_unlock(&mm->lock);
+}
@@ -0,0 +1,44 @@
+// kernel/wait.c - 待ちキュー
+#include "../include/kernel/wait.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/types.h"
+
+void init_waitqueue_head(wait_queue_head_t* wq) {
+    spin_lock_init(&wq->lock);
+    list_init(&wq->head);
+}
+
+// 既にキューに入っていれば何もしない
+void add_wait_queue(wait_queue_head_t* wq, wait_queue_entry_t* w) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    if (list_empty(&w->link)) list_add_tail(&w->link, &wq->head);
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+// wake_up で既に外されていても構わない
+void remove_wait_queue(wait_queue_head_t* wq, wait_queue_entry_t* w) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    list_del(&w->link);
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+// 起こしたエントリはキューから外す。
+// 起こされたタスクが走る前に次の wake_up が来ても、同じタスクを二重に選ばない。
+static void wake_entry(wait_queue_entry_t* w) {
+    list_del(&w->link);
+    proc_wakeup(w->task);
+}
+
+void wake_up(wait_queue_head_t* wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    if (!list_empty(&wq->head))
+        wake_entry(list_entry(wq->head.next, wait_queue_entry_t, link));
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
+
+void wake_up_all(wait_queue_head_t* wq) {
+    uint32_t flags = spin_lock_irqsave(&wq->lock);
+    while (!list_empty(&wq->head))
+        wake_entry(list_entry(wq->head.next, wait_queue_entry_t, link));
+    spin_unlock_irqrestore(&wq->lock, flags);
+}
@@ -0,0 +1,49 @@
+// kernel/workqueue.c - ワークキュー
+// 割り込みから積まれた work を kworker スレッドが割り込み許可・プロセス文脈で実行する
+#include "../include/kernel/workqueue.h"
+#include "../include/kernel/kthread.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/wait.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/types.h"
+
+static list_head_t       work_list   = LIST_HEAD_INIT(work_list);
+static wait_queue_head_t worker_wait = WAIT_QUEUE_HEAD_INIT(worker_wait);
+static spinlock_t        work_lock   = SPINLOCK_INIT;
+
+int schedule_work(work_t* w) {
+    uint32_t flags = spin_lock_irqsave(&work_lock);
+    if (w->pending) {
+        spin_unlock_irqrestore(&work_lock, flags);
+        return 0;
+    }
+    w->pending = 1;
+    list_add_tail(&w->entry, &work_list);
+    spin_unlock_irqrestore(&work_lock, flags);
+    wake_up(&worker_wait);
+    return 1;
+}
+
+static int worker_fn(void* arg) {
+    (void)arg;
+    while (!kthread_should_stop()) {
+        wait_event(worker_wait, !list_empty(&work_list) || kthread_should_stop());
+
+        uint32_t flags = spin_lock_irqsave(&work_lock);
+        while (!list_empty(&work_list)) {
+            work_t* w = list_entry(work_list.next, work_t, entry);
+            list_del(&w->entry);
+            // 実行中に再投入できるよう先に外す
+            w->pending = 0;
+            spin_unlock_irqrestore(&work_lock, flags);
+            w->fn(w);
+            flags = spin_lock_irqsave(&work_lock);
+        }
+        spin_unlock_irqrestore(&work_lock, flags);
+    }
+    return 0;
+}
+
+void workqueue_init(void) {
+    kthread_create(worker_fn, NULL, "kworker");
+}
@@ -4,6 +4,10 @@
 #include "../include/kernel/types.h"
 #include "../include/kernel/vfs.h"
 #include "../include/kernel/proc.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/futex.h"
+#include "../include/kernel/gthread.h"
+#include "../include/kernel/kthread.h"
 
 // システムコール番号
 #define SYS_EXIT    1
@@ -25,6 +29,16 @@
 #define SYS_READDIR 89
 #define SYS_GETCWD  183
 #define SYS_GETPPID 64
+#define SYS_NICE    34
+#define SYS_GETPRIORITY 96
+#define SYS_SETPRIORITY 97
+#define SYS_SCHED_YIELD    158
+#define SYS_SCHED_SETATTR  351
+#define SYS_SCHED_GETATTR  352
+#define SYS_CLOCK_GETTIME   265
+#define SYS_CLOCK_NANOSLEEP 267
+#define SYS_TIMES     43
+#define SYS_GETRUSAGE 77
 
 // ===== 内部で直接関数を呼ぶ (カーネル空間のユーザープログラム) =====
 // カーネル内で実行するため、システムコールの代わりに直接呼ぶ
@@ -35,16 +49,16 @@ extern ssize_t file_read(file_t* f, void* buf, size_t size);
 extern ssize_t file_write(file_t* f, const void* buf, size_t size);
 extern int     file_readdir(file_t* f, uint32_t index, char* name);
 extern void    proc_exit(int code);
-extern process_t* proc_fork(void);
 extern pid_t   proc_wait(pid_t pid, int* status);
 extern void    proc_sleep(uint32_t ms);
 extern void    tty_putchar(char c);
 extern int     tty_readline(char* buf, int maxlen);
 extern void    tty_puts(const char* s);
 extern vnode_t* vfs_lookup(const char* path);
-extern process_t* current_proc;
 extern void    kfree(void* ptr);
 extern void*   kmalloc(size_t size);
+extern uint32_t kstack_alloc(void);
+extern void     kstack_free(uint32_t top);
 
 // ===== 文字列関数 =====
 size_t strlen(const char* s) {
@@ -228,7 +242,7 @@ int printf(const char* fmt, ...) {
     int n = vsnprintf(buf, sizeof(buf), fmt, ap);
     __builtin_va_end(ap);
     // fd=1 (stdout) に書く
-    file_t* f = current_proc ? current_proc->fds[1] : NULL;
+    file_t* f = current_proc && current_proc->cold->files ? current_proc->cold->files->fds[1] : NULL;
     if (f) file_write(f, buf, n);
     return n;
 }
@@ -238,8 +252,8 @@ int open(const char* path, int flags) {
     file_t* f = file_open(path, flags);
     if (!f) return -1;
     for (int i = 0; i < MAX_FDS; i++) {
-        if (!current_proc->fds[i]) {
-            current_proc->fds[i] = f;
+        if (!current_proc->cold->files->fds[i]) {
+            current_proc->cold->files->fds[i] = f;
             return i;
         }
     }
@@ -248,20 +262,20 @@ int open(const char* path, int flags) {
 }
 
 int close(int fd) {
-    if (fd < 0 || fd >= MAX_FDS || !current_proc->fds[fd]) return -1;
-    file_close(current_proc->fds[fd]);
-    current_proc->fds[fd] = NULL;
+    if (fd < 0 || fd >= MAX_FDS || !current_proc->cold->files->fds[fd]) return -1;
+    file_close(current_proc->cold->files->fds[fd]);
+    current_proc->cold->files->fds[fd] = NULL;
     return 0;
 }
 
 ssize_t read(int fd, void* buf, size_t count) {
-    if (fd < 0 || fd >= MAX_FDS || !current_proc->fds[fd]) return -1;
-    return file_read(current_proc->fds[fd], buf, count);
+    if (fd < 0 || fd >= MAX_FDS || !current_proc->cold->files->fds[fd]) return -1;
+    return file_read(current_proc->cold->files->fds[fd], buf, count);
 }
 
 ssize_t write(int fd, const void* buf, size_t count) {
-    if (fd < 0 || fd >= MAX_FDS || !current_proc->fds[fd]) return -1;
-    return file_write(current_proc->fds[fd], buf, count);
+    if (fd < 0 || fd >= MAX_FDS || !current_proc->cold->files->fds[fd]) return -1;
+    return file_write(current_proc->cold->files->fds[fd], buf, count);
 }
 
 // ===== malloc =====
@@ -274,6 +288,528 @@ void exit(int code) { proc_exit(code); }
 pid_t getpid(void)  { return current_proc->pid; }
 void sleep(uint32_t secs) { proc_sleep(secs * 1000); }
 
+// ===== 優先度 =====
+int getpriority(int which, int who) {
+    if (which != PRIO_PROCESS) return -1;
+    int n = proc_getnice(who);
+    return n < NICE_MIN ? -1 : n;
+}
+int setpriority(int which, int who, int nice) {
+    if (which != PRIO_PROCESS) return -1;
+    return proc_setnice(who, nice) < 0 ? -1 : 0;
+}
+int sched_yield(void) { proc_yield(); return 0; }
+int sched_setattr(pid_t pid, const sched_attr_t* attr, uint32_t flags) {
+    if (flags) return -1;
+    return proc_sched_setattr(pid, attr) < 0 ? -1 : 0;
+}
+int sched_getattr(pid_t pid, sched_attr_t* attr, uint32_t size, uint32_t flags) {
+    if (flags || size < sizeof(sched_attr_t)) return -1;
+    return proc_sched_getattr(pid, attr) < 0 ? -1 : 0;
+}
+int nice(int inc) {
+    if (proc_setnice(0, current_proc->nice + inc) < 0) return -1;
+    return current_proc->nice;
+}
+
+// ===== 時刻 =====
+int clock_gettime(int clk, timespec_t* ts) { return ktime_gettime(clk, ts) < 0 ? -1 : 0; }
+int nanosleep(const timespec_t* req, timespec_t* rem) {
+    return ktime_nanosleep(req, rem) < 0 ? -1 : 0;
+}
+clock_t times(tms_t* buf) { return proc_times(buf); }
+int getrusage(int who, rusage_t* usage) { return proc_getrusage(who, usage) < 0 ? -1 : 0; }
+int usleep(uint32_t usecs) {
+    timespec_t ts = { (int32_t)(usecs / 1000000), (int32_t)(usecs % 1000000) * 1000 };
+    return nanosleep(&ts, NULL);
+}
+
+// ===== futex / mutex / 条件変数 =====
+// 競合がなければアトミック命令だけで終わり、カーネルには入らない
+int futex(uint32_t* uaddr, int op, uint32_t val, const timespec_t* timeout,
+          uint32_t* uaddr2, uint32_t val3) {
+    // REQUEUE 系では timeout の位置に移す数が入る (Linux と同じ)
+    uint32_t val2 = (uint32_t)timeout;
+    int r = do_futex(uaddr, op, val, (op & FUTEX_CMD_MASK) == FUTEX_WAIT ? timeout : NULL,
+                     val2, uaddr2, val3);
+    return r < 0 ? -1 : r;
+}
+
+static inline uint32_t atomic_cmpxchg(volatile uint32_t* p, uint32_t old, uint32_t val) {
+    asm volatile("lock; cmpxchgl %2, %1" : "+a"(old), "+m"(*p) : "r"(val) : "memory");
+    return old;
+}
+
+static inline uint32_t atomic_xchg(volatile uint32_t* p, uint32_t val) {
+    asm volatile("xchgl %0, %1" : "+r"(val), "+m"(*p) :: "memory");
+    return val;
+}
+
+// 足した後の値
+static inline uint32_t atomic_inc_return(volatile uint32_t* p) {
+    uint32_t v = 1;
+    asm volatile("lock; xaddl %0, %1" : "+r"(v), "+m"(*p) :: "memory");
+    return v + 1;
+}
+
+int pthread_mutex_init(pthread_mutex_t* m, const void* attr) {
+    (void)attr;
+    m->state = 0;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t* m) {
+    return m->state ? -EBUSY : 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* m) {
+    return atomic_cmpxchg(&m->state, 0, 1) == 0 ? 0 : -EBUSY;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* m) {
+    uint32_t c = atomic_cmpxchg(&m->state, 0, 1);
+    if (c == 0) return 0;
+    // 待ちありの印 (2) を付けてから眠る。起きたらまた 2 で取りにいく
+    // (他にも待っている人がいるかもしれないので、解放する側に WAKE させる)
+    if (c != 2) c = atomic_xchg(&m->state, 2);
+    while (c != 0) {
+        do_futex((uint32_t*)&m->state, FUTEX_WAIT, 2, NULL, 0, NULL, 0);
+        c = atomic_xchg(&m->state, 2);
+    }
+    return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* m) {
+    if (atomic_xchg(&m->state, 0) == 2)
+        do_futex((uint32_t*)&m->state, FUTEX_WAKE, 1, NULL, 0, NULL, 0);
+    return 0;
+}
+
+int pthread_cond_init(pthread_cond_t* c, const void* attr) {
+    (void)attr;
+    c->seq   = 0;
+    c->mutex = NULL;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t* c) {
+    (void)c;
+    return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t* c, pthread_mutex_t* m) {
+    uint32_t seq = c->seq;
+    c->mutex = m;
+    pthread_mutex_unlock(m);
+    // unlock から眠るまでに signal が来れば seq が変わっていて、すぐ戻る
+    do_futex((uint32_t*)&c->seq, FUTEX_WAIT, seq, NULL, 0, NULL, 0);
+    // broadcast で mutex の待ちに移されていることがあるので、待ちありとして取る
+    while (atomic_xchg(&m->state, 2) != 0)
+        do_futex((uint32_t*)&m->state, FUTEX_WAIT, 2, NULL, 0, NULL, 0);
+    return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t* c) {
+    atomic_inc_return(&c->seq);
+    do_futex((uint32_t*)&c->seq, FUTEX_WAKE, 1, NULL, 0, NULL, 0);
+    return 0;
+}
+
+// 1つだけ起こし、残りは mutex の待ちに移す (起きてもすぐ mutex で眠るだけなので)
+int pthread_cond_broadcast(pthread_cond_t* c) {
+    pthread_mutex_t* m = c->mutex;
+    uint32_t seq = atomic_inc_return(&c->seq);
+    if (!m) {
+        do_futex((uint32_t*)&c->seq, FUTEX_WAKE, 0x7FFFFFFF, NULL, 0, NULL, 0);
+        return 0;
+    }
+    // seq が変わっていたら (別の signal/broadcast が割り込んだ) 全員起こしてやり直させる
+    if (do_futex((uint32_t*)&c->seq, FUTEX_CMP_REQUEUE, 1, NULL, 0x7FFFFFFF,
+                 (uint32_t*)&m->state, seq) == -EAGAIN)
+        do_futex((uint32_t*)&c->seq, FUTEX_WAKE, 0x7FFFFFFF, NULL, 0, NULL, 0);
+    return 0;
+}
+
+// ===== グリーンスレッド (M:N) =====
+// 実行キュー・スリープ列・I/O 待ち列は1つずつで、gt_lock で守る。
+// グリーンスレッドは止まるときワーカーのスケジューラ文脈に切り替えて戻り、
+// キューへ戻す後始末はワーカーが切り替えた後で行う
+// (そうしないと、まだ自分のスタックの上にいるうちに別のワーカーに拾われうる)。
+#define GT_READY    0
+#define GT_RUNNING  1
+#define GT_SLEEPING 2
+#define GT_IO       3
+#define GT_DEAD     4
+
+#define GT_CANARY   0x57AC4C1Du   // スタックの底。切り替えのたびに確かめる
+
+// スタック領域の一番上に置く
+struct gthread {
+    uint32_t   sp;              // 止まっている間の ESP
+    int        state;           // GT_*
+    gt_fn_t    fn;
+    void*      arg;
+    uint32_t   wake_tick;       // GT_SLEEPING
+    int      (*io_fn)(void*);   // GT_IO
+    void*      io_arg;
+    int        io_ret;
+    gthread_t* next;            // 各キュー・スタックプールのリンク
+};
+
+typedef struct {
+    gthread_t* head;
+    gthread_t* tail;
+} gt_queue_t;
+
+typedef struct {
+    pid_t      pid;
+    uint32_t   sched_sp;        // ワーカーのスケジューラ文脈
+    gthread_t* curr;
+} gt_worker_t;
+
+extern void gt_switch(uint32_t* save_sp, uint32_t new_sp);
+
+static pthread_mutex_t   gt_lock = PTHREAD_MUTEX_INITIALIZER;
+static gt_queue_t        gt_runq, gt_ioq;
+static gthread_t*        gt_sleepers;        // wake_tick 順
+static gthread_t*        gt_pool;            // 使い終わったスタック
+static int               gt_pool_count;
+static volatile uint32_t gt_run_seq;         // 実行キューに積むたびに進める (futex)
+static volatile uint32_t gt_io_seq;
+static volatile uint32_t gt_live;            // 終わっていないグリーンスレッドの数 (futex)
+static volatile int      gt_stopping;
+static int               gt_running;
+static files_struct_t*   gt_files;           // gt_init を呼んだタスクの FD 表
+static gt_worker_t       gt_workers[GT_MAX_WORKERS];
+static pid_t             gt_io_pids[GT_MAX_IO];
+static int               gt_nworkers, gt_nio;
+
+static void gt_enqueue(gt_queue_t* q, gthread_t* t) {
+    t->next = NULL;
+    if (q->tail) q->tail->next = t;
+    else         q->head = t;
+    q->tail = t;
+}
+
+static gthread_t* gt_dequeue(gt_queue_t* q) {
+    gthread_t* t = q->head;
+    if (t) {
+        q->head = t->next;
+        if (!q->head) q->tail = NULL;
+    }
+    return t;
+}
+
+static uint32_t* gt_stack_base(gthread_t* t) {
+    return (uint32_t*)((uint8_t*)(t + 1) - GT_STACK_SIZE);
+}
+
+// gt_lock を持って呼ぶ。プールが空なら新しく確保する
+static gthread_t* gt_stack_alloc(void) {
+    gthread_t* t = gt_pool;
+    if (t) {
+        gt_pool = t->next;
+        gt_pool_count--;
+        return t;
+    }
+    // カーネルスタックと同じガードページ付きのスロット (溢れたらガードでフォルトする)
+    uint32_t top = kstack_alloc();
+    return top ? (gthread_t*)(top - sizeof(gthread_t)) : NULL;
+}
+
+// gt_lock を持って呼ぶ
+static void gt_stack_free(gthread_t* t) {
+    if (gt_pool_count >= GT_STACK_POOL_MAX) {
+        kstack_free((uint32_t)(t + 1));
+        return;
+    }
+    t->next = gt_pool;
+    gt_pool = t;
+    gt_pool_count++;
+}
+
+static gt_worker_t* gt_this_worker(void) {
+    pid_t pid = current_proc->pid;
+    for (int i = 0; i < gt_nworkers; i++)
+        if (gt_workers[i].pid == pid) return &gt_workers[i];
+    return NULL;
+}
+
+gthread_t* gt_self(void) {
+    gt_worker_t* w = gt_this_worker();
+    return w ? w->curr : NULL;
+}
+
+// 実行キューに積んで、眠っているワーカーを1つ起こす
+static void gt_make_ready(gthread_t* t) {
+    pthread_mutex_lock(&gt_lock);
+    t->state = GT_READY;
+    gt_enqueue(&gt_runq, t);
+    gt_run_seq++;
+    pthread_mutex_unlock(&gt_lock);
+    futex_wake((uint32_t*)&gt_run_seq, 1);
+}
+
+// ワーカーのスケジューラ文脈に戻る。state に応じた後始末はワーカーがする
+static void gt_park(gthread_t* t, int state) {
+    t->state = state;
+    gt_switch(&t->sp, gt_this_worker()->sched_sp);
+}
+
+static void gt_entry(void) {
+    gthread_t* t = gt_self();
+    t->fn(t->arg);
+    gt_exit();
+}
+
+gthread_t* gt_spawn(gt_fn_t fn, void* arg) {
+    if (!gt_running) return NULL;
+    pthread_mutex_lock(&gt_lock);
+    gthread_t* t = gt_stack_alloc();
+    if (t) gt_live++;
+    pthread_mutex_unlock(&gt_lock);
+    if (!t) return NULL;
+
+    t->fn  = fn;
+    t->arg = arg;
+    *gt_stack_base(t) = GT_CANARY;
+    // gt_switch が pop するレジスタ4つと戻り先 (gt_entry)。gt_entry 自身の戻り先は無い
+    uint32_t* sp = (uint32_t*)t;
+    *--sp = 0;
+    *--sp = (uint32_t)gt_entry;
+    sp -= 4;
+    memset(sp, 0, 16);
+    t->sp = (uint32_t)sp;
+    gt_make_ready(t);
+    return t;
+}
+
+void gt_yield(void) {
+    gthread_t* t = gt_self();
+    if (t) gt_park(t, GT_READY);
+    else   sched_yield();
+}
+
+void gt_sleep(uint32_t ms) {
+    gthread_t* t = gt_self();
+    if (!t) {
+        proc_sleep(ms);
+        return;
+    }
+    uint32_t n = ms_to_ticks(ms);
+    t->wake_tick = ticks + (n ? n : 1);
+    gt_park(t, GT_SLEEPING);
+}
+
+void gt_exit(void) {
+    gthread_t* t = gt_self();
+    if (!t) return;
+    gt_park(t, GT_DEAD);
+    // ここには戻らない
+}
+
+int gt_blocking(int (*fn)(void*), void* arg) {
+    gthread_t* t = gt_self();
+    if (!t) return fn(arg);
+    t->io_fn  = fn;
+    t->io_arg = arg;
+    gt_park(t, GT_IO);
+    return t->io_ret;
+}
+
+typedef struct {
+    int         fd;
+    void*       buf;
+    size_t      count;
+} gt_rw_t;
+
+static int gt_do_read(void* arg) {
+    gt_rw_t* a = (gt_rw_t*)arg;
+    return (int)read(a->fd, a->buf, a->count);
+}
+
+static int gt_do_write(void* arg) {
+    gt_rw_t* a = (gt_rw_t*)arg;
+    return (int)write(a->fd, a->buf, a->count);
+}
+
+ssize_t gt_read(int fd, void* buf, size_t count) {
+    gt_rw_t a = { fd, buf, count };
+    return gt_blocking(gt_do_read, &a);
+}
+
+ssize_t gt_write(int fd, const void* buf, size_t count) {
+    gt_rw_t a = { fd, (void*)buf, count };
+    return gt_blocking(gt_do_write, &a);
+}
+
+// gt_lock を持って呼ぶ。起きる時刻の来たスリープを実行キューへ
+static void gt_wake_sleepers(void) {
+    while (gt_sleepers && !time_before(ticks, gt_sleepers->wake_tick)) {
+        gthread_t* t = gt_sleepers;
+        gt_sleepers = t->next;
+        t->state = GT_READY;
+        gt_enqueue(&gt_runq, t);
+    }
+}
+
+// 切り替えて戻ってきた後: t が止まった理由に応じてキューへ戻す
+static void gt_put_prev(gthread_t* t) {
+    // ガードページの手前で底を踏んだ。このスレッドの状態はもう信用できないので止める
+    if (*gt_stack_base(t) != GT_CANARY) {
+        tty_puts("\n*** KERNEL PANIC: green thread stack overflow ***\n");
+        asm volatile("cli; hlt");
+    }
+
+    pthread_mutex_lock(&gt_lock);
+    switch (t->state) {
+    case GT_READY:
+        gt_enqueue(&gt_runq, t);
+        break;
+    case GT_SLEEPING: {
+        gthread_t** pp = &gt_sleepers;
+        while (*pp && !time_before(t->wake_tick, (*pp)->wake_tick)) pp = &(*pp)->next;
+        t->next = *pp;
+        *pp = t;
+        break;
+    }
+    case GT_IO:
+        gt_enqueue(&gt_ioq, t);
+        gt_io_seq++;
+        break;
+    case GT_DEAD:
+        gt_stack_free(t);
+        gt_live--;
+        break;
+    }
+    int state = t->state;
+    uint32_t live = gt_live;
+    pthread_mutex_unlock(&gt_lock);
+
+    if (state == GT_IO) futex_wake((uint32_t*)&gt_io_seq, 1);
+    if (state == GT_DEAD && live == 0) futex_wake((uint32_t*)&gt_live, 0x7FFFFFFF);
+}
+
+static int gt_worker_fn(void* arg) {
+    gt_worker_t* w = (gt_worker_t*)arg;
+    proc_share_files(gt_files);
+    while (1) {
+        pthread_mutex_lock(&gt_lock);
+        gt_wake_sleepers();
+        gthread_t* t = gt_dequeue(&gt_runq);
+        if (!t) {
+            if (gt_stopping) {
+                pthread_mutex_unlock(&gt_lock);
+                break;
+            }
+            // 仕事が来るか、一番早いスリープの時刻まで眠る
+            uint32_t seq = gt_run_seq;
+            uint32_t tmo = 0;
+            if (gt_sleepers) {
+                tmo = gt_sleepers->wake_tick - ticks;
+                if (!tmo || tmo > 0x80000000u) tmo = 1;
+            }
+            pthread_mutex_unlock(&gt_lock);
+            futex_wait((uint32_t*)&gt_run_seq, seq, tmo);
+            continue;
+        }
+        pthread_mutex_unlock(&gt_lock);
+
+        t->state = GT_RUNNING;
+        w->curr  = t;
+        gt_switch(&w->sched_sp, t->sp);
+        w->curr  = NULL;
+        gt_put_prev(t);
+    }
+    return 0;
+}
+
+// ブロックする呼び出しを肩代わりする
+static int gt_io_fn(void* arg) {
+    (void)arg;
+    proc_share_files(gt_files);
+    while (1) {
+        pthread_mutex_lock(&gt_lock);
+        gthread_t* t = gt_dequeue(&gt_ioq);
+        if (!t) {
+            if (gt_stopping) {
+                pthread_mutex_unlock(&gt_lock);
+                break;
+            }
+            uint32_t seq = gt_io_seq;
+            pthread_mutex_unlock(&gt_lock);
+            futex_wait((uint32_t*)&gt_io_seq, seq, 0);
+            continue;
+        }
+        pthread_mutex_unlock(&gt_lock);
+        t->io_ret = t->io_fn(t->io_arg);
+        gt_make_ready(t);
+    }
+    return 0;
+}
+
+int gt_init(int nworkers, int nio) {
+    if (gt_running) return -EBUSY;
+    if (nworkers < 1) nworkers = 1;
+    if (nworkers > GT_MAX_WORKERS) nworkers = GT_MAX_WORKERS;
+    if (nio < 1) nio = 1;
+    if (nio > GT_MAX_IO) nio = GT_MAX_IO;
+
+    gt_files    = current_proc->cold->files;
+    gt_stopping = 0;
+    gt_live     = 0;
+    gt_nworkers = 0;
+    gt_nio      = 0;
+    // ワーカーが gt_this_worker() で自分を見つけられるよう、pid を入れてから数を増やす
+    for (int i = 0; i < nworkers; i++) {
+        gt_worker_t* w = &gt_workers[i];
+        w->curr = NULL;
+        process_t* p = kthread_create(gt_worker_fn, w, "gtworker");
+        if (!p) break;
+        w->pid = p->pid;
+        gt_nworkers++;
+    }
+    for (int i = 0; i < nio; i++) {
+        process_t* p = kthread_create(gt_io_fn, NULL, "gtio");
+        if (!p) break;
+        gt_io_pids[gt_nio++] = p->pid;
+    }
+    gt_running = 1;
+    if (!gt_nworkers || !gt_nio) {
+        gt_shutdown();
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+void gt_shutdown(void) {
+    if (!gt_running) return;
+    uint32_t live;
+    while ((live = gt_live) != 0)
+        futex_wait((uint32_t*)&gt_live, live, 0);
+
+    pthread_mutex_lock(&gt_lock);
+    gt_stopping = 1;
+    gt_run_seq++;
+    gt_io_seq++;
+    pthread_mutex_unlock(&gt_lock);
+    futex_wake((uint32_t*)&gt_run_seq, 0x7FFFFFFF);
+    futex_wake((uint32_t*)&gt_io_seq, 0x7FFFFFFF);
+    for (int i = 0; i < gt_nworkers; i++) proc_wait(gt_workers[i].pid, NULL);
+    for (int i = 0; i < gt_nio; i++)     proc_wait(gt_io_pids[i], NULL);
+
+    pthread_mutex_lock(&gt_lock);
+    while (gt_pool) {
+        gthread_t* t = gt_pool;
+        gt_pool = t->next;
+        kstack_free((uint32_t)(t + 1));
+    }
+    gt_pool_count = 0;
+    pthread_mutex_unlock(&gt_lock);
+    gt_nworkers = gt_nio = 0;
+    gt_running  = 0;
+}
+
 // ===== 文字判定 =====
 int isspace(int c) { return c==' '||c=='\t'||c=='\n'||c=='\r'||c=='\f'||c=='\v'; }
 int isdigit(int c) { return c>='0' && c<='9'; }
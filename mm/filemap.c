@@ -0,0 +1,123 @@
+// mm/filemap.c - ページキャッシュ
+// (vnode, ページ番号) → 物理ページ。キャッシュ自身が1つ参照を持ち、
+// マップするたびに参照を足す。同じ実行ファイルのテキストは何プロセスでも1枚で済む。
+#include "../include/kernel/vma.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/types.h"
+
+#define PAGE_CACHE_HASH 256
+
+typedef struct page_cache_entry {
+    vnode_t*                 vnode;
+    uint32_t                 index;
+    uint32_t                 phys;
+    struct page_cache_entry* next;
+} page_cache_entry_t;
+
+static page_cache_entry_t* pc_hash[PAGE_CACHE_HASH];
+static kmem_cache_t*       pc_cache;
+static uint32_t            pc_nr_pages;
+DEFINE_SPINLOCK(page_cache_lock);
+
+static void kmemcpy(void* d, const void* s, size_t n) {
+    uint8_t* dd = (uint8_t*)d; const uint8_t* ss = (const uint8_t*)s;
+    for (size_t i = 0; i < n; i++) dd[i] = ss[i];
+}
+static void kmemset(void* ptr, int val, size_t n) {
+    uint8_t* p = (uint8_t*)ptr;
+    for (size_t i = 0; i < n; i++) p[i] = (uint8_t)val;
+}
+
+static uint32_t pc_hashfn(vnode_t* v, uint32_t index) {
+    return (((uint32_t)v >> 4) ^ (index * 0x9E3779B1u)) % PAGE_CACHE_HASH;
+}
+
+static page_cache_entry_t* pc_find(vnode_t* v, uint32_t index) {
+    for (page_cache_entry_t* e = pc_hash[pc_hashfn(v, index)]; e; e = e->next)
+        if (e->vnode == v && e->index == index) return e;
+    return NULL;
+}
+
+void page_cache_init(void) {
+    pc_cache = kmem_cache_create("page_cache", sizeof(page_cache_entry_t), 16);
+}
+
+// ファイルの index ページ目を読み込んだ物理ページ (呼び出し側の参照つき)。失敗なら0。
+// 読み込みは眠るので、一旦カーネルヒープの作業領域に読んでから kmap して写す
+uint32_t page_cache_get(vnode_t* v, uint32_t index, int* major) {
+    uint32_t flags = spin_lock_irqsave(&page_cache_lock);
+    page_cache_entry_t* e = pc_find(v, index);
+    if (e) {
+        pmm_get(e->phys);
+        uint32_t phys = e->phys;
+        spin_unlock_irqrestore(&page_cache_lock, flags);
+        if (major) *major = 0;
+        return phys;
+    }
+    spin_unlock_irqrestore(&page_cache_lock, flags);
+    if (major) *major = 1;
+
+    uint8_t* buf = (uint8_t*)kmalloc(PAGE_SIZE);
+    uint32_t phys = (uint32_t)pmm_alloc();
+    page_cache_entry_t* ne = (page_cache_entry_t*)kmem_cache_alloc(pc_cache);
+    if (!buf || !phys || !ne) goto fail;
+
+    ssize_t n = v->ops->read(v, (off_t)(index * PAGE_SIZE), PAGE_SIZE, buf);
+    if (n < 0) goto fail;
+    kmemset(buf + n, 0, PAGE_SIZE - (uint32_t)n);
+    void* dst = kmap(phys);
+    kmemcpy(dst, buf, PAGE_SIZE);
+    kunmap(dst);
+    kfree(buf);
+
+    flags = spin_lock_irqsave(&page_cache_lock);
+    e = pc_find(v, index);
+    if (e) {
+        // 読んでいる間に他のプロセスが入れた
+        pmm_get(e->phys);
+        uint32_t ret = e->phys;
+        spin_unlock_irqrestore(&page_cache_lock, flags);
+        pmm_put(phys);
+        kmem_cache_free(pc_cache, ne);
+        return ret;
+    }
+    ne->vnode = v;
+    ne->index = index;
+    ne->phys  = phys;
+    uint32_t h = pc_hashfn(v, index);
+    ne->next  = pc_hash[h];
+    pc_hash[h] = ne;
+    pc_nr_pages++;
+    v->nrpages++;
+    pmm_get(phys);                  // 呼び出し側の分 (キャッシュの分は pmm_alloc の1)
+    spin_unlock_irqrestore(&page_cache_lock, flags);
+    return phys;
+
+fail:
+    if (buf) kfree(buf);
+    if (phys) pmm_put(phys);
+    if (ne) kmem_cache_free(pc_cache, ne);
+    return 0;
+}
+
+// ファイルが書き換えられた: キャッシュから外す。
+// すでにマップしているプロセスは古い内容のページを参照数で持ち続ける
+void page_cache_invalidate(vnode_t* v) {
+    if (!v->nrpages) return;
+    uint32_t flags = spin_lock_irqsave(&page_cache_lock);
+    for (int h = 0; h < PAGE_CACHE_HASH && v->nrpages; h++) {
+        page_cache_entry_t** pp = &pc_hash[h];
+        while (*pp) {
+            page_cache_entry_t* e = *pp;
+            if (e->vnode != v) { pp = &e->next; continue; }
+            *pp = e->next;
+            pmm_put(e->phys);
+            kmem_cache_free(pc_cache, e);
+            pc_nr_pages--;
+            v->nrpages--;
+        }
+    }
+    spin_unlock_irqrestore(&page_cache_lock, flags);
+}
+
+uint32_t page_cache_nr_pages(void) { return pc_nr_pages; }
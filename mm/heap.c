@@ -1,5 +1,7 @@
 // mm/heap.c - カーネルヒープ (free-list アロケータ)
 #include "../include/kernel/mm.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/cgroup.h"
 #include "../include/kernel/types.h"
 
 #define HEAP_START 0x01000000  // 16MB
@@ -9,6 +11,7 @@ typedef struct block_header {
     uint32_t            magic;
     size_t              size;
     int                 free;
+    int                 cg;       // 課金したグループの id (0 なら課金していない)
     struct block_header *next;
     struct block_header *prev;
 } block_header_t;
@@ -18,13 +21,17 @@ typedef struct block_header {
 static block_header_t* heap_head = NULL;
 static uint32_t heap_brk = HEAP_START;
 
+// 全 CPU から呼ばれ、ソフト割り込み (タイマー) からも確保するのでチケットロック + irqsave
+DEFINE_TICKETLOCK(heap_lock);
+
 extern page_directory_t* vmm_get_kernel_directory(void);
 
 static void heap_expand(size_t bytes) {
     page_directory_t* kd = vmm_get_kernel_directory();
     uint32_t needed = (bytes + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
     for (uint32_t off = 0; off < needed; off += PAGE_SIZE) {
-        void* phys = pmm_alloc();
+        // ヒープはブロック単位で課金するので、下のページは課金しない
+        void* phys = pmm_alloc_kernel();
         vmm_map(kd, heap_brk + off, (uint32_t)phys, PAGE_PRESENT | PAGE_WRITE);
     }
     heap_brk += needed;
@@ -36,6 +43,7 @@ void heap_init(void) {
     heap_head->magic = HEAP_MAGIC;
     heap_head->size  = PAGE_SIZE - sizeof(block_header_t);
     heap_head->free  = 1;
+    heap_head->cg    = 0;
     heap_head->next  = NULL;
     heap_head->prev  = NULL;
 }
@@ -53,9 +61,7 @@ static void coalesce(block_header_t* b) {
     }
 }
 
-void* kmalloc(size_t size) {
-    if (size == 0) return NULL;
-    size = (size + 7) & ~7; // 8バイトアライン
+static void* __kmalloc(size_t size) {
 
     block_header_t* cur = heap_head;
     while (cur) {
@@ -66,6 +72,7 @@ void* kmalloc(size_t size) {
                 split->magic = HEAP_MAGIC;
                 split->size  = cur->size - size - sizeof(block_header_t);
                 split->free  = 1;
+                split->cg    = 0;
                 split->next  = cur->next;
                 split->prev  = cur;
                 if (cur->next) cur->next->prev = split;
@@ -73,6 +80,7 @@ void* kmalloc(size_t size) {
                 cur->size    = size;
             }
             cur->free = 0;
+            cur->cg   = 0;
             return (void*)(cur + 1);
         }
         cur = cur->next;
@@ -87,6 +95,7 @@ void* kmalloc(size_t size) {
     newb->magic = HEAP_MAGIC;
     newb->size  = heap_brk - old_brk - sizeof(block_header_t);
     newb->free  = 1;
+    newb->cg    = 0;
     newb->next  = NULL;
     newb->prev  = NULL;
 
@@ -97,12 +106,35 @@ void* kmalloc(size_t size) {
     newb->prev = last;
     coalesce(newb);
 
-    return kmalloc(size);
+    return __kmalloc(size);
 }
 
+// charge なら今のタスクのグループにブロックの大きさを課金する。
+// 確保の失敗を想定していない呼び出し元が多いので、上限を超えても断らずに課金する
+// (超えた分は以後のページ確保と brk の伸長で断られる)
+static void* heap_alloc(size_t size, int charge) {
+    if (size == 0) return NULL;
+    size = (size + 7) & ~7; // 8バイトアライン
+    uint32_t flags = ticket_lock_irqsave(&heap_lock);
+    void* p = __kmalloc(size);
+    cgroup_t* cg = charge && p ? cgroup_charge_target() : NULL;
+    if (cg) {
+        block_header_t* hdr = (block_header_t*)p - 1;
+        hdr->cg = cg->id;
+        cgroup_charge(cg, CG_MEM_HEAP, hdr->size + sizeof(block_header_t), 1);
+    }
+    ticket_unlock_irqrestore(&heap_lock, flags);
+    return p;
+}
+
+void* kmalloc(size_t size) {
+    return heap_alloc(size, 1);
+}
+
+// slab の領域に使う (返さないので誰にも課金しない)
 void* kmalloc_aligned(size_t size, size_t align) {
     // シンプル実装: 余分に確保してアライン
-    void* ptr = kmalloc(size + align);
+    void* ptr = heap_alloc(size + align, 0);
     uint32_t addr = (uint32_t)ptr;
     addr = (addr + align - 1) & ~(align - 1);
     return (void*)addr;
@@ -112,8 +144,14 @@ void kfree(void* ptr) {
     if (!ptr) return;
     block_header_t* hdr = (block_header_t*)ptr - 1;
     if (hdr->magic != HEAP_MAGIC) return; // 二重解放防止
+    uint32_t flags = ticket_lock_irqsave(&heap_lock);
+    if (hdr->cg) {
+        cgroup_uncharge(hdr->cg, CG_MEM_HEAP, hdr->size + sizeof(block_header_t));
+        hdr->cg = 0;
+    }
     hdr->free = 1;
     coalesce(hdr);
+    ticket_unlock_irqrestore(&heap_lock, flags);
 }
 
 void* krealloc(void* ptr, size_t new_size) {
@@ -129,3 +167,11 @@ void* krealloc(void* ptr, size_t new_size) {
     kfree(ptr);
     return newp;
 }
+
+// 消すグループの課金を親に付け替える
+void heap_reparent(int from, int to) {
+    uint32_t flags = ticket_lock_irqsave(&heap_lock);
+    for (block_header_t* b = heap_head; b; b = b->next)
+        if (!b->free && b->cg == from) b->cg = to;
+    ticket_unlock_irqrestore(&heap_lock, flags);
+}
@@ -0,0 +1,78 @@
+// mm/kstack.c - ガードページ付きカーネルスタック
+// 専用の仮想領域をスロットに分け、各スロットの先頭1ページを未マップのまま残す。
+// スタックが溢れるとガードページでフォルトし、隣のスタックは壊れない。
+#include "../include/kernel/mm.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/types.h"
+
+#define KSTACK_SLOT_SIZE (KSTACK_SIZE + PAGE_SIZE)
+#define KSTACK_SLOTS     (KSTACK_REGION_SIZE / KSTACK_SLOT_SIZE)
+
+static uint32_t slot_bitmap[(KSTACK_SLOTS + 31) / 32];
+static uint32_t next_hint = 0;
+// スロットと、スタック領域のページテーブル (カーネルディレクトリ) の更新を守る
+DEFINE_SPINLOCK(kstack_lock);
+
+static int slot_used(uint32_t i) { return (slot_bitmap[i / 32] >> (i % 32)) & 1; }
+static void slot_set(uint32_t i)   { slot_bitmap[i / 32] |=  (1u << (i % 32)); }
+static void slot_clear(uint32_t i) { slot_bitmap[i / 32] &= ~(1u << (i % 32)); }
+
+static uint32_t slot_base(uint32_t i) {
+    return KSTACK_REGION_BASE + i * KSTACK_SLOT_SIZE;
+}
+
+// スタックの最上位アドレスを返す (失敗時0)
+uint32_t kstack_alloc(void) {
+    page_directory_t* kd = vmm_get_kernel_directory();
+    uint32_t top = 0;
+    uint32_t flags = spin_lock_irqsave(&kstack_lock);
+
+    for (uint32_t n = 0; n < KSTACK_SLOTS; n++) {
+        uint32_t i = (next_hint + n) % KSTACK_SLOTS;
+        if (slot_used(i)) continue;
+
+        // ガードページ (base) の上にスタック本体をマップ
+        uint32_t stack = slot_base(i) + PAGE_SIZE;
+        for (uint32_t off = 0; off < KSTACK_SIZE; off += PAGE_SIZE) {
+            void* phys = pmm_alloc();
+            if (!phys) {
+                while (off) {
+                    off -= PAGE_SIZE;
+                    pmm_free((void*)vmm_get_physical(kd, stack + off));
+                    vmm_unmap(kd, stack + off);
+                }
+                goto out;
+            }
+            vmm_map(kd, stack + off, (uint32_t)phys, PAGE_PRESENT | PAGE_WRITE);
+        }
+        slot_set(i);
+        next_hint = i + 1;
+        top = stack + KSTACK_SIZE;
+        break;
+    }
+out:
+    spin_unlock_irqrestore(&kstack_lock, flags);
+    return top;
+}
+
+void kstack_free(uint32_t top) {
+    if (!top) return;
+    page_directory_t* kd = vmm_get_kernel_directory();
+    uint32_t stack = top - KSTACK_SIZE;
+    uint32_t i = (stack - PAGE_SIZE - KSTACK_REGION_BASE) / KSTACK_SLOT_SIZE;
+
+    uint32_t flags = spin_lock_irqsave(&kstack_lock);
+    for (uint32_t off = 0; off < KSTACK_SIZE; off += PAGE_SIZE) {
+        pmm_free((void*)vmm_get_physical(kd, stack + off));
+        vmm_unmap(kd, stack + off);
+    }
+    slot_clear(i);
+    spin_unlock_irqrestore(&kstack_lock, flags);
+}
+
+// addr がいずれかのスタックのガードページ内か
+int kstack_is_guard(uint32_t addr) {
+    if (addr < KSTACK_REGION_BASE || addr >= KSTACK_REGION_BASE + KSTACK_REGION_SIZE)
+        return 0;
+    return (addr - KSTACK_REGION_BASE) % KSTACK_SLOT_SIZE < PAGE_SIZE;
+}
@@ -1,13 +1,20 @@
 // mm/pmm.c - 物理メモリ管理 (ビットマップ)
 #include "../include/kernel/mm.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/cgroup.h"
 #include "../include/kernel/types.h"
 
 #define MAX_MEM_MB  256
 #define BITMAP_LEN  (MAX_MEM_MB * 1024 * 1024 / PAGE_SIZE / 32)
 
 static uint32_t bitmap[BITMAP_LEN];
+// ページごとの参照数 (CoW やページキャッシュで複数のマップから指される)
+static uint16_t page_refs[MAX_MEM_MB * 1024 * 1024 / PAGE_SIZE];
+// ページを課金したグループの id (0 ならどこにも課金していない)
+static uint8_t  page_cg[MAX_MEM_MB * 1024 * 1024 / PAGE_SIZE];
 static uint32_t total_pages;
 static uint32_t used_pages;
+DEFINE_SPINLOCK(pmm_lock);
 
 static void set_bit(uint32_t page) {
     bitmap[page / 32] |= (1U << (page % 32));
@@ -39,21 +46,88 @@ void pmm_init(uint32_t mem_size, uint32_t kernel_end) {
     used_pages = start_page;
 }
 
-void* pmm_alloc(void) {
+// pmm_lock を持って呼ぶ。空いたページを返して課金を戻す
+static void page_release(uint32_t page) {
+    clear_bit(page);
+    page_refs[page] = 0;
+    used_pages--;
+    if (page_cg[page]) {
+        cgroup_uncharge(page_cg[page], CG_MEM_PAGE, PAGE_SIZE);
+        page_cg[page] = 0;
+    }
+}
+
+// 課金先のグループは pmm_lock の下で決める (rmdir の付け替えと入れ違わない)
+static void* alloc_page(int charge) {
+    void* ret = NULL;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    cgroup_t* cg = charge ? cgroup_charge_target() : NULL;
+    if (cg && cgroup_charge(cg, CG_MEM_PAGE, PAGE_SIZE, 0) < 0) {
+        spin_unlock_irqrestore(&pmm_lock, flags);
+        return NULL;
+    }
     for (uint32_t i = 0; i < total_pages; i++) {
         if (!test_bit(i)) {
             set_bit(i);
+            page_refs[i] = 1;
+            page_cg[i]   = cg ? (uint8_t)cg->id : 0;
             used_pages++;
-            return (void*)(i * PAGE_SIZE);
+            ret = (void*)(i * PAGE_SIZE);
+            break;
         }
     }
-    return NULL;
+    if (!ret && cg) cgroup_uncharge(cg->id, CG_MEM_PAGE, PAGE_SIZE);
+    spin_unlock_irqrestore(&pmm_lock, flags);
+    return ret;
+}
+
+void* pmm_alloc(void) {
+    return alloc_page(1);
+}
+
+void* pmm_alloc_kernel(void) {
+    return alloc_page(0);
 }
 
 void pmm_free(void* addr) {
     uint32_t page = (uint32_t)addr / PAGE_SIZE;
-    if (test_bit(page)) {
-        clear_bit(page);
-        used_pages--;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    if (test_bit(page)) page_release(page);
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+void pmm_get(uint32_t phys) {
+    uint32_t page = phys / PAGE_SIZE;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    page_refs[page]++;
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+void pmm_put(uint32_t phys) {
+    uint32_t page = phys / PAGE_SIZE;
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    if (page_refs[page] && --page_refs[page] == 0 && test_bit(page)) page_release(page);
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+// まとめて参照を落とす (アドレス空間の後始末用: ロックを1回で済ませる)
+void pmm_put_batch(const uint32_t* phys, int n) {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    for (int i = 0; i < n; i++) {
+        uint32_t page = phys[i] / PAGE_SIZE;
+        if (page_refs[page] && --page_refs[page] == 0 && test_bit(page)) page_release(page);
     }
+    spin_unlock_irqrestore(&pmm_lock, flags);
+}
+
+uint32_t pmm_refcount(uint32_t phys) {
+    return page_refs[phys / PAGE_SIZE];
+}
+
+// 消すグループの課金を親に付け替える
+void pmm_reparent(int from, int to) {
+    uint32_t flags = spin_lock_irqsave(&pmm_lock);
+    for (uint32_t i = 0; i < total_pages; i++)
+        if (page_cg[i] == from) page_cg[i] = (uint8_t)to;
+    spin_unlock_irqrestore(&pmm_lock, flags);
 }
@@ -0,0 +1,77 @@
+// mm/slab.c - 固定サイズオブジェクトキャッシュ
+#include "../include/kernel/mm.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/types.h"
+
+#define SLAB_MIN_OBJS 8
+
+typedef struct slab_free {
+    struct slab_free* next;
+} slab_free_t;
+
+struct kmem_cache {
+    spinlock_t   lock;
+    const char*  name;
+    size_t       size;       // アライン後のオブジェクトサイズ
+    size_t       align;
+    size_t       slab_size;  // 1回に確保する領域
+    slab_free_t* free_list;
+    uint32_t     nr_slabs;
+    uint32_t     nr_active;
+    uint32_t     nr_free;
+};
+
+static lock_class_t cache_lock_class = LOCK_CLASS_INIT("kmem_cache->lock");
+
+static void cache_grow(kmem_cache_t* c) {
+    uint8_t* mem = (uint8_t*)kmalloc_aligned(c->slab_size, c->align);
+    if (!mem) return;
+    size_t n = c->slab_size / c->size;
+    for (size_t i = 0; i < n; i++) {
+        slab_free_t* f = (slab_free_t*)(mem + i * c->size);
+        f->next = c->free_list;
+        c->free_list = f;
+    }
+    c->nr_slabs++;
+    c->nr_free += n;
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, size_t size, size_t align) {
+    kmem_cache_t* c = (kmem_cache_t*)kmalloc(sizeof(kmem_cache_t));
+    if (!c) return NULL;
+    if (align < sizeof(void*)) align = sizeof(void*);
+    if (size < sizeof(slab_free_t)) size = sizeof(slab_free_t);
+    spin_lock_init_class(&c->lock, &cache_lock_class);
+    c->name      = name;
+    c->align     = align;
+    c->size      = (size + align - 1) & ~(align - 1);
+    c->slab_size = PAGE_SIZE;
+    while (c->slab_size / c->size < SLAB_MIN_OBJS) c->slab_size += PAGE_SIZE;
+    c->free_list = NULL;
+    c->nr_slabs = c->nr_active = c->nr_free = 0;
+    return c;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* c) {
+    uint32_t flags = spin_lock_irqsave(&c->lock);
+    if (!c->free_list) cache_grow(c);
+    slab_free_t* f = c->free_list;
+    if (f) {
+        c->free_list = f->next;
+        c->nr_free--;
+        c->nr_active++;
+    }
+    spin_unlock_irqrestore(&c->lock, flags);
+    return f;
+}
+
+void kmem_cache_free(kmem_cache_t* c, void* obj) {
+    if (!obj) return;
+    slab_free_t* f = (slab_free_t*)obj;
+    uint32_t flags = spin_lock_irqsave(&c->lock);
+    f->next = c->free_list;
+    c->free_list = f;
+    c->nr_free++;
+    c->nr_active--;
+    spin_unlock_irqrestore(&c->lock, flags);
+}
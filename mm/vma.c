@@ -0,0 +1,332 @@
+// mm/vma.c - ユーザーアドレス空間 (VMA) とページフォルト処理
+// ページは触られたときに用意する:
+//   書き込まないファイルのページ … ページキャッシュの1枚をそのまま共有マップ
+//   書き込むファイルのページ     … キャッシュから写した自分用のページ
+//   無名 (bss・スタック・brk)    … ゼロ埋めしたページ
+#include "../include/kernel/vma.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/cgroup.h"
+#include "../include/kernel/smp.h"
+#include "../include/kernel/kthread.h"
+#include "../include/kernel/wait.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/types.h"
+
+static kmem_cache_t* mm_cache;
+static kmem_cache_t* vma_cache;
+static lock_class_t  mm_lock_class = LOCK_CLASS_INIT("mm->lock");
+
+#define PAGE_ALIGN(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
+
+static void kmemcpy(void* d, const void* s, size_t n) {
+    uint8_t* dd = (uint8_t*)d; const uint8_t* ss = (const uint8_t*)s;
+    for (size_t i = 0; i < n; i++) dd[i] = ss[i];
+}
+static void kmemset(void* ptr, int val, size_t n) {
+    uint8_t* p = (uint8_t*)ptr;
+    for (size_t i = 0; i < n; i++) p[i] = (uint8_t)val;
+}
+
+void vma_init(void) {
+    mm_cache  = kmem_cache_create("mm", sizeof(mm_t), 16);
+    vma_cache = kmem_cache_create("vm_area", sizeof(vm_area_t), 16);
+    page_cache_init();
+}
+
+static mm_t* mm_alloc(page_directory_t* pgd) {
+    if (!pgd) return NULL;
+    mm_t* mm = (mm_t*)kmem_cache_alloc(mm_cache);
+    if (!mm) {
+        vmm_destroy_directory(pgd);
+        return NULL;
+    }
+    kmemset(mm, 0, sizeof(mm_t));
+    mm->pgd   = pgd;
+    mm->users = 1;
+    mutex_init(&mm->lock, &mm_lock_class);
+    return mm;
+}
+
+mm_t* mm_create(void) {
+    return mm_alloc(vmm_create_directory());
+}
+
+static void vma_free(vm_area_t* v) {
+    if (v->file) v->file->ref_count--;
+    kmem_cache_free(vma_cache, v);
+}
+
+// 他のスレッドが別の CPU でこの mm を使っていれば、その CPU の TLB も捨てさせる。
+// 1スレッドのプロセスは自分の invlpg だけで済む
+static void mm_flush_tlb(mm_t* mm) {
+    if (mm->users > 1) smp_flush_tlb_others(mm->pgd);
+}
+
+void mm_get(mm_t* mm) {
+    asm volatile("lock; incl %0" : "+m"(mm->users) :: "memory");
+}
+
+// fork: VMA を写し、ページは CoW で共有する
+mm_t* mm_dup(mm_t* old) {
+    mutex_lock(&old->lock);
+    mm_t* mm = mm_alloc(vmm_clone(old->pgd));
+    // 親の書き込み可能なページを読み取り専用にした (他のスレッドにも見せる)
+    mm_flush_tlb(old);
+    if (!mm) {
+        mutex_unlock(&old->lock);
+        return NULL;
+    }
+    mm->start_brk = old->start_brk;
+    mm->brk       = old->brk;
+    vm_area_t** tail = &mm->mmap;
+    for (vm_area_t* v = old->mmap; v; v = v->next) {
+        vm_area_t* n = (vm_area_t*)kmem_cache_alloc(vma_cache);
+        if (!n) {
+            mutex_unlock(&old->lock);
+            mm_put(mm);
+            return NULL;
+        }
+        *n = *v;
+        n->next = NULL;
+        if (n->file) n->file->ref_count++;
+        *tail = n;
+        tail  = &n->next;
+    }
+    mutex_unlock(&old->lock);
+    return mm;
+}
+
+// ===== アドレス空間の後始末 =====
+// 最後の利用者が落とした mm は kreaper スレッドに渡す。大きなプロセスでも
+// exit / exec とそれを待つ親はページの数だけ待たされない。
+// kreaper は nice 19 で、ページテーブル数枚ずつ解放しては割り込める状態に戻る
+#define REAP_BATCH_TABLES 4
+
+static mm_t*             reap_list;
+static spinlock_t        reap_lock = SPINLOCK_INIT;
+static wait_queue_head_t reap_wait = WAIT_QUEUE_HEAD_INIT(reap_wait);
+static int               reaper_running;
+
+static void mm_free(mm_t* mm) {
+    vm_area_t* v = mm->mmap;
+    while (v) {
+        vm_area_t* next = v->next;
+        vma_free(v);
+        v = next;
+    }
+    int pde = KERNEL_SHARED_PDES;
+    while ((pde = vmm_free_user_tables(mm->pgd, pde, REAP_BATCH_TABLES)) != 0)
+        ;
+    vmm_destroy_directory(mm->pgd);
+    kmem_cache_free(mm_cache, mm);
+}
+
+static int reaper_fn(void* arg) {
+    (void)arg;
+    while (!kthread_should_stop()) {
+        wait_event(reap_wait, reap_list != NULL || kthread_should_stop());
+
+        uint32_t flags = spin_lock_irqsave(&reap_lock);
+        while (reap_list) {
+            mm_t* mm  = reap_list;
+            reap_list = mm->reap_next;
+            spin_unlock_irqrestore(&reap_lock, flags);
+            mm_free(mm);
+            flags = spin_lock_irqsave(&reap_lock);
+        }
+        spin_unlock_irqrestore(&reap_lock, flags);
+    }
+    return 0;
+}
+
+void mm_reaper_init(void) {
+    process_t* p = kthread_create(reaper_fn, NULL, "kreaper");
+    if (!p) return;
+    sched_set_nice(p, NICE_MAX);
+    reaper_running = 1;
+}
+
+// 最後の利用者が落としたらページ・ページテーブル・VMA を解放する (kreaper で)。
+// どの CPU もこの mm の CR3 を使っていないこと
+void mm_put(mm_t* mm) {
+    uint8_t left;
+    asm volatile("lock; decl %0; setnz %1" : "+m"(mm->users), "=qm"(left) :: "memory");
+    if (left) return;
+
+    if (!reaper_running) {
+        mm_free(mm);
+        return;
+    }
+    uint32_t flags = spin_lock_irqsave(&reap_lock);
+    mm->reap_next = reap_list;
+    reap_list     = mm;
+    spin_unlock_irqrestore(&reap_lock, flags);
+    wake_up(&reap_wait);
+}
+
+vm_area_t* mm_find_vma(mm_t* mm, uint32_t addr) {
+    for (vm_area_t* v = mm->mmap; v && v->start <= addr; v = v->next)
+        if (addr < v->end) return v;
+    return NULL;
+}
+
+// [start, end) を登録する (ページはまだ用意しない)。重なりは -EINVAL
+int mm_map(mm_t* mm, uint32_t start, uint32_t end, uint32_t flags,
+           vnode_t* file, uint32_t file_off, uint32_t file_end) {
+    if ((start | end | file_off) & (PAGE_SIZE - 1)) return -EINVAL;
+    if (start >= end || start < USER_SPACE_START || end > USER_SPACE_END) return -EINVAL;
+
+    vm_area_t** pp = &mm->mmap;
+    while (*pp && (*pp)->end <= start) pp = &(*pp)->next;
+    if (*pp && (*pp)->start < end) return -EINVAL;
+
+    vm_area_t* v = (vm_area_t*)kmem_cache_alloc(vma_cache);
+    if (!v) return -ENOMEM;
+    v->start    = start;
+    v->end      = end;
+    v->flags    = flags;
+    v->file     = file;
+    v->file_off = file_off;
+    v->file_end = file_end;
+    v->next     = *pp;
+    *pp = v;
+    if (file) file->ref_count++;
+    return 0;
+}
+
+// [start, end) に載っているページを外す
+static void zap_range(mm_t* mm, uint32_t start, uint32_t end) {
+    for (uint32_t va = start; va < end; va += PAGE_SIZE) {
+        uint32_t pte = vmm_get_pte(mm->pgd, va);
+        if (!(pte & PAGE_PRESENT)) continue;
+        vmm_unmap(mm->pgd, va);
+        mm_flush_tlb(mm);
+        pmm_put(pte & ~0xFFF);
+    }
+}
+
+// brk: ヒープ VMA (start_brk から始まる無名領域) を伸び縮みさせる。新しい brk を返す
+uint32_t mm_brk(mm_t* mm, uint32_t addr) {
+    mutex_lock(&mm->lock);
+    uint32_t ret = mm->brk;
+    if (addr < mm->start_brk) goto out;
+
+    uint32_t old_end = PAGE_ALIGN(mm->brk);
+    uint32_t new_end = PAGE_ALIGN(addr);
+    vm_area_t* heap = mm_find_vma(mm, mm->start_brk);
+
+    if (new_end > old_end) {
+        // 伸ばした分を今のグループの上限の残りと比べる (ページの課金はフォルトのとき)
+        if (cgroup_mem_check(cgroup_charge_target(), new_end - old_end) < 0) goto out;
+        if (!heap) {
+            if (mm_map(mm, mm->start_brk, new_end, VM_READ | VM_WRITE, NULL, 0, 0) < 0) goto out;
+        } else {
+            if (heap->next && heap->next->start < new_end) goto out;
+            heap->end = new_end;
+        }
+    } else if (new_end < old_end && heap) {
+        zap_range(mm, new_end, old_end);
+        heap->end = new_end;
+        if (heap->end == heap->start) {
+            vm_area_t** pp = &mm->mmap;
+            while (*pp != heap) pp = &(*pp)->next;
+            *pp = heap->next;
+            vma_free(heap);
+        }
+    }
+    mm->brk = ret = addr;
+out:
+    mutex_unlock(&mm->lock);
+    return ret;
+}
+
+// ===== ページフォルト =====
+static void copy_page(uint32_t dst_phys, uint32_t src_phys, uint32_t len) {
+    uint8_t* src = (uint8_t*)kmap(src_phys);
+    uint8_t* dst = (uint8_t*)kmap(dst_phys);
+    kmemcpy(dst, src, len);
+    kmemset(dst + len, 0, PAGE_SIZE - len);
+    kunmap(dst);
+    kunmap(src);
+}
+
+// 書き込みで CoW ページに当たった。共有しているのが自分だけなら書けるようにするだけ
+static int do_wp_page(mm_t* mm, uint32_t va, uint32_t pte) {
+    uint32_t old = pte & ~0xFFF;
+    if (pmm_refcount(old) == 1) {
+        vmm_map(mm->pgd, va, old, PAGE_USER | PAGE_WRITE);
+        return 0;
+    }
+    uint32_t phys = (uint32_t)pmm_alloc();
+    if (!phys) return -ENOMEM;
+    copy_page(phys, old, PAGE_SIZE);
+    vmm_map(mm->pgd, va, phys, PAGE_USER | PAGE_WRITE);
+    // 他のスレッドが古いページを読み続けないように
+    mm_flush_tlb(mm);
+    pmm_put(old);
+    return 0;
+}
+
+static int do_no_page(mm_t* mm, vm_area_t* vma, uint32_t va, int* major) {
+    uint32_t index = (vma->file_off + (va - vma->start)) / PAGE_SIZE;
+    int writable   = (vma->flags & VM_WRITE) != 0;
+
+    // 1ページまるごとファイルの中身で、書かないならキャッシュのページを共有する
+    if (vma->file && !writable && va + PAGE_SIZE <= vma->file_end) {
+        uint32_t phys = page_cache_get(vma->file, index, major);
+        if (!phys) return -ENOMEM;
+        vmm_map(mm->pgd, va, phys, PAGE_USER | PAGE_SHARED);
+        return 0;
+    }
+
+    uint32_t phys = (uint32_t)pmm_alloc();
+    if (!phys) return -ENOMEM;
+    if (vma->file && va < vma->file_end) {
+        // データ部分はキャッシュから写し、file_end より先 (bss の頭) はゼロにする
+        uint32_t len = vma->file_end - va;
+        if (len > PAGE_SIZE) len = PAGE_SIZE;
+        uint32_t cached = page_cache_get(vma->file, index, major);
+        if (!cached) {
+            pmm_put(phys);
+            return -ENOMEM;
+        }
+        copy_page(phys, cached, len);
+        pmm_put(cached);
+    } else {
+        void* p = kmap(phys);
+        kmemset(p, 0, PAGE_SIZE);
+        kunmap(p);
+    }
+    vmm_map(mm->pgd, va, phys, PAGE_USER | (writable ? PAGE_WRITE : 0));
+    return 0;
+}
+
+int vmm_handle_fault(uint32_t addr, uint32_t err) {
+    process_t* p = current_proc;
+    mm_t* mm = p ? p->mm : NULL;
+    if (!mm || addr < USER_SPACE_START || addr >= USER_SPACE_END) return -EFAULT;
+
+    int write = (err & 2) != 0;
+    int major = 0;
+    int ret   = -EFAULT;
+    uint32_t va = addr & ~(PAGE_SIZE - 1);
+
+    mutex_lock(&mm->lock);
+    vm_area_t* vma = mm_find_vma(mm, addr);
+    if (!vma || (write && !(vma->flags & VM_WRITE))) goto out;
+
+    uint32_t pte = vmm_get_pte(mm->pgd, va);
+    if (pte & PAGE_PRESENT) {
+        if (write && (pte & PAGE_COW))   ret = do_wp_page(mm, va, pte);
+        else if (!write || (pte & PAGE_WRITE)) ret = 0;   // 他のスレッドが先に直した
+    } else {
+        ret = do_no_page(mm, vma, va, &major);
+    }
+out:
+    mutex_unlock(&mm->lock);
+    if (ret == 0) {
+        if (major) p->maj_flt++;
+        else       p->min_flt++;
+    }
+    return ret;
+}
@@ -1,52 +1,116 @@
 // mm/vmm.c - 仮想メモリ管理 (ページング)
 #include "../include/kernel/mm.h"
+#include "../include/kernel/preempt.h"
+#include "../include/kernel/smp.h"
 #include "../include/kernel/types.h"
 
 // カーネル空間: 0xC0000000〜 (3GB以降)
 #define KERNEL_VIRT_BASE 0xC0000000
 
+// kmap 用の窓 (カーネルスタック領域の直前の 4MB)。CPU ごとに KMAP_SLOTS ページ
+#define KMAP_BASE    0xDFC00000
+#define KMAP_SLOTS   16
+#define KMAP_DIRECT  0x00400000   // ここまでは恒等マップ済みなので窓を使わない
+
 static page_directory_t* kernel_dir = NULL;
 static page_directory_t* current_dir = NULL;
+static page_table_t*     kmap_pt    = NULL;
+static int               kmap_depth[MAX_CPUS];
 
 static void memset32(void* dst, uint32_t val, size_t count) {
     uint32_t* d = (uint32_t*)dst;
     for (size_t i = 0; i < count; i++) d[i] = val;
 }
 
-void vmm_map(page_directory_t* pd, uint32_t virt, uint32_t phys, uint32_t flags) {
-    uint32_t pd_idx = virt >> 22;
-    uint32_t pt_idx = (virt >> 12) & 0x3FF;
+static inline void invlpg(uint32_t virt) {
+    asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+}
+
+// ===== kmap =====
+// ページテーブルやユーザーページは 4MB より上の物理メモリにもあるので、
+// 触るときはこの窓に一時的にマップする。入れ子は後に取ったものから返すこと
+void* kmap(uint32_t phys) {
+    if (phys < KMAP_DIRECT) return (void*)phys;
+    preempt_disable();
+    int cpu = smp_processor_id();
+    uint32_t idx  = (uint32_t)(cpu * KMAP_SLOTS + kmap_depth[cpu]++);
+    uint32_t virt = KMAP_BASE + idx * PAGE_SIZE;
+    kmap_pt->entries[idx] = (phys & ~0xFFF) | PAGE_PRESENT | PAGE_WRITE;
+    invlpg(virt);
+    return (void*)(virt + (phys & 0xFFF));
+}
+
+void kunmap(void* addr) {
+    uint32_t virt = (uint32_t)addr & ~0xFFF;
+    if (virt < KMAP_BASE || virt >= KMAP_BASE + 0x400000) return;
+    kmap_pt->entries[(virt - KMAP_BASE) / PAGE_SIZE] = 0;
+    invlpg(virt);
+    kmap_depth[smp_processor_id()]--;
+    preempt_enable();
+}
+
+static void zero_page(uint32_t phys) {
+    void* p = kmap(phys);
+    memset32(p, 0, 1024);
+    kunmap(p);
+}
 
-    page_table_t* pt;
-    if (!(pd->entries[pd_idx] & PAGE_PRESENT)) {
-        pt = (page_table_t*)pmm_alloc();
-        memset32(pt, 0, 1024);
-        pd->entries[pd_idx] = (uint32_t)pt | PAGE_PRESENT | PAGE_WRITE | (flags & PAGE_USER);
-    } else {
-        pt = (page_table_t*)(pd->entries[pd_idx] & ~0xFFF);
+// pd[virt] のページテーブル (物理アドレス)。無ければ create のとき作る
+static uint32_t pt_lookup(page_directory_t* pd, uint32_t virt, uint32_t flags, int create) {
+    page_t* dir = (page_t*)kmap((uint32_t)pd);
+    uint32_t pde = dir[virt >> 22];
+    uint32_t pt = 0;
+    if (pde & PAGE_PRESENT) {
+        pt = pde & ~0xFFF;
+    } else if (create) {
+        // カーネルのページテーブルは全ディレクトリで共有して返さないので課金しない
+        pt = (uint32_t)(pd == kernel_dir ? pmm_alloc_kernel() : pmm_alloc());
+        if (pt) {
+            zero_page(pt);
+            dir[virt >> 22] = pt | PAGE_PRESENT | PAGE_WRITE | (flags & PAGE_USER);
+        }
     }
+    kunmap(dir);
+    return pt;
+}
+
+void vmm_map(page_directory_t* pd, uint32_t virt, uint32_t phys, uint32_t flags) {
+    uint32_t pt_idx = (virt >> 12) & 0x3FF;
+    uint32_t pt_phys = pt_lookup(pd, virt, flags, 1);
+    if (!pt_phys) return;
 
+    page_table_t* pt = (page_table_t*)kmap(pt_phys);
     pt->entries[pt_idx] = (phys & ~0xFFF) | PAGE_PRESENT | flags;
+    kunmap(pt);
 
     // TLBフラッシュ
-    asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+    invlpg(virt);
 }
 
 void vmm_unmap(page_directory_t* pd, uint32_t virt) {
-    uint32_t pd_idx = virt >> 22;
     uint32_t pt_idx = (virt >> 12) & 0x3FF;
-    if (!(pd->entries[pd_idx] & PAGE_PRESENT)) return;
-    page_table_t* pt = (page_table_t*)(pd->entries[pd_idx] & ~0xFFF);
+    uint32_t pt_phys = pt_lookup(pd, virt, 0, 0);
+    if (!pt_phys) return;
+    page_table_t* pt = (page_table_t*)kmap(pt_phys);
     pt->entries[pt_idx] = 0;
-    asm volatile("invlpg (%0)" :: "r"(virt) : "memory");
+    kunmap(pt);
+    invlpg(virt);
+}
+
+// ページテーブルエントリそのもの (無ければ0)
+uint32_t vmm_get_pte(page_directory_t* pd, uint32_t virt) {
+    uint32_t pt_phys = pt_lookup(pd, virt, 0, 0);
+    if (!pt_phys) return 0;
+    page_table_t* pt = (page_table_t*)kmap(pt_phys);
+    uint32_t pte = pt->entries[(virt >> 12) & 0x3FF];
+    kunmap(pt);
+    return pte;
 }
 
 uint32_t vmm_get_physical(page_directory_t* pd, uint32_t virt) {
-    uint32_t pd_idx = virt >> 22;
-    uint32_t pt_idx = (virt >> 12) & 0x3FF;
-    if (!(pd->entries[pd_idx] & PAGE_PRESENT)) return 0;
-    page_table_t* pt = (page_table_t*)(pd->entries[pd_idx] & ~0xFFF);
-    return (pt->entries[pt_idx] & ~0xFFF) + (virt & 0xFFF);
+    uint32_t pte = vmm_get_pte(pd, virt);
+    if (!(pte & PAGE_PRESENT)) return 0;
+    return (pte & ~0xFFF) + (virt & 0xFFF);
 }
 
 void vmm_switch(page_directory_t* pd) {
@@ -54,6 +118,13 @@ void vmm_switch(page_directory_t* pd) {
     asm volatile("mov %0, %%cr3" :: "r"((uint32_t)pd) : "memory");
 }
 
+static page_table_t* alloc_kernel_pt(uint32_t addr) {
+    page_table_t* pt = (page_table_t*)pmm_alloc();
+    memset32(pt, 0, 1024);
+    kernel_dir->entries[addr >> 22] = (uint32_t)pt | PAGE_PRESENT | PAGE_WRITE;
+    return pt;
+}
+
 void vmm_init(void) {
     // カーネルページディレクトリ作成
     kernel_dir = (page_directory_t*)pmm_alloc();
@@ -64,6 +135,18 @@ void vmm_init(void) {
         vmm_map(kernel_dir, addr, addr, PAGE_PRESENT | PAGE_WRITE);
     }
 
+    // 下位 64MB (ヒープを含む) のページテーブルも先に作り、ユーザー用ディレクトリと共有する
+    for (int i = 1; i < KERNEL_SHARED_PDES; i++)
+        alloc_kernel_pt((uint32_t)i << 22);
+
+    // カーネルスタック領域のページテーブルを先に作っておく
+    // (上位1GBのPDEは全ディレクトリにコピーされるので後からのマップも共有される)
+    for (uint32_t addr = KSTACK_REGION_BASE;
+         addr < KSTACK_REGION_BASE + KSTACK_REGION_SIZE; addr += 0x400000) {
+        alloc_kernel_pt(addr);
+    }
+    kmap_pt = alloc_kernel_pt(KMAP_BASE);
+
     // ページングを有効化
     uint32_t cr0;
     asm volatile("mov %%cr3, %%eax\n" : : : "eax");
@@ -78,49 +161,115 @@ void vmm_init(void) {
 
 page_directory_t* vmm_create_directory(void) {
     page_directory_t* pd = (page_directory_t*)pmm_alloc();
-    memset32(pd, 0, 1024);
+    if (!pd) return NULL;
+    page_directory_t* d = (page_directory_t*)kmap((uint32_t)pd);
+    memset32(d, 0, 1024);
 
-    // カーネル空間をコピー (上位1GB)
+    // カーネル空間をコピー (下位 64MB と上位1GB)
+    for (int i = 0; i < KERNEL_SHARED_PDES; i++)
+        d->entries[i] = kernel_dir->entries[i];
     for (int i = 768; i < 1024; i++) {
-        pd->entries[i] = kernel_dir->entries[i];
+        d->entries[i] = kernel_dir->entries[i];
     }
+    kunmap(d);
     return pd;
 }
 
-// CoWクローン: ユーザー空間ページをread-onlyにしてCOWフラグ
+static page_directory_t* read_cr3(void) {
+    uint32_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    return (page_directory_t*)cr3;
+}
+
+// CoWクローン: ユーザー空間の書けるページをread-onlyにしてCOWフラグ。
+// どのページも親子で共有するので参照数を足す。
+// ページテーブルが確保できなければ、写した分を返して NULL (途中までの写しは返さない)
 page_directory_t* vmm_clone(page_directory_t* src) {
     page_directory_t* dst = vmm_create_directory();
+    if (!dst) return NULL;
 
-    for (int i = 0; i < 768; i++) { // ユーザー空間のみ
-        if (!(src->entries[i] & PAGE_PRESENT)) continue;
-        page_table_t* src_pt = (page_table_t*)(src->entries[i] & ~0xFFF);
-        page_table_t* dst_pt = (page_table_t*)pmm_alloc();
+    int failed = 0;
+    page_directory_t* s = (page_directory_t*)kmap((uint32_t)src);
+    page_directory_t* d = (page_directory_t*)kmap((uint32_t)dst);
+    for (int i = KERNEL_SHARED_PDES; i < 768; i++) { // ユーザー空間のみ
+        if (!(s->entries[i] & PAGE_PRESENT)) continue;
+        uint32_t dst_phys = (uint32_t)pmm_alloc();
+        if (!dst_phys) {
+            failed = 1;
+            break;
+        }
+        page_table_t* src_pt = (page_table_t*)kmap(s->entries[i] & ~0xFFF);
+        page_table_t* dst_pt = (page_table_t*)kmap(dst_phys);
         memset32(dst_pt, 0, 1024);
 
         for (int j = 0; j < 1024; j++) {
-            if (!(src_pt->entries[j] & PAGE_PRESENT)) continue;
-            // COW: 親子ともread-only + COWビット
-            src_pt->entries[j] &= ~PAGE_WRITE;
-            src_pt->entries[j] |= PAGE_COW;
-            dst_pt->entries[j]  = src_pt->entries[j];
+            uint32_t pte = src_pt->entries[j];
+            if (!(pte & PAGE_PRESENT)) continue;
+            // COW: 親子ともread-only + COWビット (キャッシュのページは元から書けない)
+            if (pte & (PAGE_WRITE | PAGE_COW)) {
+                pte = (pte & ~PAGE_WRITE) | PAGE_COW;
+                src_pt->entries[j] = pte;
+            }
+            dst_pt->entries[j] = pte;
+            pmm_get(pte & ~0xFFF);
         }
-        dst->entries[i] = (uint32_t)dst_pt | (src->entries[i] & 0xFFF);
+        kunmap(dst_pt);
+        kunmap(src_pt);
+        d->entries[i] = dst_phys | (s->entries[i] & 0xFFF);
+    }
+    kunmap(d);
+    kunmap(s);
+
+    // 親の書き込み許可を落としたので TLB を捨てる (失敗しても COW のままで正しい)
+    if (read_cr3() == src) vmm_switch(src);
+    if (failed) {
+        // 写したテーブルのページの参照を pmm_put_batch で落としてテーブルごと返す
+        vmm_destroy_directory(dst);
+        return NULL;
     }
     return dst;
 }
 
-void vmm_destroy_directory(page_directory_t* pd) {
-    for (int i = 0; i < 768; i++) {
-        if (!(pd->entries[i] & PAGE_PRESENT)) continue;
-        page_table_t* pt = (page_table_t*)(pd->entries[i] & ~0xFFF);
-        for (int j = 0; j < 1024; j++) {
-            if (pt->entries[j] & PAGE_PRESENT) {
-                pmm_free((void*)(pt->entries[j] & ~0xFFF));
-            }
+#define FREE_BATCH 64   // pmm のロックを1回取って落とすページ数
+
+// ページテーブル1枚分のページと、テーブル自身を解放する
+static void free_page_table(uint32_t pt_phys) {
+    uint32_t batch[FREE_BATCH];
+    int n = 0;
+    page_table_t* pt = (page_table_t*)kmap(pt_phys);
+    for (int j = 0; j < 1024; j++) {
+        if (!(pt->entries[j] & PAGE_PRESENT)) continue;
+        batch[n++] = pt->entries[j] & ~0xFFF;
+        if (n == FREE_BATCH) {
+            pmm_put_batch(batch, n);
+            n = 0;
         }
-        pmm_free(pt);
     }
+    kunmap(pt);
+    if (n) pmm_put_batch(batch, n);
+    pmm_free((void*)pt_phys);
+}
+
+// ユーザー部分のページテーブルを pde 番目から最大 max_tables 枚 (空のエントリは数えない)
+// 解放し、続きの pde を返す。全部済んだら0。呼ぶ間に割り込めるよう少しずつ進める
+int vmm_free_user_tables(page_directory_t* pd, int pde, int max_tables) {
+    page_directory_t* d = (page_directory_t*)kmap((uint32_t)pd);
+    int freed = 0;
+    for (; pde < 768 && freed < max_tables; pde++) {
+        if (!(d->entries[pde] & PAGE_PRESENT)) continue;
+        uint32_t pt_phys = d->entries[pde] & ~0xFFF;
+        d->entries[pde] = 0;
+        free_page_table(pt_phys);
+        freed++;
+    }
+    kunmap(d);
+    return pde < 768 ? pde : 0;
+}
+
+// どの CPU の CR3 にも載っていないこと
+void vmm_destroy_directory(page_directory_t* pd) {
+    vmm_free_user_tables(pd, KERNEL_SHARED_PDES, 768);
     pmm_free(pd);
 }
 
-page_directory_t* vmm_get_kernel_directory(void) { return kernel_dir; }
\ No newline at end of file
+page_directory_t* vmm_get_kernel_directory(void) { return kernel_dir; }
@@ -0,0 +1,31 @@
+// proc/kthread.c - カーネルスレッド (proc_create_kernel の上に引数と停止要求を足す)
+#include "../include/kernel/kthread.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/types.h"
+
+// proc_create_kernel の entry。関数と引数は記述子から取る
+static void kthread_entry(void) {
+    process_t* self = current_proc;
+    proc_exit(self->kthread_fn(self->kthread_arg));
+}
+
+process_t* kthread_create(kthread_fn_t fn, void* arg, const char* name) {
+    // 関数と引数を入れてから走らせる (先に別の CPU で走り出さないように)
+    process_t* p = proc_alloc_kernel(kthread_entry, name);
+    if (!p) return NULL;
+    p->flags      |= PF_KTHREAD;
+    p->kthread_fn  = fn;
+    p->kthread_arg = arg;
+    proc_start(p);
+    return p;
+}
+
+int kthread_should_stop(void) {
+    return (current_proc->flags & PF_KTHREAD_STOP) != 0;
+}
+
+// 停止を要求して起こす。スレッドは kthread_should_stop() を見て自分で戻る
+void kthread_stop(process_t* p) {
+    p->flags |= PF_KTHREAD_STOP;
+    proc_wakeup(p);
+}
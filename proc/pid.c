@@ -0,0 +1,91 @@
+// proc/pid.c - PID 割り当て (ビットマップ) と pid → プロセスのハッシュ
+#include "../include/kernel/proc.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/types.h"
+
+#define PID_HASH_BITS 8
+#define PID_HASH_SIZE (1 << PID_HASH_BITS)
+
+static uint32_t   pid_bitmap[PID_MAX / 32];
+static pid_t      last_pid = 0;         // 直前に割り当てた PID
+static process_t* pid_hash[PID_HASH_SIZE];
+DEFINE_SPINLOCK(pid_lock);        // ビットマップとハッシュ
+
+static int  pid_test(pid_t pid)  { return (pid_bitmap[pid / 32] >> (pid % 32)) & 1; }
+static void pid_set(pid_t pid)   { pid_bitmap[pid / 32] |=  (1u << (pid % 32)); }
+static void pid_clear(pid_t pid) { pid_bitmap[pid / 32] &= ~(1u << (pid % 32)); }
+
+static uint32_t pid_hashfn(pid_t pid) {
+    // 黄金比ハッシュ (連番の PID をバケットに散らす)
+    return ((uint32_t)pid * 0x9E3779B9u) >> (32 - PID_HASH_BITS);
+}
+
+// pid 0 は idle 専用
+void pid_init(void) {
+    pid_set(0);
+}
+
+// last_pid の次から空きを探す (解放直後の PID をすぐには再利用しない)
+// 空きが無ければ -EAGAIN
+pid_t pid_alloc(void) {
+    uint32_t flags = spin_lock_irqsave(&pid_lock);
+    pid_t pid = last_pid;
+    for (int n = 0; n < PID_MAX; n++) {
+        if (++pid >= PID_MAX) pid = 1;
+        // 32個まとめて埋まっているワードは飛ばす
+        if (pid % 32 == 0 && pid_bitmap[pid / 32] == 0xFFFFFFFF) {
+            pid += 31;
+            n   += 31;
+            continue;
+        }
+        if (!pid_test(pid)) {
+            pid_set(pid);
+            last_pid = pid;
+            spin_unlock_irqrestore(&pid_lock, flags);
+            return pid;
+        }
+    }
+    spin_unlock_irqrestore(&pid_lock, flags);
+    return -EAGAIN;
+}
+
+void pid_free(pid_t pid) {
+    if (pid <= 0 || pid >= PID_MAX) return;
+    uint32_t flags = spin_lock_irqsave(&pid_lock);
+    pid_clear(pid);
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
+
+void pid_hash_add(process_t* p) {
+    uint32_t h = pid_hashfn(p->pid);
+    uint32_t flags = spin_lock_irqsave(&pid_lock);
+    p->pid_next = pid_hash[h];
+    pid_hash[h] = p;
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
+
+void pid_hash_del(process_t* p) {
+    uint32_t flags = spin_lock_irqsave(&pid_lock);
+    process_t** pp = &pid_hash[pid_hashfn(p->pid)];
+    while (*pp) {
+        if (*pp == p) {
+            *pp = p->pid_next;
+            p->pid_next = NULL;
+            break;
+        }
+        pp = &(*pp)->pid_next;
+    }
+    spin_unlock_irqrestore(&pid_lock, flags);
+}
+
+// 返したプロセスの寿命は呼び出し側が tasklist_lock で守る
+process_t* pid_lookup(pid_t pid) {
+    if (pid < 0 || pid >= PID_MAX) return NULL;
+    process_t* ret = NULL;
+    uint32_t flags = spin_lock_irqsave(&pid_lock);
+    for (process_t* p = pid_hash[pid_hashfn(pid)]; p; p = p->pid_next) {
+        if (p->pid == pid) { ret = p; break; }
+    }
+    spin_unlock_irqrestore(&pid_lock, flags);
+    return ret;
+}
@@ -1,15 +1,38 @@
 // proc/proc.c - プロセス管理
 #include "../include/kernel/proc.h"
 #include "../include/kernel/mm.h"
+#include "../include/kernel/vma.h"
 #include "../include/kernel/gdt.h"
+#include "../include/kernel/timer.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/sched.h"
+#include "../include/kernel/cgroup.h"
+#include "../include/kernel/vdso.h"
+#include "../include/kernel/kthread.h"
+#include "../include/kernel/irqflags.h"
+#include "../include/kernel/spinlock.h"
 #include "../include/kernel/types.h"
 
-process_t  proc_table[MAX_PROCS];
-process_t* current_proc = NULL;
+#define PROC_TABLE_INIT 64
+
+// プロセス表: 記述子はキャッシュから確保し、表は必要に応じて伸ばす
+process_t** proc_table      = NULL;
+int         proc_table_size = 0;
+// 表・親子リストの書き換えは write、pid から引いたプロセスを使う間は read
+static lock_class_t tasklist_lock_class = LOCK_CLASS_INIT("tasklist_lock");
+rwlock_t tasklist_lock = RWLOCK_INIT_CLASS(tasklist_lock_class);
+static kmem_cache_t* proc_cache = NULL;
+static kmem_cache_t* cold_cache = NULL;   // proc_cold_t
+static kmem_cache_t* files_cache = NULL;  // files_struct_t
+static kmem_cache_t* fs_cache    = NULL;  // fs_struct_t
+static lock_class_t  files_lock_class = LOCK_CLASS_INIT("files->lock");
 uint32_t   ticks = 0;
+static uint32_t   total_forks  = 0;     // 起動から作ったタスク (tasklist_lock の write で数える)
+static process_t* child_reaper = NULL;  // 親が先に終わった子を引き取って回収する korphan スレッド
 
-extern void context_switch(uint32_t* old_esp, uint32_t new_esp);
 extern void switch_to_user(uint32_t entry, uint32_t user_stack);
+extern void task_entry_trampoline(void);
+extern void ret_from_fork(void);
 
 // カーネル文字列関数
 static void kstrcpy(char* dst, const char* src) {
@@ -28,205 +51,677 @@ static void kmemcpy(void* dst, const void* src, size_t n) {
     for (size_t i = 0; i < n; i++) d[i] = s[i];
 }
 
-static process_t* alloc_proc(void) {
-    for (int i = 0; i < MAX_PROCS; i++) {
-        if (proc_table[i].state == PROC_UNUSED) {
-            kmemset(&proc_table[i], 0, sizeof(process_t));
-            return &proc_table[i];
+// スリープ・ブロックのタイムアウト
+static void proc_timeout(void* data) {
+    process_t* p = (process_t*)data;
+    p->timed_out = 1;
+    proc_wakeup(p);
+}
+
+static int table_slot(void) {
+    for (int i = 0; i < proc_table_size; i++) {
+        if (!proc_table[i]) return i;
+    }
+    int new_size = proc_table_size ? proc_table_size * 2 : PROC_TABLE_INIT;
+    process_t** t = (process_t**)krealloc(proc_table, sizeof(process_t*) * new_size);
+    if (!t) return -1;
+    kmemset(&t[proc_table_size], 0, sizeof(process_t*) * (new_size - proc_table_size));
+    int slot = proc_table_size;
+    proc_table      = t;
+    proc_table_size = new_size;
+    return slot;
+}
+
+// ===== FD 表と作業ディレクトリ (CLONE_FILES / CLONE_FS で共有) =====
+static void ref_get(int* users) {
+    asm volatile("lock; incl %0" : "+m"(*users) :: "memory");
+}
+
+// 残りがあれば1
+static int ref_put(int* users) {
+    uint8_t left;
+    asm volatile("lock; decl %0; setnz %1" : "+m"(*users), "=qm"(left) :: "memory");
+    return left;
+}
+
+static files_struct_t* files_alloc(void) {
+    files_struct_t* f = (files_struct_t*)kmem_cache_alloc(files_cache);
+    if (!f) return NULL;
+    kmemset(f, 0, sizeof(files_struct_t));
+    f->users = 1;
+    spin_lock_init_class(&f->lock, &files_lock_class);
+    return f;
+}
+
+// 写し (fork)。開いているファイルはそれぞれ参照を足す
+static files_struct_t* files_dup(files_struct_t* old) {
+    files_struct_t* f = files_alloc();
+    if (!f) return NULL;
+    spin_lock(&old->lock);
+    for (int i = 0; i < MAX_FDS; i++) {
+        f->fds[i] = old->fds[i];
+        if (f->fds[i]) f->fds[i]->ref++;
+    }
+    spin_unlock(&old->lock);
+    return f;
+}
+
+static void files_put(files_struct_t* f) {
+    if (ref_put(&f->users)) return;
+    for (int i = 0; i < MAX_FDS; i++)
+        if (f->fds[i]) file_close(f->fds[i]);
+    kmem_cache_free(files_cache, f);
+}
+
+static fs_struct_t* fs_alloc(const char* cwd) {
+    fs_struct_t* fs = (fs_struct_t*)kmem_cache_alloc(fs_cache);
+    if (!fs) return NULL;
+    fs->users = 1;
+    kstrcpy(fs->cwd, cwd);
+    return fs;
+}
+
+static void fs_put(fs_struct_t* fs) {
+    if (!ref_put(&fs->users)) kmem_cache_free(fs_cache, fs);
+}
+
+// 表からは外してある (unlink_proc 済み) こと
+static void free_proc(process_t* p) {
+    cgroup_exit(p);
+    fpu_free(p);
+    kstack_free(p->kernel_stack_top);
+    if (p->cold) {
+        if (p->cold->files) files_put(p->cold->files);
+        if (p->cold->fs)    fs_put(p->cold->fs);
+        kmem_cache_free(cold_cache, p->cold);
+    }
+    kmem_cache_free(proc_cache, p);
+}
+
+// 今のタスクの FD 表を files に取り替える。
+// カーネルスレッド同士で CLONE_FILES と同じ共有をするのに使う (libc の gt_*)
+void proc_share_files(files_struct_t* files) {
+    proc_cold_t* cold = current_proc->cold;
+    ref_get(&files->users);
+    files_struct_t* old = cold->files;
+    cold->files = files;
+    if (old) files_put(old);
+}
+
+void proc_pin(process_t* p) {
+    ref_get(&p->usage);
+}
+
+// 最後の参照なら解放する (表からは外れていること)
+void proc_unpin(process_t* p) {
+    if (!ref_put(&p->usage)) free_proc(p);
+}
+
+// with_stack=0 は idle 用 (ブートスタックをそのまま使う)
+static process_t* alloc_proc(int with_stack) {
+    process_t* p = (process_t*)kmem_cache_alloc(proc_cache);
+    if (!p) return NULL;
+    kmemset(p, 0, sizeof(process_t));
+    cgroup_fork(p);
+    p->cold = (proc_cold_t*)kmem_cache_alloc(cold_cache);
+    if (!p->cold) {
+        free_proc(p);
+        return NULL;
+    }
+    kmemset(p->cold, 0, sizeof(proc_cold_t));
+    p->cold->files = files_alloc();
+    p->cold->fs    = fs_alloc("/");
+    if (!p->cold->files || !p->cold->fs) {
+        free_proc(p);
+        return NULL;
+    }
+
+    if (with_stack) {
+        p->pid = pid_alloc();
+        if (p->pid < 0) {
+            free_proc(p);
+            return NULL;
         }
+        p->kernel_stack_top = kstack_alloc();
+        if (!p->kernel_stack_top) {
+            pid_free(p->pid);
+            free_proc(p);
+            return NULL;
+        }
+    }
+    list_init(&p->children);
+    list_init(&p->sibling);
+    init_waitqueue_head(&p->wait_chldexit);
+    timer_setup(&p->timer, proc_timeout, p);
+    ipc_task_init(p);
+    p->usage = 1;
+
+    write_lock(&tasklist_lock);
+    int slot = table_slot();
+    if (slot >= 0) proc_table[slot] = p;
+    write_unlock(&tasklist_lock);
+    if (slot < 0) {
+        if (with_stack) pid_free(p->pid);
+        free_proc(p);
+        return NULL;
     }
-    return NULL;
+    p->slot = slot;
+    return p;
+}
+
+// 親の子リストにつないで pid で引けるようにする
+static void link_proc(process_t* p, process_t* parent) {
+    write_lock(&tasklist_lock);
+    total_forks++;
+    p->parent = parent;
+    p->ppid   = parent ? parent->pid : 0;
+    if (parent) list_add_tail(&p->sibling, &parent->children);
+    pid_hash_add(p);
+    write_unlock(&tasklist_lock);
+}
+
+uint32_t proc_total_forks(void) { return total_forks; }
+
+// tasklist_lock を write で持って呼ぶ
+static void unlink_proc(process_t* p) {
+    list_del(&p->sibling);
+    pid_hash_del(p);
+    pid_free(p->pid);
+    proc_table[p->slot] = NULL;
 }
 
+
+
 void proc_init(void) {
-    kmemset(proc_table, 0, sizeof(proc_table));
+    proc_cache = kmem_cache_create("process", sizeof(process_t), CACHE_LINE);
+    cold_cache = kmem_cache_create("proc_cold", sizeof(proc_cold_t), 16);
+    files_cache = kmem_cache_create("files", sizeof(files_struct_t), 16);
+    fs_cache    = kmem_cache_create("fs", sizeof(fs_struct_t), 16);
+    pid_init();
 
     // idle/init プロセス (pid=0, カーネル)
-    process_t* idle = &proc_table[0];
+    process_t* idle = alloc_proc(0);
     idle->pid   = 0;
     idle->ppid  = 0;
     idle->state = PROC_RUNNING;
     idle->page_dir = vmm_get_kernel_directory();
     kstrcpy(idle->name, "idle");
-    kstrcpy(idle->cwd, "/");
+    link_proc(idle, NULL);
 
     current_proc = idle;
+    sched_init(idle);
 }
 
-process_t* proc_create_kernel(void (*entry)(void), const char* name) {
-    process_t* p = alloc_proc();
+// AP の idle (pid 0、pid ハッシュには入れない)。スタックは AP 起動時に使う
+process_t* proc_create_idle(int cpu) {
+    process_t* p = alloc_proc(0);
+    if (!p) return NULL;
+    p->kernel_stack_top = kstack_alloc();
+    if (!p->kernel_stack_top) {
+        write_lock(&tasklist_lock);
+        unlink_proc(p);
+        write_unlock(&tasklist_lock);
+        free_proc(p);
+        return NULL;
+    }
+    p->state    = PROC_RUNNING;
+    p->page_dir = vmm_get_kernel_directory();
+    kstrcpy(p->name, "idle/");
+    p->name[5] = (char)('0' + cpu);
+    p->name[6] = 0;
+    return p;
+}
+
+// カーネルタスクの entry から戻ってきたら終了する
+static void proc_task_exit(void) {
+    proc_exit(0);
+}
+
+// 作るだけで実行キューには入れない (proc_start で走らせる)
+process_t* proc_alloc_kernel(void (*entry)(void), const char* name) {
+    process_t* p = alloc_proc(1);
     if (!p) return NULL;
 
-    static pid_t next_pid = 1;
-    p->pid   = next_pid++;
-    p->ppid  = current_proc ? current_proc->pid : 0;
-    p->state = PROC_READY;
+    link_proc(p, current_proc);
     p->page_dir = vmm_get_kernel_directory();
     kstrcpy(p->name, name);
-    kstrcpy(p->cwd, "/");
 
     // カーネルスタックの初期化
-    uint32_t stack_top = (uint32_t)&p->kernel_stack[8192];
-    // 戻りアドレスとしてentryを積む
-    stack_top -= 4;
-    *(uint32_t*)stack_top = (uint32_t)entry;
+    // context_switch → task_entry_trampoline (sti) → entry → proc_task_exit
+    uint32_t* sp = (uint32_t*)p->kernel_stack_top;
+    *--sp = (uint32_t)proc_task_exit;
+    *--sp = (uint32_t)entry;
+    *--sp = (uint32_t)task_entry_trampoline;
     // context_switchでpopするレジスタ (edi,esi,ebx,ebp)
-    stack_top -= 16;
-    kmemset((void*)stack_top, 0, 16);
-    p->esp = stack_top;
-    p->kernel_stack_top = (uint32_t)&p->kernel_stack[8192];
-
+    sp -= 4;
+    kmemset(sp, 0, 16);
+    p->esp = (uint32_t)sp;
     return p;
 }
 
-// スケジューラ (Round-Robin)
-void scheduler_tick(void) {
-    ticks++;
-
-    // スリープ解除チェック
-    for (int i = 0; i < MAX_PROCS; i++) {
-        if (proc_table[i].state == PROC_SLEEPING && ticks >= proc_table[i].sleep_until) {
-            proc_table[i].state = PROC_READY;
-        }
-    }
-
-    // 次のREADYプロセスを探す
-    int cur_idx = current_proc - proc_table;
-    int next_idx = -1;
-
-    for (int i = 1; i <= MAX_PROCS; i++) {
-        int idx = (cur_idx + i) % MAX_PROCS;
-        if (proc_table[idx].state == PROC_READY) {
-            next_idx = idx;
-            break;
-        }
-    }
-
-    if (next_idx < 0 || &proc_table[next_idx] == current_proc) return;
-
-    process_t* prev = current_proc;
-    process_t* next = &proc_table[next_idx];
+void proc_start(process_t* p) {
+    sched_fork(p);
+}
 
-    if (prev->state == PROC_RUNNING) prev->state = PROC_READY;
-    next->state = PROC_RUNNING;
-    current_proc = next;
+process_t* proc_create_kernel(void (*entry)(void), const char* name) {
+    process_t* p = proc_alloc_kernel(entry, name);
+    if (p) proc_start(p);
+    return p;
+}
 
-    // TSS のカーネルスタック更新
-    gdt_set_kernel_stack(next->kernel_stack_top);
+void proc_yield(void) {
+    sched_yield_current();
+}
 
-    // アドレス空間切り替え
-    vmm_switch(next->page_dir);
+// BLOCKED/SLEEPING のプロセスを起こす
+void proc_wakeup(process_t* p) {
+    if (p->state != PROC_BLOCKED && p->state != PROC_SLEEPING) return;
+    timer_cancel(&p->timer);
+    sched_wakeup(p);
+}
 
-    // コンテキストスイッチ
-    context_switch(&prev->esp, next->esp);
+// 呼び出し側で state を設定済みのプロセスを切り替える (timeout_ticks=0 なら無期限)
+// 設定後に起こされていれば schedule() はすぐ戻る。タイムアウトで起きたら1を返す
+int proc_schedule_timeout(uint32_t timeout_ticks) {
+    uint32_t flags = local_irq_save();
+    current_proc->timed_out = 0;
+    if (timeout_ticks)
+        timer_add(&current_proc->timer, ticks + timeout_ticks);
+    schedule();
+    timer_cancel(&current_proc->timer);
+    local_irq_restore(flags);
+    return current_proc->timed_out;
 }
 
-void proc_yield(void) {
-    if (current_proc->state == PROC_RUNNING)
-        current_proc->state = PROC_READY;
-    scheduler_tick();
+// 現在のプロセスを state で眠らせる
+int proc_block_timeout(proc_state_t state, uint32_t timeout_ticks) {
+    // 状態設定から切り替えまでの間に起こされないよう割り込み禁止
+    uint32_t flags = local_irq_save();
+    current_proc->state = state;
+    int ret = proc_schedule_timeout(timeout_ticks);
+    local_irq_restore(flags);
+    return ret;
 }
 
 void proc_sleep(uint32_t ms) {
-    // PIT 100Hz → 1tick=10ms
-    current_proc->sleep_until = ticks + (ms / 10 + 1);
-    current_proc->state = PROC_SLEEPING;
-    proc_yield();
+    // 次の tick 境界までの端数があるので1tick足す
+    proc_block_timeout(PROC_SLEEPING, ms_to_ticks(ms) + 1);
 }
 
 process_t* proc_get(pid_t pid) {
-    for (int i = 0; i < MAX_PROCS; i++) {
-        if (proc_table[i].pid == pid && proc_table[i].state != PROC_UNUSED)
-            return &proc_table[i];
-    }
-    return NULL;
+    process_t* p = pid_lookup(pid);
+    if (p && p->state == PROC_UNUSED) return NULL;
+    return p;
+}
+
+// 資源使用量は子に引き継がない
+static void acct_reset(process_t* p) {
+    p->utick = p->stick = 0;
+    p->nvcsw = p->nivcsw = 0;
+    p->min_flt = p->maj_flt = 0;
+    p->rchar = p->wchar = 0;
+    kmemset(&p->cacct, 0, sizeof(p->cacct));
 }
 
-process_t* proc_fork(void) {
-    process_t* child = alloc_proc();
+// fork / clone。r はユーザーモードから入ったシステムコールのフレームで、
+// 子はその写しから eax=0 で ret_from_fork → iret してユーザーに戻る。
+// flags の CLONE_VM / CLONE_FILES / CLONE_FS で指定した資源は写さずに共有する。
+// child_stack が0でなければ子のユーザースタックにする
+process_t* proc_clone(uint32_t flags, regs_t* r, uint32_t child_stack, uint64_t tls_desc) {
+    process_t* parent = current_proc;
+    if ((r->cs & 3) != 3) return NULL;
+    if ((flags & CLONE_VM) && !parent->mm) return NULL;
+
+    process_t* child = alloc_proc(1);
     if (!child) return NULL;
 
-    static pid_t next_pid = 100;
-    // 親をコピー
-    kmemcpy(child, current_proc, sizeof(process_t));
-    child->pid   = next_pid++;
-    child->ppid  = current_proc->pid;
-    child->state = PROC_READY;
-
-    // アドレス空間クローン (CoW)
-    child->page_dir = vmm_clone(current_proc->page_dir);
-
-    // カーネルスタック再初期化 (forkから戻るようにセットアップ)
-    uint32_t stack_top = (uint32_t)&child->kernel_stack[8192];
-    // fork_returnというラベルから再開させる
-    // 実際はesp保存点からコピーして子はeax=0で返す
-    uint32_t stack_offset = current_proc->kernel_stack_top - current_proc->esp;
-    stack_top -= stack_offset;
-    kmemcpy((void*)stack_top,
-            (void*)current_proc->esp,
-            stack_offset);
-    child->esp = stack_top;
-    child->kernel_stack_top = (uint32_t)&child->kernel_stack[8192];
+    // 親をコピー (表の位置・PID・スタック・cold 領域は子のもの)
+    int          slot      = child->slot;
+    pid_t        pid       = child->pid;
+    uint32_t     stack_top = child->kernel_stack_top;
+    proc_cold_t* cold      = child->cold;
+    struct cgroup* cg      = child->cgroup;
+    kmemcpy(child, parent, sizeof(process_t));
+    child->slot             = slot;
+    child->pid              = pid;
+    child->kernel_stack_top = stack_top;
+    child->cold             = cold;
+    child->cgroup           = cg;
+    child->cg_runnable      = 0;
+    child->fpu              = NULL;
+    cold->sig_mask = parent->cold->sig_mask;
+    kmemcpy(cold->sig_handlers, parent->cold->sig_handlers, sizeof(cold->sig_handlers));
+    acct_reset(child);
+    list_init(&child->children);
+    list_init(&child->sibling);
+    init_waitqueue_head(&child->wait_chldexit);
+    timer_setup(&child->timer, proc_timeout, child);
+    ipc_task_init(child);
+    child->usage = 1;
+    if (flags & CLONE_SETTLS) child->tls_desc = tls_desc;
+    int err = 0;
+
+    // FD 表・作業ディレクトリ: 共有なら参照を足し、そうでなければ写す
+    files_struct_t* files = parent->cold->files;
+    if (flags & CLONE_FILES) ref_get(&files->users);
+    else if (!(files = files_dup(files))) err = 1;
+    if (files) {
+        files_put(cold->files);
+        cold->files = files;
+    }
+    if (flags & CLONE_FS) {
+        fs_put(cold->fs);
+        cold->fs = parent->cold->fs;
+        ref_get(&cold->fs->users);
+    } else {
+        kstrcpy(cold->fs->cwd, parent->cold->fs->cwd);
+    }
 
+    // アドレス空間: CLONE_VM なら同じ mm、そうでなければ CoW で写す
+    child->mm       = NULL;
+    child->page_dir = vmm_get_kernel_directory();
+    if (flags & CLONE_VM) {
+        mm_get(parent->mm);
+        child->mm = parent->mm;
+    } else if (parent->mm) {
+        child->mm = mm_dup(parent->mm);
+        // vDSO のプロセスのページは親のものを共有しているので自分の pid のものにする
+        if (child->mm && vdso_mm_setup(child->mm, child->pid) < 0) err = 1;
+    }
+    if (child->mm) child->page_dir = child->mm->pgd;
+    if (parent->mm && !child->mm) err = 1;
+    if (fpu_fork(child, parent) < 0) err = 1;
+
+    if (err) {
+        // まだ pid ハッシュにも親の子リストにもつないでいない
+        if (child->mm) mm_put(child->mm);
+        write_lock(&tasklist_lock);
+        proc_table[child->slot] = NULL;
+        pid_free(child->pid);
+        write_unlock(&tasklist_lock);
+        free_proc(child);
+        return NULL;
+    }
+    link_proc(child, parent);
+    // pid がスレッドごとになったので、vDSO の pid はもう使わせない
+    if (flags & CLONE_VM) vdso_mm_shared(child->mm);
+
+    // カーネルスタック: 一番上にユーザーフレームの写し、その下に context_switch が
+    // pop するレジスタと戻り先 (ret_from_fork) を積む
+    regs_t* cr = (regs_t*)(stack_top - sizeof(regs_t));
+    kmemcpy(cr, r, sizeof(regs_t));
+    cr->eax = 0;
+    if (child_stack) cr->useresp = child_stack;
+    uint32_t* sp = (uint32_t*)cr;
+    *--sp = (uint32_t)ret_from_fork;
+    sp -= 4;
+    kmemset(sp, 0, 16);
+    child->esp = (uint32_t)sp;
+
+    sched_fork(child);
     return child;
 }
 
+// ユーザーアドレス空間・FD 表・作業ディレクトリを手放す (カーネルのディレクトリに戻ってから)
+static void exit_mm_files(process_t* p) {
+    if (p->mm) {
+        mm_t* mm = p->mm;
+        p->page_dir = vmm_get_kernel_directory();
+        vmm_switch(p->page_dir);
+        p->mm = NULL;
+        mm_put(mm);
+    }
+    // 共有している相手がいれば参照を落とすだけ
+    files_struct_t* files = p->cold->files;
+    fs_struct_t*    fs    = p->cold->fs;
+    p->cold->files = NULL;
+    p->cold->fs    = NULL;
+    if (files) files_put(files);
+    if (fs)    fs_put(fs);
+}
+
 void proc_exit(int code) {
+    ipc_exit(current_proc);
+    exit_mm_files(current_proc);
+    local_irq_disable();
     current_proc->state     = PROC_ZOMBIE;
     current_proc->exit_code = code;
-
-    // 親を起こす
-    process_t* parent = proc_get(current_proc->ppid);
-    if (parent && parent->state == PROC_BLOCKED) {
-        parent->state = PROC_READY;
+    sched_exit(current_proc);
+    fpu_exit(current_proc);
+
+    // 子は korphan に引き取らせる (起動前は idle)。親は回収されないよう押さえてから起こす
+    write_lock(&tasklist_lock);
+    process_t* reaper = child_reaper ? child_reaper : proc_table[0];
+    int moved = 0;
+    list_head_t *pos, *n;
+    list_for_each_safe(pos, n, &current_proc->children) {
+        process_t* c = list_entry(pos, process_t, sibling);
+        list_del(&c->sibling);
+        c->parent = reaper;
+        c->ppid   = reaper->pid;
+        list_add_tail(&c->sibling, &reaper->children);
+        moved = 1;
     }
-
-    // アドレス空間解放
-    if (current_proc->page_dir != vmm_get_kernel_directory()) {
-        vmm_destroy_directory(current_proc->page_dir);
-        current_proc->page_dir = vmm_get_kernel_directory();
+    process_t* parent = current_proc->parent;
+    if (parent) proc_pin(parent);
+    write_unlock(&tasklist_lock);
+
+    // 引き取らせた子にもうゾンビがいるかもしれない
+    if (moved) wake_up_all(&reaper->wait_chldexit);
+    // wait 中の親を起こす
+    if (parent) {
+        wake_up_all(&parent->wait_chldexit);
+        proc_unpin(parent);
     }
 
-    // FDクローズ
-    // (VFS側でやるが、ここではスキップ)
-
-    proc_yield();
+    schedule();
     // ここには戻らない
     while(1) asm volatile("hlt");
 }
 
 pid_t proc_wait(pid_t pid, int* status) {
-    while (1) {
-        for (int i = 0; i < MAX_PROCS; i++) {
-            process_t* p = &proc_table[i];
-            if (p->state != PROC_ZOMBIE) continue;
-            if (p->ppid != current_proc->pid) continue;
-            if (pid != -1 && p->pid != pid) continue;
-
-            pid_t ret = p->pid;
-            if (status) *status = p->exit_code;
-            p->state = PROC_UNUSED;
-            return ret;
-        }
-        // 子がいないなら-1
-        int has_child = 0;
-        for (int i = 0; i < MAX_PROCS; i++) {
-            if (proc_table[i].ppid == current_proc->pid &&
-                proc_table[i].state != PROC_UNUSED) {
-                has_child = 1; break;
-            }
+    return proc_wait_timeout(pid, status, 0);
+}
+
+// 終了済みの子を1つ回収する
+// 回収したら pid、待てる子がいなければ -ECHILD、まだ走っていれば0
+// 回収した子 (と子がすでに回収した孫) の使用量を親に足す
+static void acct_add_child(process_t* parent, process_t* child) {
+    proc_acct_t a;
+    proc_acct_get(child, &a);
+    proc_acct_t* c = &parent->cacct;
+    c->utime   += a.utime   + child->cacct.utime;
+    c->stime   += a.stime   + child->cacct.stime;
+    c->nvcsw   += a.nvcsw   + child->cacct.nvcsw;
+    c->nivcsw  += a.nivcsw  + child->cacct.nivcsw;
+    c->min_flt += a.min_flt + child->cacct.min_flt;
+    c->maj_flt += a.maj_flt + child->cacct.maj_flt;
+    c->rchar   += a.rchar   + child->cacct.rchar;
+    c->wchar   += a.wchar   + child->cacct.wchar;
+}
+
+static pid_t reap_child(pid_t pid, int* status) {
+    int has_child;
+    process_t* dead;
+    process_t* busy;
+again:
+    has_child = 0;
+    dead = busy = NULL;
+    list_head_t* pos;
+    write_lock(&tasklist_lock);
+    list_for_each(pos, &current_proc->children) {
+        process_t* p = list_entry(pos, process_t, sibling);
+        if (pid != -1 && p->pid != pid) continue;
+        has_child = 1;
+        if (p->state != PROC_ZOMBIE) continue;
+        // 別の CPU でまだ自分のスタックの上にいる。その子は proc_exit で tasklist_lock を
+        // 待っていることがあるので、ロックを離してから切り替え完了を待つ
+        if (p->on_cpu) {
+            proc_pin(p);
+            busy = p;
+            break;
         }
-        if (!has_child) return -1;
 
-        current_proc->state = PROC_BLOCKED;
-        proc_yield();
+        if (status) *status = p->exit_code;
+        acct_add_child(current_proc, p);
+        unlink_proc(p);
+        dead = p;
+        break;
+    }
+    write_unlock(&tasklist_lock);
+
+    if (busy) {
+        while (busy->on_cpu) asm volatile("pause");
+        proc_unpin(busy);
+        goto again;
+    }
+
+    if (dead) {
+        pid_t ret = dead->pid;
+        proc_unpin(dead);
+        return ret;
     }
+    return has_child ? 0 : -ECHILD;
+}
+
+// 親が先に終わった子を引き取り、終わったものから回収し続ける (Unix の init の役)。
+// 子が1つもいない間は、proc_exit が子を移して起こすまで眠る
+static int child_reaper_fn(void* arg) {
+    (void)arg;
+    while (!kthread_should_stop())
+        wait_event(current_proc->wait_chldexit,
+                   reap_child(-1, NULL) > 0 || kthread_should_stop());
+    return 0;
+}
+
+void proc_reaper_init(void) {
+    child_reaper = kthread_create(child_reaper_fn, NULL, "korphan");
+}
+
+// ms=0 なら無期限に待つ。タイムアウトしたら -ETIMEDOUT
+// 子の proc_exit が wait_chldexit を起こすまで眠る
+pid_t proc_wait_timeout(pid_t pid, int* status, uint32_t ms) {
+    pid_t ret = 0;
+    if (!wait_event_timeout(current_proc->wait_chldexit,
+                            (ret = reap_child(pid, status)) != 0, ms_to_ticks(ms)))
+        return -ETIMEDOUT;
+    // 待てる子がいないなら-1
+    return ret < 0 ? -1 : ret;
+}
+
+// 待たずに回収だけ試す: 回収したら pid、まだ走っていれば0、待てる子がいなければ-1
+pid_t proc_wait_nohang(pid_t pid, int* status) {
+    pid_t ret = reap_child(pid, status);
+    return ret < 0 ? -1 : ret;
 }
 
+// pid で引いたプロセスは tasklist_lock (read) を持つ間だけ使う (回収されない)
 void proc_kill(pid_t pid, int sig) {
+    read_lock(&tasklist_lock);
     process_t* p = proc_get(pid);
-    if (!p) return;
-    p->pending_sigs |= (1u << sig);
-    if (p->state == PROC_BLOCKED || p->state == PROC_SLEEPING)
-        p->state = PROC_READY;
+    if (p) {
+        p->pending_sigs |= (1u << sig);
+        proc_wakeup(p);
+    }
+    read_unlock(&tasklist_lock);
+}
+
+int proc_getnice(pid_t pid) {
+    read_lock(&tasklist_lock);
+    process_t* p = pid ? proc_get(pid) : current_proc;
+    int ret = p ? p->nice : -ESRCH;
+    read_unlock(&tasklist_lock);
+    return ret;
+}
+
+int proc_setnice(pid_t pid, int nice) {
+    read_lock(&tasklist_lock);
+    process_t* p = pid ? proc_get(pid) : current_proc;
+    if (p) sched_set_nice(p, nice);
+    read_unlock(&tasklist_lock);
+    return p ? 0 : -ESRCH;
+}
+
+int proc_sched_setattr(pid_t pid, const sched_attr_t* attr) {
+    if (!attr) return -EFAULT;
+    read_lock(&tasklist_lock);
+    process_t* p = pid ? proc_get(pid) : current_proc;
+    int ret = p ? sched_task_setattr(p, attr) : -ESRCH;
+    read_unlock(&tasklist_lock);
+    return ret;
+}
+
+int proc_sched_getattr(pid_t pid, sched_attr_t* attr) {
+    if (!attr) return -EFAULT;
+    read_lock(&tasklist_lock);
+    process_t* p = pid ? proc_get(pid) : current_proc;
+    if (p) sched_task_getattr(p, attr);
+    read_unlock(&tasklist_lock);
+    return p ? 0 : -ESRCH;
+}
+
+// ===== 資源使用量 =====
+// utime/stime は実行時間を tick サンプルの比で分ける (64bit 除算は div_u64_rem で)
+void proc_acct_get(process_t* p, proc_acct_t* a) {
+    uint32_t flags = local_irq_save();
+    uint64_t sum = p->sum_exec_runtime;
+    // 自分なら今回のスライスで走った分も足す
+    if (p == current_proc) {
+        uint64_t now = ktime_get_ns();
+        if (now > p->exec_start) sum += now - p->exec_start;
+    }
+    uint32_t utick = p->utick, total = p->utick + p->stick;
+    local_irq_restore(flags);
+
+    a->utime = 0;
+    if (total && utick) {
+        uint32_t rem;
+        uint64_t q = div_u64_rem(sum, total, &rem);
+        a->utime = q * utick + div_u64_rem((uint64_t)rem * utick, total, NULL);
+    }
+    a->stime   = sum - a->utime;
+    a->nvcsw   = p->nvcsw;
+    a->nivcsw  = p->nivcsw;
+    a->min_flt = p->min_flt;
+    a->maj_flt = p->maj_flt;
+    a->rchar   = p->rchar;
+    a->wchar   = p->wchar;
+}
+
+static void ns_to_timeval(uint64_t ns, timeval_t* tv) {
+    uint32_t rem;
+    tv->tv_sec  = (int32_t)div_u64_rem(ns, NSEC_PER_SEC, &rem);
+    tv->tv_usec = (int32_t)(rem / NSEC_PER_USEC);
+}
+
+int proc_getrusage(int who, rusage_t* ru) {
+    if (!ru) return -EFAULT;
+    proc_acct_t a;
+    if (who == RUSAGE_SELF)          proc_acct_get(current_proc, &a);
+    else if (who == RUSAGE_CHILDREN) a = current_proc->cacct;
+    else return -EINVAL;
+
+    kmemset(ru, 0, sizeof(*ru));
+    ns_to_timeval(a.utime, &ru->ru_utime);
+    ns_to_timeval(a.stime, &ru->ru_stime);
+    ru->ru_minflt  = (int32_t)a.min_flt;
+    ru->ru_majflt  = (int32_t)a.maj_flt;
+    ru->ru_inblock = (int32_t)(a.rchar >> 9);
+    ru->ru_oublock = (int32_t)(a.wchar >> 9);
+    ru->ru_nvcsw   = (int32_t)a.nvcsw;
+    ru->ru_nivcsw  = (int32_t)a.nivcsw;
+    return 0;
+}
+
+// 起動からの tick 数を返す
+clock_t proc_times(tms_t* t) {
+    if (t) {
+        proc_acct_t a;
+        proc_acct_get(current_proc, &a);
+        t->tms_utime  = (clock_t)div_u64_rem(a.utime, TICK_NSEC, NULL);
+        t->tms_stime  = (clock_t)div_u64_rem(a.stime, TICK_NSEC, NULL);
+        t->tms_cutime = (clock_t)div_u64_rem(current_proc->cacct.utime, TICK_NSEC, NULL);
+        t->tms_cstime = (clock_t)div_u64_rem(current_proc->cacct.stime, TICK_NSEC, NULL);
+    }
+    return ticks;
 }
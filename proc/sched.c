@@ -0,0 +1,812 @@
+// proc/sched.c - スケジューラ (CFS: vruntime 順の赤黒木、CPU ごとの実行キュー)
+#include "../include/kernel/sched.h"
+#include "../include/kernel/proc.h"
+#include "../include/kernel/gdt.h"
+#include "../include/kernel/mm.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/timer.h"
+#include "../include/kernel/irqflags.h"
+#include "../include/kernel/smp.h"
+#include "../include/kernel/spinlock.h"
+#include "../include/kernel/softirq.h"
+#include "../include/kernel/fpu.h"
+#include "../include/kernel/cgroup.h"
+#include "../include/kernel/types.h"
+
+extern void context_switch(uint32_t* old_esp, uint32_t new_esp);
+
+static rq_t runqueues[MAX_CPUS];
+static lock_class_t rq_lock_class = LOCK_CLASS_INIT("rq->lock");
+
+static inline rq_t* cpu_rq(int cpu) { return &runqueues[cpu]; }
+static inline rq_t* this_rq(void)   { return &runqueues[smp_processor_id()]; }
+
+// nice -20..19 → 重み (1段階で約10%のCPU差)
+static const uint32_t prio_to_weight[40] = {
+ /* -20 */ 88761, 71755, 56483, 46273, 36291,
+ /* -15 */ 29154, 23254, 18705, 14949, 11916,
+ /* -10 */  9548,  7620,  6100,  4904,  3906,
+ /*  -5 */  3121,  2501,  1991,  1586,  1277,
+ /*   0 */  1024,   820,   655,   526,   423,
+ /*   5 */   335,   272,   215,   172,   137,
+ /*  10 */   110,    87,    70,    56,    45,
+ /*  15 */    36,    29,    23,    18,    15,
+};
+
+// 2^32 / weight
+static const uint32_t prio_to_wmult[40] = {
+ /* -20 */     48388,     59856,     76040,     92818,    118348,
+ /* -15 */    147320,    184698,    229616,    287308,    360437,
+ /* -10 */    449829,    563644,    704093,    875809,   1099582,
+ /*  -5 */   1376151,   1717300,   2157191,   2708050,   3363326,
+ /*   0 */   4194304,   5237765,   6557202,   8165337,  10153587,
+ /*   5 */  12820798,  15790321,  19976592,  24970740,  31350126,
+ /*  10 */  39045157,  49367440,  61356676,  76695844,  95443717,
+ /*  15 */ 119304647, 148102320, 186737708, 238609294, 286331153,
+};
+
+static inline process_t* task_of(rb_node_t* n) {
+    return rb_entry(n, process_t, run_node);
+}
+
+// 実時間 delta を重みで割った仮想時間 (グループに入っていればその取り分でも割る)
+static uint64_t calc_delta_fair(uint64_t delta, process_t* p) {
+    if (p->weight != NICE_0_LOAD) delta = mul_u64_u32_shr(delta * NICE_0_LOAD, p->inv_weight, 32);
+    if (p->cgroup == &cgroup_root) return delta;
+    return cgroup_scale_delta(p->cgroup, delta);
+}
+
+// 走れる状態になった / でなくなったタスクをグループの nr_running に数える。
+// p の実行キューのロックを持って呼ぶ
+static void cg_set_runnable(process_t* p, int on) {
+    if (p->cg_runnable == on) return;
+    p->cg_runnable = on;
+    cgroup_runnable(p->cgroup, on ? 1 : -1);
+}
+
+static void update_min_vruntime(rq_t* rq) {
+    uint64_t v = rq->min_vruntime;
+    process_t* curr = rq->curr;
+    int have = 0;
+
+    if (curr && curr != rq->idle && curr->policy == SCHED_NORMAL &&
+        curr->state == PROC_RUNNING) {
+        v = curr->vruntime;
+        have = 1;
+    }
+    if (rq->leftmost) {
+        uint64_t lv = task_of(rq->leftmost)->vruntime;
+        if (!have || lv < v) v = lv;
+        have = 1;
+    }
+    // 単調増加
+    if (have && v > rq->min_vruntime) rq->min_vruntime = v;
+}
+
+static void enqueue_entity(rq_t* rq, process_t* p) {
+    rb_node_t** link = &rq->tasks.root;
+    rb_node_t*  parent = NULL;
+    int leftmost = 1;
+
+    while (*link) {
+        parent = *link;
+        if (p->vruntime < task_of(parent)->vruntime) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = 0;
+        }
+    }
+    rb_link_node(&p->run_node, parent, link);
+    rb_insert_color(&p->run_node, &rq->tasks);
+    if (leftmost) rq->leftmost = &p->run_node;
+
+    p->on_rq = 1;
+    rq->nr_running++;
+    rq->load_weight += p->weight;
+}
+
+static void dequeue_entity(rq_t* rq, process_t* p) {
+    if (rq->leftmost == &p->run_node) rq->leftmost = rb_next(&p->run_node);
+    rb_erase(&p->run_node, &rq->tasks);
+    p->on_rq = 0;
+    rq->nr_running--;
+    rq->load_weight -= p->weight;
+}
+
+// ===== デッドラインクラス (EDF + CBS) =====
+static inline process_t* dl_task_of(rb_node_t* n) {
+    return rb_entry(n, process_t, dl_node);
+}
+
+static void enqueue_dl(rq_t* rq, process_t* p) {
+    rb_node_t** link = &rq->dl_tasks.root;
+    rb_node_t*  parent = NULL;
+    int leftmost = 1;
+
+    while (*link) {
+        parent = *link;
+        if (p->dl_abs_deadline < dl_task_of(parent)->dl_abs_deadline) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = 0;
+        }
+    }
+    rb_link_node(&p->dl_node, parent, link);
+    rb_insert_color(&p->dl_node, &rq->dl_tasks);
+    if (leftmost) rq->dl_leftmost = &p->dl_node;
+
+    p->on_rq = 1;
+    rq->dl_nr_running++;
+}
+
+static void dequeue_dl(rq_t* rq, process_t* p) {
+    if (rq->dl_leftmost == &p->dl_node) rq->dl_leftmost = rb_next(&p->dl_node);
+    rb_erase(&p->dl_node, &rq->dl_tasks);
+    p->on_rq = 0;
+    rq->dl_nr_running--;
+}
+
+static void enqueue_task(rq_t* rq, process_t* p) {
+    if (p->policy == SCHED_DEADLINE) enqueue_dl(rq, p);
+    else                             enqueue_entity(rq, p);
+}
+
+static void dequeue_task(rq_t* rq, process_t* p) {
+    if (p->policy == SCHED_DEADLINE) dequeue_dl(rq, p);
+    else                             dequeue_entity(rq, p);
+}
+
+// rq の CPU に再スケジュールさせる (他 CPU なら IPI)
+static void resched_rq(rq_t* rq) {
+    rq->need_resched = 1;
+    smp_send_resched(rq->cpu);
+}
+
+// p が属する実行キューをロックする。ロックを待つ間に移動されたら取り直す
+static rq_t* task_rq_lock(process_t* p, uint32_t* flags) {
+    while (1) {
+        rq_t* rq = cpu_rq(p->cpu);
+        *flags = spin_lock_irqsave(&rq->lock);
+        if (rq == cpu_rq(p->cpu)) return rq;
+        spin_unlock_irqrestore(&rq->lock, *flags);
+    }
+}
+
+static void task_rq_unlock(rq_t* rq, uint32_t flags) {
+    spin_unlock_irqrestore(&rq->lock, flags);
+}
+
+// 新しい周期を今から始める
+static void dl_new_period(process_t* p, uint64_t now) {
+    p->dl_abs_deadline = now + p->dl_deadline;
+    p->dl_budget       = (int64_t)p->dl_runtime;
+    p->dl_missed       = 0;
+}
+
+static void dl_check_miss(process_t* p, uint64_t now) {
+    if (now > p->dl_abs_deadline && !p->dl_missed) {
+        p->dl_misses++;
+        p->dl_missed = 1;
+    }
+}
+
+// 予算切れ / ジョブ完了: 次周期の開始まで実行させない
+static void dl_throttle(process_t* p, uint64_t now) {
+    p->dl_throttled = 1;
+    dl_check_miss(p, now);
+    uint64_t next = p->dl_abs_deadline - p->dl_deadline + p->dl_period;
+    uint32_t t = next > now ? ns_to_ticks(next - now) : 1;
+    timer_add(&p->dl_timer, ticks + t);
+}
+
+// EDF: より早いデッドラインのタスクが来たら切り替え
+static void check_preempt_dl(rq_t* rq, process_t* p) {
+    process_t* curr = rq->curr;
+    if (curr == rq->idle || curr->policy != SCHED_DEADLINE ||
+        p->dl_abs_deadline < curr->dl_abs_deadline)
+        resched_rq(rq);
+}
+
+// 補充タイマー: 超過分を差し引いて予算を戻す
+static void dl_replenish(void* data) {
+    process_t* p = (process_t*)data;
+    uint32_t flags;
+    rq_t* rq = task_rq_lock(p, &flags);
+    uint64_t now = ktime_get_ns();
+
+    p->dl_throttled = 0;
+    while (p->dl_budget <= 0) {
+        p->dl_abs_deadline += p->dl_period;
+        p->dl_budget       += (int64_t)p->dl_runtime;
+    }
+    p->dl_missed = 0;
+    if (p->dl_abs_deadline < now) dl_new_period(p, now);
+
+    if (p->state == PROC_READY && !p->on_rq && p != rq->curr) {
+        enqueue_dl(rq, p);
+        check_preempt_dl(rq, p);
+    }
+    task_rq_unlock(rq, flags);
+}
+
+// runtime/period を DL_BW_UNIT 単位に (64bit 除算を避ける)
+static uint32_t to_ratio(uint64_t runtime, uint64_t period) {
+    while (period >> 32) { period >>= 1; runtime >>= 1; }
+    if (!period) return DL_BW_UNIT;
+    return (uint32_t)div_u64_rem(runtime << DL_BW_SHIFT, (uint32_t)period, NULL);
+}
+
+// 実行中タスクの実行時間と vruntime を進める
+static void update_curr(rq_t* rq) {
+    process_t* curr = rq->curr;
+    uint64_t now = ktime_get_ns();
+    if (now <= curr->exec_start) return;
+    uint64_t delta = now - curr->exec_start;
+    curr->exec_start = now;
+    curr->sum_exec_runtime += delta;
+    if (curr == rq->idle) return;
+    cgroup_account_cpu(curr->cgroup, delta);
+
+    if (curr->policy == SCHED_DEADLINE) {
+        curr->dl_budget -= (int64_t)delta;
+        if (curr->dl_budget <= 0 && !curr->dl_throttled) {
+            // CBS: 予算超過は次周期まで止める
+            curr->dl_throttles++;
+            dl_throttle(curr, now);
+            rq->need_resched = 1;
+        }
+        return;
+    }
+    curr->vruntime += calc_delta_fair(delta, curr);
+    update_min_vruntime(rq);
+}
+
+// p の1回分の持ち時間 (ns)
+static uint64_t sched_slice(rq_t* rq, process_t* p) {
+    uint32_t nr = rq->nr_running + 1;
+    uint64_t period = SCHED_LATENCY_NS;
+    if (nr > SCHED_NR_LATENCY) period = (uint64_t)nr * SCHED_MIN_GRAN_NS;
+    uint32_t total = rq->load_weight + p->weight;
+    return div_u64_rem(period * p->weight, total, NULL);
+}
+
+static void set_weight(process_t* p, int nice) {
+    if (nice < NICE_MIN) nice = NICE_MIN;
+    if (nice > NICE_MAX) nice = NICE_MAX;
+    p->nice       = nice;
+    p->weight     = prio_to_weight[nice - NICE_MIN];
+    p->inv_weight = prio_to_wmult[nice - NICE_MIN];
+}
+
+// 起きた / 移ってきたタスクが rq の実行中タスクより十分に遅れていれば切り替え
+static void check_preempt_fair(rq_t* rq, process_t* p) {
+    process_t* curr = rq->curr;
+    if (curr == rq->idle) {
+        resched_rq(rq);
+    } else if (curr->policy == SCHED_NORMAL) {
+        update_curr(rq);
+        if (curr->vruntime > p->vruntime + SCHED_WAKEUP_GRAN_NS)
+            resched_rq(rq);
+    }
+}
+
+// ===== 負荷分散 =====
+// 実行中のタスクも含めた負荷
+static uint32_t rq_load(rq_t* rq) {
+    return rq->nr_running + rq->dl_nr_running + (rq->curr != rq->idle);
+}
+
+// デッドラインタスクは帯域を CPU ごとに管理しているので動かさない。
+// FPU の状態がまだ元の CPU のレジスタにあるタスクも動かさない
+static int can_migrate(process_t* p) {
+    return p->policy == SCHED_NORMAL && !(p->flags & PF_NO_MIGRATE) && !fpu_is_live(p);
+}
+
+// src の待ちタスクを1つ dst に移す。dst のロックを持って呼ぶ。
+// src は trylock なので、互いに引き合ってもデッドロックしない
+static process_t* pull_task(rq_t* dst, rq_t* src) {
+    if (!spin_trylock(&src->lock)) return NULL;
+
+    process_t* p = NULL;
+    for (rb_node_t* n = src->leftmost; n; n = rb_next(n)) {
+        if (can_migrate(task_of(n))) { p = task_of(n); break; }
+    }
+    if (p) {
+        dequeue_entity(src, p);
+        // vruntime は各キューの min_vruntime からの相対値として引き継ぐ
+        int64_t lag = (int64_t)(p->vruntime - src->min_vruntime);
+        p->vruntime = (lag < 0 && (uint64_t)-lag > dst->min_vruntime)
+                      ? 0 : dst->min_vruntime + (uint64_t)lag;
+        p->cpu = dst->cpu;
+        enqueue_entity(dst, p);
+        dst->nr_migrations++;
+    }
+    spin_unlock(&src->lock);
+    return p;
+}
+
+// 自分のキューが空になったら、待ちタスクを抱えた CPU から盗む
+static void steal_task(rq_t* rq) {
+    for (int i = 1; i < MAX_CPUS; i++) {
+        rq_t* src = cpu_rq((rq->cpu + i) % MAX_CPUS);
+        if (!src->online || !src->nr_running) continue;
+        if (pull_task(rq, src)) return;
+    }
+}
+
+// 定期的な負荷分散: 最も混んでいる CPU との差が2以上なら1つ引き取る
+static void load_balance(rq_t* rq) {
+    rq_t* busiest = NULL;
+    uint32_t max = 0;
+    for (int i = 0; i < MAX_CPUS; i++) {
+        rq_t* r = cpu_rq(i);
+        if (r == rq || !r->online) continue;
+        uint32_t load = rq_load(r);
+        if (load > max) { max = load; busiest = r; }
+    }
+    if (!busiest || !busiest->nr_running || max < rq_load(rq) + 2) return;
+
+    process_t* p = pull_task(rq, busiest);
+    if (p) check_preempt_fair(rq, p);
+}
+
+// fork したタスクは一番空いている CPU に置く
+static int select_cpu_fork(void) {
+    int best = smp_processor_id();
+    uint32_t best_load = rq_load(cpu_rq(best));
+    for (int i = 0; i < MAX_CPUS; i++) {
+        rq_t* r = cpu_rq(i);
+        if (!r->online) continue;
+        uint32_t load = rq_load(r);
+        if (load < best_load) { best_load = load; best = i; }
+    }
+    return best;
+}
+
+// ===== 公開API =====
+void sched_init_cpu(int cpu, process_t* idle) {
+    rq_t* rq = cpu_rq(cpu);
+    spin_lock_init_class(&rq->lock, &rq_lock_class);
+    rq->cpu           = cpu;
+    rq->dl_tasks      = RB_ROOT;
+    rq->dl_leftmost   = NULL;
+    rq->dl_nr_running = 0;
+    rq->dl_total_bw   = 0;
+    rq->tasks        = RB_ROOT;
+    rq->leftmost     = NULL;
+    rq->min_vruntime = 0;
+    rq->nr_running   = 0;
+    rq->load_weight  = 0;
+    rq->need_resched = 0;
+    rq->prev         = NULL;
+    rq->idle = rq->curr = idle;
+    idle->cpu    = cpu;
+    idle->on_cpu = 1;
+    idle->flags |= PF_NO_MIGRATE;
+    set_weight(idle, NICE_MAX);
+    timer_setup(&idle->dl_timer, dl_replenish, idle);
+    idle->exec_start = ktime_get_ns();
+    rq->online = 1;
+}
+
+void sched_init(process_t* idle) {
+    sched_init_cpu(0, idle);
+    cpus[0].online = 1;
+}
+
+uint32_t sched_nr_running(void) {
+    rq_t* rq = this_rq();
+    return rq->nr_running + rq->dl_nr_running;
+}
+
+void sched_stat_totals(uint32_t* nr_running, uint32_t* nr_switches) {
+    uint32_t running = 0, switches = 0;
+    for (int i = 0; i < MAX_CPUS; i++) {
+        rq_t* rq = cpu_rq(i);
+        if (!rq->online) continue;
+        running  += rq->nr_running + rq->dl_nr_running + (rq->curr != rq->idle);
+        switches += rq->nr_switches;
+    }
+    *nr_running  = running;
+    *nr_switches = switches;
+}
+
+// 新しいタスク: 既存タスクより少し後ろから始めて割り込みを防ぐ
+void sched_fork(process_t* p) {
+    p->on_rq  = 0;
+    p->on_cpu = 0;
+    p->cpu    = select_cpu_fork();
+    p->sum_exec_runtime = p->prev_sum_exec = 0;
+    // デッドライン帯域は子に引き継がない
+    p->policy = SCHED_NORMAL;
+    p->dl_bw = 0;
+    p->dl_throttled = 0;
+    p->dl_misses = p->dl_throttles = 0;
+    timer_setup(&p->dl_timer, dl_replenish, p);
+    set_weight(p, p->nice);
+
+    uint32_t flags;
+    rq_t* rq = task_rq_lock(p, &flags);
+    p->vruntime = rq->min_vruntime + calc_delta_fair(sched_slice(rq, p), p);
+    p->state = PROC_READY;
+    cg_set_runnable(p, 1);
+    enqueue_entity(rq, p);
+    if (rq->curr == rq->idle) resched_rq(rq);
+    task_rq_unlock(rq, flags);
+}
+
+// 起床: 長く寝ていたタスクには半周期分だけ優先権を与える
+// 起きたタスクは直前に走っていた CPU のキューに戻す (キャッシュが温かい)
+void sched_wakeup(process_t* p) {
+    uint32_t flags;
+    rq_t* rq = task_rq_lock(p, &flags);
+    if (p->on_rq || p == rq->curr) {
+        // 眠る直前 (schedule() の手前) なら RUNNING に戻すだけでよい
+        p->state = (p == rq->curr) ? PROC_RUNNING : PROC_READY;
+        task_rq_unlock(rq, flags);
+        return;
+    }
+
+    cg_set_runnable(p, 1);
+    if (p->policy == SCHED_DEADLINE) {
+        p->state = PROC_READY;
+        if (!p->dl_throttled) {
+            // CBS: 残り予算を今のデッドラインまでに使うと帯域を超えるなら新周期
+            uint64_t now = ktime_get_ns();
+            if (p->dl_abs_deadline <= now ||
+                (uint64_t)p->dl_budget * p->dl_period >
+                (p->dl_abs_deadline - now) * p->dl_runtime)
+                dl_new_period(p, now);
+            enqueue_dl(rq, p);
+            check_preempt_dl(rq, p);
+        }
+        task_rq_unlock(rq, flags);
+        return;
+    }
+
+    uint64_t credit = SCHED_LATENCY_NS / 2;
+    uint64_t floor  = rq->min_vruntime > credit ? rq->min_vruntime - credit : 0;
+    if (p->vruntime < floor) p->vruntime = floor;
+    p->state = PROC_READY;
+    enqueue_entity(rq, p);
+
+    // 起きたタスクが十分に遅れていれば即座に切り替える (対話性)
+    check_preempt_fair(rq, p);
+    task_rq_unlock(rq, flags);
+}
+
+void sched_set_nice(process_t* p, int nice) {
+    uint32_t flags;
+    rq_t* rq = task_rq_lock(p, &flags);
+    if (p->on_rq) rq->load_weight -= p->weight;
+    set_weight(p, nice);
+    if (p->on_rq) rq->load_weight += p->weight;
+    task_rq_unlock(rq, flags);
+}
+
+// 切り替え先で呼ぶ: 前タスクの on_cpu を落として実行キューのロックを返す
+// (新しいタスクは task_entry_trampoline から来る)
+void finish_task_switch(void) {
+    rq_t* rq = this_rq();
+    if (rq->prev) {
+        rq->prev->on_cpu = 0;
+        rq->prev = NULL;
+    }
+    spin_unlock(&rq->lock);
+}
+
+// prev から next へ切り替える。rq->lock を持ち割り込み禁止で呼び、
+// 戻ってきたとき (prev として再開) にはロックは外れている
+static void switch_tasks(rq_t* rq, process_t* prev, process_t* next) {
+    rq->curr      = next;
+    current_proc  = next;
+    next->on_cpu  = 1;
+    rq->prev      = prev;
+    rq->nr_switches++;
+
+    // TSS のカーネルスタック更新
+    gdt_set_kernel_stack(next->kernel_stack_top);
+    gdt_load_tls(next->tls_desc);
+
+    // FPU は #NM まで切り替えない
+    fpu_switch_to(next);
+
+    // アドレス空間切り替え
+    if (next->page_dir != prev->page_dir) vmm_switch(next->page_dir);
+
+    context_switch(&prev->esp, next->esp);
+
+    // prev として再開 (別の CPU のことがある)
+    finish_task_switch();
+}
+
+void schedule(void) {
+    uint32_t flags = local_irq_save();
+    rq_t* rq = this_rq();
+    process_t* prev = rq->curr;
+
+    // idle が割り込みで起こされた場合は周期 tick に戻す
+    // (満了したタイマーが起床を行うので実行キューのロック前に)
+    if (prev == rq->idle) tick_nohz_idle_exit();
+
+    spin_lock(&rq->lock);
+    rq->need_resched = 0;
+    update_curr(rq);
+
+    // 走れる状態のまま外されるなら横取り (眠る・終わるなら自発的)
+    int preempted = prev->state == PROC_RUNNING;
+    if (prev->state == PROC_RUNNING) {
+        prev->state = PROC_READY;
+        // 予算切れのデッドラインタスクは補充タイマーが戻す
+        if (prev != rq->idle && !(prev->policy == SCHED_DEADLINE && prev->dl_throttled))
+            enqueue_task(rq, prev);
+    } else if (prev != rq->idle) {
+        cg_set_runnable(prev, 0);
+    }
+
+    // 何も無ければ他の CPU から盗む
+    if (!rq->dl_leftmost && !rq->leftmost) steal_task(rq);
+
+    // デッドラインクラス → 通常クラス → idle
+    process_t* next = rq->idle;
+    if (rq->dl_leftmost)   next = dl_task_of(rq->dl_leftmost);
+    else if (rq->leftmost) next = task_of(rq->leftmost);
+    if (next != rq->idle) dequeue_task(rq, next);
+    next->state         = PROC_RUNNING;
+    next->exec_start    = ktime_get_ns();
+    next->prev_sum_exec = next->sum_exec_runtime;
+
+    if (next == prev) {
+        spin_unlock(&rq->lock);
+        local_irq_restore(flags);
+        return;
+    }
+    if (preempted) prev->nivcsw++;
+    else           prev->nvcsw++;
+
+    switch_tasks(rq, prev, next);
+    local_irq_restore(flags);
+}
+
+// 2つの実行キューをアドレス順にロックする (割り込み禁止で呼ぶ)
+static void double_rq_lock(rq_t* a, rq_t* b) {
+    if (a == b) {
+        spin_lock(&a->lock);
+        return;
+    }
+    spin_lock(a < b ? &a->lock : &b->lock);
+    spin_lock(a < b ? &b->lock : &a->lock);
+}
+
+static void double_rq_unlock(rq_t* a, rq_t* b) {
+    if (a != b) spin_unlock(&b->lock);
+    spin_unlock(&a->lock);
+}
+
+// 同期 IPC の直接切り替え: 眠っている next を実行キューを通さずにこの CPU で走らせる。
+// next は呼び出し側の vruntime と残りの持ち時間を引き継ぐ (受け手は送り手の時間で動く)。
+// 呼び出し側は自分を BLOCKED にしてから呼ぶ。
+// 条件が合わない (デッドラインクラスが絡む・next がもう起きている など) ときは
+// next を普通に起こして schedule() する
+void sched_yield_to(process_t* next) {
+    uint32_t flags = local_irq_save();
+    rq_t* rq  = this_rq();
+    rq_t* src = cpu_rq(next->cpu);
+    process_t* prev = rq->curr;
+
+    double_rq_lock(rq, src);
+    int ok = prev != rq->idle && prev->state != PROC_RUNNING &&
+             prev->policy == SCHED_NORMAL && next->policy == SCHED_NORMAL &&
+             next->state == PROC_BLOCKED && !next->on_rq && !next->on_cpu &&
+             src == cpu_rq(next->cpu) && (src == rq || can_migrate(next)) && !rq->dl_nr_running;
+    if (!ok) {
+        double_rq_unlock(rq, src);
+        proc_wakeup(next);
+        if (prev->state != PROC_RUNNING) schedule();
+        local_irq_restore(flags);
+        return;
+    }
+
+    // 起床処理と競合しないよう、ロックを離す前に next をこの CPU の実行中にする
+    // (後から来た sched_wakeup は next == rq->curr を見て状態を直すだけになる)
+    next->state = PROC_RUNNING;
+    cg_set_runnable(next, 1);
+    cg_set_runnable(prev, 0);
+    if (src != rq) {
+        next->cpu = rq->cpu;
+        rq->nr_migrations++;
+        spin_unlock(&src->lock);
+    }
+    update_curr(rq);
+
+    // 長く寝ていた分の優先権は sched_wakeup と同じ半周期まで。
+    // 送り手より先に進んでいれば送り手の位置まで戻す
+    uint64_t credit = SCHED_LATENCY_NS / 2;
+    uint64_t floor  = rq->min_vruntime > credit ? rq->min_vruntime - credit : 0;
+    if (next->vruntime < floor) next->vruntime = floor;
+    if (next->vruntime > prev->vruntime) next->vruntime = prev->vruntime;
+    // 今の持ち時間の使用量も引き継ぐ (往復し続けても scheduler_tick は1つの持ち時間として数える)
+    uint64_t used = prev->sum_exec_runtime - prev->prev_sum_exec;
+    next->prev_sum_exec = next->sum_exec_runtime > used ? next->sum_exec_runtime - used : 0;
+    next->exec_start    = ktime_get_ns();
+    prev->nvcsw++;
+
+    switch_tasks(rq, prev, next);
+    local_irq_restore(flags);
+}
+
+// 各 CPU の周期 tick から呼ばれる (BSP は PIT、AP は LAPIC タイマー)
+// user_tick: 割り込まれたのがユーザーモード (utime/stime の按分に使う)
+void scheduler_tick(int user_tick) {
+    rq_t* rq = this_rq();
+    if (!rq->online) return;
+
+    spin_lock(&rq->lock);
+    process_t* curr = rq->curr;
+    update_curr(rq);
+    if (user_tick) curr->utick++;
+    else           curr->stick++;
+
+    if (++rq->balance_tick >= SCHED_BALANCE_TICKS) {
+        rq->balance_tick = 0;
+        load_balance(rq);
+    }
+
+    if (curr == rq->idle) {
+        // 暇な CPU は毎 tick 他の CPU から仕事を盗みにいく
+        if (!rq->nr_running) steal_task(rq);
+        if (rq->nr_running + rq->dl_nr_running) rq->need_resched = 1;
+        goto out;
+    }
+
+    if (curr->policy == SCHED_DEADLINE) {
+        // 予算切れは update_curr で処理済み
+        if (rq->dl_leftmost &&
+            dl_task_of(rq->dl_leftmost)->dl_abs_deadline < curr->dl_abs_deadline)
+            rq->need_resched = 1;
+        goto out;
+    }
+    if (rq->dl_nr_running) {
+        rq->need_resched = 1;
+        goto out;
+    }
+
+    // 持ち時間を使い切ったか、最小粒度を過ぎて先頭のタスクに大きく抜かれたら切り替え
+    uint64_t ideal = sched_slice(rq, curr);
+    uint64_t delta_exec = curr->sum_exec_runtime - curr->prev_sum_exec;
+    if (delta_exec > ideal) {
+        rq->need_resched = 1;
+    } else if (delta_exec >= SCHED_MIN_GRAN_NS && rq->leftmost) {
+        uint64_t lv = task_of(rq->leftmost)->vruntime;
+        if (curr->vruntime > lv && curr->vruntime - lv > ideal)
+            rq->need_resched = 1;
+    }
+out:
+    spin_unlock(&rq->lock);
+}
+
+// 割り込みの出口 (EOI 後) で呼ぶ
+// ロック保持中 (preempt_count > 0) に割り込まれた場合は preempt_enable() まで遅らせる
+void sched_irq_exit(void) {
+    if (this_rq()->need_resched && preempt_count() == 0) schedule();
+}
+
+// preempt_enable() でカウンタが0に戻ったとき。割り込み禁止中・ソフト割り込み中と、
+// 眠る準備をしている途中 (state != RUNNING) は切り替えない
+void preempt_schedule(void) {
+    uint32_t eflags;
+    asm volatile("pushfl; popl %0" : "=r"(eflags));
+    if (!(eflags & EFLAGS_IF) || in_softirq()) return;
+    if (!this_rq()->need_resched || current_proc->state != PROC_RUNNING) return;
+    schedule();
+}
+
+// ポリシー変更。デッドラインクラスは CPU ごとの合計帯域が上限以下のときだけ受け入れる
+int sched_task_setattr(process_t* p, const sched_attr_t* attr) {
+    uint32_t new_bw = 0;
+    uint64_t period = 0;
+
+    if (attr->sched_policy == SCHED_DEADLINE) {
+        period = attr->sched_period ? attr->sched_period : attr->sched_deadline;
+        if (attr->sched_runtime < 1000 ||
+            attr->sched_runtime > attr->sched_deadline ||
+            attr->sched_deadline > period)
+            return -EINVAL;
+        new_bw = to_ratio(attr->sched_runtime, period);
+    } else if (attr->sched_policy != SCHED_NORMAL) {
+        return -EINVAL;
+    }
+
+    uint32_t flags;
+    rq_t* rq = task_rq_lock(p, &flags);
+    uint32_t old_bw = (p->policy == SCHED_DEADLINE) ? p->dl_bw : 0;
+    if (rq->dl_total_bw - old_bw + new_bw > DL_BW_LIMIT) {
+        task_rq_unlock(rq, flags);
+        return -EBUSY;
+    }
+
+    if (p->on_rq) dequeue_task(rq, p);
+    if (p->policy == SCHED_DEADLINE) timer_cancel(&p->dl_timer);
+    rq->dl_total_bw = rq->dl_total_bw - old_bw + new_bw;
+
+    p->dl_throttled = 0;
+    if (attr->sched_policy == SCHED_DEADLINE) {
+        p->policy       = SCHED_DEADLINE;
+        p->dl_runtime   = attr->sched_runtime;
+        p->dl_deadline  = attr->sched_deadline;
+        p->dl_period    = period;
+        p->dl_bw        = new_bw;
+        p->dl_misses    = p->dl_throttles = 0;
+        dl_new_period(p, ktime_get_ns());
+    } else {
+        // デッドラインクラスから戻るときだけ vruntime を今の基準に合わせる。
+        // NORMAL のままなら貯めた vruntime を残す (同じ nice で呼び直して先頭に割り込めないように)
+        if (p->policy == SCHED_DEADLINE) p->vruntime = rq->min_vruntime;
+        p->policy   = SCHED_NORMAL;
+        p->dl_bw    = 0;
+        set_weight(p, attr->sched_nice);
+    }
+
+    if (p->state == PROC_READY && p != rq->curr) enqueue_task(rq, p);
+    if (p == rq->curr) resched_rq(rq);
+    task_rq_unlock(rq, flags);
+    return 0;
+}
+
+void sched_task_getattr(process_t* p, sched_attr_t* attr) {
+    attr->size           = sizeof(sched_attr_t);
+    attr->sched_policy   = (uint32_t)p->policy;
+    attr->sched_flags    = 0;
+    attr->sched_nice     = p->nice;
+    attr->sched_priority = 0;
+    attr->sched_runtime  = p->dl_runtime;
+    attr->sched_deadline = p->dl_deadline;
+    attr->sched_period   = p->dl_period;
+}
+
+// デッドラインタスクの yield はジョブ完了: 残り予算を捨てて次周期を待つ
+void sched_yield_current(void) {
+    uint32_t flags = local_irq_save();
+    rq_t* rq = this_rq();
+    process_t* curr = rq->curr;
+    if (curr->policy == SCHED_DEADLINE) {
+        spin_lock(&rq->lock);
+        update_curr(rq);
+        if (!curr->dl_throttled) {
+            curr->dl_budget = 0;
+            dl_throttle(curr, ktime_get_ns());
+        }
+        spin_unlock(&rq->lock);
+    }
+    schedule();
+    local_irq_restore(flags);
+}
+
+// 終了するタスクの帯域とタイマーを返す
+void sched_exit(process_t* p) {
+    uint32_t flags;
+    rq_t* rq = task_rq_lock(p, &flags);
+    if (p->policy == SCHED_DEADLINE) {
+        timer_cancel(&p->dl_timer);
+        rq->dl_total_bw -= p->dl_bw;
+        p->dl_bw  = 0;
+        p->policy = SCHED_NORMAL;
+    }
+    task_rq_unlock(rq, flags);
+}
+
+// グループを移す (cgroup_attach から)。走れる状態なら数も移し、
+// 実行中ならそこまでの実行時間を元のグループに付けてから切り替える
+void sched_move_cgroup(process_t* p, struct cgroup* cg) {
+    uint32_t flags;
+    rq_t* rq = task_rq_lock(p, &flags);
+    if (p == rq->curr && p != rq->idle) update_curr(rq);
+    if (p->cg_runnable) {
+        cgroup_runnable(p->cgroup, -1);
+        cgroup_runnable(cg, 1);
+    }
+    p->cgroup = cg;
+    task_rq_unlock(rq, flags);
+}
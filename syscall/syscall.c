@@ -3,7 +3,12 @@
 #include "../include/kernel/proc.h"
 #include "../include/kernel/vfs.h"
 #include "../include/kernel/mm.h"
+#include "../include/kernel/vma.h"
 #include "../include/kernel/types.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/gdt.h"
+#include "../include/kernel/futex.h"
+#include "../include/kernel/ipc.h"
 
 // システムコール番号 (Linux互換)
 #define SYS_EXIT    1
@@ -27,6 +32,24 @@
 #define SYS_BRK     45
 #define SYS_KILL    37
 #define SYS_DUP2    63
+#define SYS_NICE    34
+#define SYS_GETPRIORITY 96
+#define SYS_SETPRIORITY 97
+#define SYS_SCHED_YIELD    158
+#define SYS_SCHED_SETATTR  351
+#define SYS_SCHED_GETATTR  352
+#define SYS_CLOCK_GETTIME   265
+#define SYS_CLOCK_NANOSLEEP 267
+#define SYS_TIMES     43
+#define SYS_GETRUSAGE 77
+#define SYS_CLONE           120
+#define SYS_FUTEX           240
+#define SYS_SET_THREAD_AREA 243
+#define SYS_GET_THREAD_AREA 244
+// 独自 (Linux に無い番号)
+#define SYS_IPC_CALL        400
+#define SYS_IPC_REPLY_WAIT  401
+#define SYS_IPC_REPLY       402
 
 extern void tty_putchar(char c);
 extern vnode_t* tty_get_vnode(void);
@@ -47,16 +70,21 @@ static void   kmemset(void* p, int v, size_t n) {
 // ファイルディスクリプタ管理
 static file_t* fd_get(int fd) {
     if (fd < 0 || fd >= MAX_FDS || !current_proc) return NULL;
-    return current_proc->fds[fd];
+    return current_proc->cold->files->fds[fd];
 }
 
+// FD 表はスレッド間で共有されうるので、空き探しと差し替えは表のロックの下で
 static int fd_alloc(file_t* f) {
+    files_struct_t* files = current_proc->cold->files;
+    spin_lock(&files->lock);
     for (int i = 0; i < MAX_FDS; i++) {
-        if (!current_proc->fds[i]) {
-            current_proc->fds[i] = f;
+        if (!files->fds[i]) {
+            files->fds[i] = f;
+            spin_unlock(&files->lock);
             return i;
         }
     }
+    spin_unlock(&files->lock);
     return -EMFILE;
 }
 
@@ -68,15 +96,10 @@ static int32_t sys_exit(int32_t code) {
     return 0; // 戻らない
 }
 
-// 2: fork
+// 2: fork (子には proc_clone が eax=0 のフレームを用意する)
 static int32_t sys_fork(regs_t* r) {
-    process_t* child = proc_fork();
+    process_t* child = proc_clone(0, r, 0, 0);
     if (!child) return -ENOMEM;
-    // 子プロセスにはeax=0を返す
-    // コンテキストスイッチ後に子から再開する
-    // 子のespが指すフレームのeaxを0にする
-    regs_t* child_regs = (regs_t*)child->esp;
-    child_regs->eax = 0;
     return (int32_t)child->pid;
 }
 
@@ -100,7 +123,7 @@ static int32_t sys_open(const char* path, int flags, uint32_t mode) {
     // CWD解決
     char full_path[VFS_PATH_LEN];
     if (path[0] != '/') {
-        kstrcpy(full_path, current_proc->cwd);
+        kstrcpy(full_path, current_proc->cold->fs->cwd);
         if (full_path[kstrlen(full_path)-1] != '/')
             full_path[kstrlen(full_path)] = '/', full_path[kstrlen(full_path)+1] = 0;
         // 末尾に追記
@@ -121,15 +144,19 @@ static int32_t sys_open(const char* path, int flags, uint32_t mode) {
 
 // 6: close
 static int32_t sys_close(int fd) {
-    file_t* f = fd_get(fd);
+    if (fd < 0 || fd >= MAX_FDS) return -EBADF;
+    files_struct_t* files = current_proc->cold->files;
+    spin_lock(&files->lock);
+    file_t* f = files->fds[fd];
+    files->fds[fd] = NULL;
+    spin_unlock(&files->lock);
     if (!f) return -EBADF;
-    current_proc->fds[fd] = NULL;
     return file_close(f);
 }
 
 // 7: waitpid
 static int32_t sys_waitpid(pid_t pid, int* status, int options) {
-    (void)options;
+    if (options & WNOHANG) return (int32_t)proc_wait_nohang(pid, status);
     return (int32_t)proc_wait(pid, status);
 }
 
@@ -144,9 +171,9 @@ static int32_t sys_execve(const char* path, char* const argv[], char* const envp
 static int32_t sys_chdir(const char* path) {
     vnode_t* node = vfs_lookup(path);
     if (!node || node->type != VFS_DIR) return -ENOENT;
-    if (path[0] == '/') kstrcpy(current_proc->cwd, path);
+    if (path[0] == '/') kstrcpy(current_proc->cold->fs->cwd, path);
     else {
-        char* cwd = current_proc->cwd;
+        char* cwd = current_proc->cold->fs->cwd;
         if (cwd[kstrlen(cwd)-1] != '/') {
             cwd[kstrlen(cwd)] = '/';
             cwd[kstrlen(cwd)+1] = 0;
@@ -204,6 +231,12 @@ static int32_t sys_lseek(int fd, off_t offset, int whence) {
     return (int32_t)file_seek(f, offset, whence);
 }
 
+// 45: brk (0 なら現在の brk を返す)
+static int32_t sys_brk(uint32_t addr) {
+    if (!current_proc->mm) return -ENOMEM;
+    return (int32_t)mm_brk(current_proc->mm, addr);
+}
+
 // 37: kill
 static int32_t sys_kill(pid_t pid, int sig) {
     proc_kill(pid, sig);
@@ -215,12 +248,53 @@ static int32_t sys_dup2(int oldfd, int newfd) {
     file_t* f = fd_get(oldfd);
     if (!f) return -EBADF;
     if (newfd < 0 || newfd >= MAX_FDS) return -EBADF;
-    if (current_proc->fds[newfd]) file_close(current_proc->fds[newfd]);
-    current_proc->fds[newfd] = f;
+    files_struct_t* files = current_proc->cold->files;
     f->ref++;
+    spin_lock(&files->lock);
+    file_t* old = files->fds[newfd];
+    files->fds[newfd] = f;
+    spin_unlock(&files->lock);
+    if (old) file_close(old);
     return newfd;
 }
 
+// 34: nice
+static int32_t sys_nice(int inc) {
+    return (int32_t)proc_setnice(0, current_proc->nice + inc);
+}
+
+// 96: getpriority (Linux と同じく 20 - nice を返す)
+static int32_t sys_getpriority(int which, pid_t who) {
+    if (which != PRIO_PROCESS) return -EINVAL;
+    int nice = proc_getnice(who);
+    if (nice < NICE_MIN) return nice;
+    return 20 - nice;
+}
+
+// 97: setpriority
+static int32_t sys_setpriority(int which, pid_t who, int nice) {
+    if (which != PRIO_PROCESS) return -EINVAL;
+    return (int32_t)proc_setnice(who, nice);
+}
+
+// 158: sched_yield
+static int32_t sys_sched_yield(void) {
+    proc_yield();
+    return 0;
+}
+
+// 351: sched_setattr
+static int32_t sys_sched_setattr(pid_t pid, const sched_attr_t* attr, uint32_t flags) {
+    if (flags) return -EINVAL;
+    return (int32_t)proc_sched_setattr(pid, attr);
+}
+
+// 352: sched_getattr
+static int32_t sys_sched_getattr(pid_t pid, sched_attr_t* attr, uint32_t size, uint32_t flags) {
+    if (flags || size < sizeof(sched_attr_t)) return -EINVAL;
+    return (int32_t)proc_sched_getattr(pid, attr);
+}
+
 // 162: sleep (秒)
 static int32_t sys_sleep(uint32_t seconds) {
     proc_sleep(seconds * 1000);
@@ -237,12 +311,104 @@ static int32_t sys_readdir(int fd, uint32_t index, char* name_out) {
 // 183: getcwd
 static int32_t sys_getcwd(char* buf, size_t size) {
     if (!buf) return -EINVAL;
-    size_t len = kstrlen(current_proc->cwd);
+    size_t len = kstrlen(current_proc->cold->fs->cwd);
     if (len >= size) return -ENOMEM;
-    kstrcpy(buf, current_proc->cwd);
+    kstrcpy(buf, current_proc->cold->fs->cwd);
     return (int32_t)len;
 }
 
+// 265: clock_gettime
+static int32_t sys_clock_gettime(int clk, timespec_t* ts) {
+    return (int32_t)ktime_gettime(clk, ts);
+}
+
+// 267: clock_nanosleep (flags は未対応, 相対時間のみ)
+static int32_t sys_clock_nanosleep(int clk, int flags, const timespec_t* req, timespec_t* rem) {
+    if (clk != CLOCK_MONOTONIC && clk != CLOCK_REALTIME) return -EINVAL;
+    if (flags) return -EINVAL;
+    return (int32_t)ktime_nanosleep(req, rem);
+}
+
+// 43: times (戻り値は起動からの tick 数)
+static int32_t sys_times(tms_t* t) {
+    return (int32_t)proc_times(t);
+}
+
+// 77: getrusage
+static int32_t sys_getrusage(int who, rusage_t* ru) {
+    return (int32_t)proc_getrusage(who, ru);
+}
+
+// 120: clone(flags, child_stack, parent_tid, tls, child_tid)
+// parent_tid / child_tid (CLONE_*SETTID) は未対応で無視する
+static int32_t sys_clone(regs_t* r, uint32_t flags, uint32_t child_stack, const user_desc_t* tls) {
+    uint64_t desc = 0;
+    if (flags & CLONE_SETTLS) {
+        if (!tls) return -EFAULT;
+        if (tls->entry_number != -1 && tls->entry_number != GDT_TLS_ENTRY) return -EINVAL;
+        desc = gdt_tls_desc(tls);
+    }
+    process_t* child = proc_clone(flags, r, child_stack, desc);
+    if (!child) return -ENOMEM;
+    return (int32_t)child->pid;
+}
+
+// 243: set_thread_area。使える TLS エントリは1つ (GDT_TLS_ENTRY) だけ
+static int32_t sys_set_thread_area(user_desc_t* u) {
+    if (!u) return -EFAULT;
+    if (u->entry_number == -1) u->entry_number = GDT_TLS_ENTRY;
+    if (u->entry_number != GDT_TLS_ENTRY) return -EINVAL;
+    uint64_t desc = gdt_tls_desc(u);
+    // 書いてから GDT に載せるまでの間に別の CPU へ移らないように
+    uint32_t flags = local_irq_save();
+    current_proc->tls_desc = desc;
+    gdt_load_tls(desc);
+    local_irq_restore(flags);
+    return 0;
+}
+
+// 244: get_thread_area
+static int32_t sys_get_thread_area(user_desc_t* u) {
+    if (!u) return -EFAULT;
+    if (u->entry_number != GDT_TLS_ENTRY) return -EINVAL;
+    uint64_t d = current_proc->tls_desc;
+    uint32_t lo = (uint32_t)d, hi = (uint32_t)(d >> 32);
+    uint8_t  access = (uint8_t)(hi >> 8), gran = (uint8_t)(hi >> 20);
+    u->base_addr       = (lo >> 16) | ((hi & 0xFF) << 16) | (hi & 0xFF000000);
+    u->limit           = (lo & 0xFFFF) | (hi & 0xF0000);
+    u->seg_32bit       = (gran >> 2) & 1;
+    u->contents        = 0;
+    u->read_exec_only  = !(access & 0x02);
+    u->limit_in_pages  = (gran >> 3) & 1;
+    u->seg_not_present = !(access & 0x80);
+    u->useable         = gran & 1;
+    return 0;
+}
+
+// 240: futex(uaddr, op, val, timeout / val2, uaddr2, val3)
+static int32_t sys_futex(regs_t* r) {
+    int op = (int)r->ecx & FUTEX_CMD_MASK;
+    const timespec_t* tmo = op == FUTEX_WAIT ? (const timespec_t*)r->esi : NULL;
+    return do_futex((uint32_t*)r->ebx, op, r->edx, tmo, r->esi, (uint32_t*)r->edi, r->ebp);
+}
+
+// 400: ipc_call(dest, msg, reply) / 401: ipc_reply_wait(to, reply, msg) / 402: ipc_reply(to, reply)
+// メッセージは固定長 (ipc_msg_t) のユーザーバッファで渡す
+static int32_t sys_ipc_call(pid_t dest, const ipc_msg_t* msg, ipc_msg_t* reply) {
+    if (!msg || !reply) return -EFAULT;
+    return ipc_call(dest, msg, reply);
+}
+
+static int32_t sys_ipc_reply_wait(pid_t to, const ipc_msg_t* reply, ipc_msg_t* msg) {
+    if (!msg || (to > 0 && !reply)) return -EFAULT;
+    return ipc_reply_wait(to, reply, msg);
+}
+
+static int32_t sys_ipc_reply(pid_t to, const ipc_msg_t* reply) {
+    if (!reply) return -EFAULT;
+    return ipc_reply(to, reply);
+}
+
 // ===== ディスパッチャ =====
 void syscall_dispatch(regs_t* r) {
     int32_t ret = -ENOSYS;
@@ -262,16 +428,54 @@ void syscall_dispatch(regs_t* r) {
     case SYS_MKDIR:   ret = sys_mkdir((char*)r->ebx, r->ecx); break;
     case SYS_UNLINK:  ret = sys_unlink((char*)r->ebx); break;
     case SYS_LSEEK:   ret = sys_lseek((int)r->ebx, (off_t)r->ecx, (int)r->edx); break;
+    case SYS_BRK:     ret = sys_brk(r->ebx); break;
     case SYS_KILL:    ret = sys_kill((pid_t)r->ebx, (int)r->ecx); break;
     case SYS_DUP2:    ret = sys_dup2((int)r->ebx, (int)r->ecx); break;
+    case SYS_NICE:    ret = sys_nice((int)r->ebx); break;
+    case SYS_GETPRIORITY: ret = sys_getpriority((int)r->ebx, (pid_t)r->ecx); break;
+    case SYS_SETPRIORITY: ret = sys_setpriority((int)r->ebx, (pid_t)r->ecx, (int)r->edx); break;
+    case SYS_SCHED_YIELD:   ret = sys_sched_yield(); break;
+    case SYS_SCHED_SETATTR: ret = sys_sched_setattr((pid_t)r->ebx, (const sched_attr_t*)r->ecx, r->edx); break;
+    case SYS_SCHED_GETATTR: ret = sys_sched_getattr((pid_t)r->ebx, (sched_attr_t*)r->ecx, r->edx, r->esi); break;
     case SYS_SLEEP:   ret = sys_sleep(r->ebx); break;
     case SYS_READDIR: ret = sys_readdir((int)r->ebx, r->ecx, (char*)r->edx); break;
     case SYS_GETCWD:  ret = sys_getcwd((char*)r->ebx, (size_t)r->ecx); break;
+    case SYS_CLOCK_GETTIME:   ret = sys_clock_gettime((int)r->ebx, (timespec_t*)r->ecx); break;
+    case SYS_CLOCK_NANOSLEEP: ret = sys_clock_nanosleep((int)r->ebx, (int)r->ecx,
+                                  (const timespec_t*)r->edx, (timespec_t*)r->esi); break;
+    case SYS_TIMES:     ret = sys_times((tms_t*)r->ebx); break;
+    case SYS_GETRUSAGE: ret = sys_getrusage((int)r->ebx, (rusage_t*)r->ecx); break;
+    case SYS_CLONE:     ret = sys_clone(r, r->ebx, r->ecx, (const user_desc_t*)r->esi); break;
+    case SYS_FUTEX:     ret = sys_futex(r); break;
+    case SYS_SET_THREAD_AREA: ret = sys_set_thread_area((user_desc_t*)r->ebx); break;
+    case SYS_GET_THREAD_AREA: ret = sys_get_thread_area((user_desc_t*)r->ebx); break;
+    case SYS_IPC_CALL:  ret = sys_ipc_call((pid_t)r->ebx, (const ipc_msg_t*)r->ecx, (ipc_msg_t*)r->edx); break;
+    case SYS_IPC_REPLY_WAIT:
+        ret = sys_ipc_reply_wait((pid_t)r->ebx, (const ipc_msg_t*)r->ecx, (ipc_msg_t*)r->edx);
+        break;
+    case SYS_IPC_REPLY: ret = sys_ipc_reply((pid_t)r->ebx, (const ipc_msg_t*)r->ecx); break;
     default: break;
     }
 
     r->eax = (uint32_t)ret;
 }
 
+// sysenter の入口 (kernel/isr_stubs.S の sysenter_entry) から。
+// sysenter は戻り先もユーザーの ESP も残さないので、ユーザーの %ebp が指す
+// [戻り先, ecx, edx, ebp] から int 0x80 と同じフレームを作ってから配る。
+// 戻ると ecx / edx は sysexit に使われるので、ユーザー側がスタックから戻す
+void syscall_sysenter(regs_t* r) {
+    uint32_t ubp = r->ebp;
+    if (ubp < USER_SPACE_START || ubp > USER_SPACE_END - 16 || (ubp & 3)) {
+        kprintf("%s[%d]: bad sysenter frame 0x%x\n", current_proc->name, current_proc->pid, ubp);
+        proc_exit(128 + SIGSEGV);
+    }
+    const uint32_t* u = (const uint32_t*)ubp;   // 触れなければページフォルトでプロセスだけ死ぬ
+    r->eip     = u[0];
+    r->ebp     = u[3];
+    r->useresp = ubp + 4;
+    syscall_dispatch(r);
+}
+
 // isr_handler から syscall ディスパッチ (int 0x80 = 128)
 // → drivers/irq.c の isr_handler に追加する形で呼ばれる
\ No newline at end of file
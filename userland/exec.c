@@ -1,9 +1,22 @@
-// userland/exec.c - プログラム実行 (カーネル内組み込みプログラム)
+// userland/exec.c - プログラム実行 (ELF32 ローダーとカーネル内組み込みプログラム)
+// ELF はヘッダとプログラムヘッダだけを読み、PT_LOAD を VMA として登録する。
+// 中身はページフォルトで読み込むので、exec の時間はバイナリの大きさによらない。
 #include "../include/kernel/types.h"
 #include "../include/kernel/proc.h"
 #include "../include/kernel/vfs.h"
+#include "../include/kernel/vma.h"
+#include "../include/kernel/elf.h"
+#include "../include/kernel/kthread.h"
+#include "../include/kernel/gdt.h"
+#include "../include/kernel/vdso.h"
+
+#define EXEC_ARG_MAX  4096   // argv 文字列の合計
+#define EXEC_MAX_ARGS 32
+
+#define PAGE_ALIGN(x) (((x) + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1))
 
 extern void shell_main(void);
+extern void switch_to_user(uint32_t eip, uint32_t esp);
 
 typedef struct {
     const char* name;
@@ -16,16 +29,224 @@ static builtin_program_t builtins[] = {
     { NULL, NULL }
 };
 
+// 古いアドレス空間を捨てる前に、パスと引数をカーネル側へ写しておく
+typedef struct {
+    char     path[VFS_PATH_LEN];
+    int      argc;
+    uint32_t len;
+    char     strs[EXEC_ARG_MAX];
+} exec_args_t;
+
+static size_t kstrlen(const char* s) { size_t n = 0; while (s[n]) n++; return n; }
+static int kstrcmp(const char* a, const char* b) {
+    while (*a && *a == *b) { a++; b++; }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+static void kstrncpy(char* d, const char* s, size_t max) {
+    size_t i = 0;
+    for (; i + 1 < max && s[i]; i++) d[i] = s[i];
+    d[i] = 0;
+}
+static void kmemset(void* ptr, int val, size_t n) {
+    uint8_t* p = (uint8_t*)ptr;
+    for (size_t i = 0; i < n; i++) p[i] = (uint8_t)val;
+}
+
+static exec_args_t* exec_args_new(const char* path, char* const argv[]) {
+    exec_args_t* a = (exec_args_t*)kmalloc(sizeof(exec_args_t));
+    if (!a) return NULL;
+    kstrncpy(a->path, path, VFS_PATH_LEN);
+    a->argc = 0;
+    a->len  = 0;
+    for (int i = 0; argv && argv[i]; i++) {
+        size_t n = kstrlen(argv[i]) + 1;
+        if (i >= EXEC_MAX_ARGS || a->len + n > EXEC_ARG_MAX) {
+            kfree(a);
+            return NULL;
+        }
+        kstrncpy(a->strs + a->len, argv[i], n);
+        a->len += n;
+        a->argc++;
+    }
+    return a;
+}
+
+static ssize_t vnode_read(vnode_t* v, uint32_t off, void* buf, size_t size) {
+    return v->ops && v->ops->read ? v->ops->read(v, (off_t)off, size, buf) : -EIO;
+}
+
+// PT_LOAD を VMA にする。file_end より先 (bss) はフォルト時にゼロ埋め
+static int load_segments(mm_t* mm, vnode_t* v, const elf32_ehdr_t* eh, const elf32_phdr_t* ph) {
+    uint32_t brk = 0;
+    for (int i = 0; i < eh->e_phnum; i++) {
+        const elf32_phdr_t* p = &ph[i];
+        if (p->p_type != PT_LOAD || p->p_memsz == 0) continue;
+        if (p->p_filesz > p->p_memsz) return -ENOEXEC;
+        if ((p->p_offset & (PAGE_SIZE - 1)) != (p->p_vaddr & (PAGE_SIZE - 1))) return -ENOEXEC;
+        if (p->p_vaddr + p->p_memsz < p->p_vaddr) return -ENOEXEC;
+
+        uint32_t start = p->p_vaddr & ~(PAGE_SIZE - 1);
+        uint32_t end   = PAGE_ALIGN(p->p_vaddr + p->p_memsz);
+        uint32_t flags = 0;
+        if (p->p_flags & PF_R) flags |= VM_READ;
+        if (p->p_flags & PF_W) flags |= VM_WRITE;
+        if (p->p_flags & PF_X) flags |= VM_EXEC;
+        int ret = mm_map(mm, start, end, flags, p->p_filesz ? v : NULL,
+                         p->p_offset & ~(PAGE_SIZE - 1), p->p_vaddr + p->p_filesz);
+        if (ret < 0) return ret == -EINVAL ? -ENOEXEC : ret;
+        if (end > brk) brk = end;
+    }
+    if (!brk) return -ENOEXEC;
+    mm->start_brk = mm->brk = brk;
+    return mm_map(mm, USER_STACK_TOP - USER_STACK_PAGES * PAGE_SIZE, USER_STACK_TOP,
+                  VM_READ | VM_WRITE | VM_STACK, NULL, 0, 0);
+}
+
+// i386 System V の初期スタック: argc, argv[], NULL, envp[] (空), NULL, auxv (AT_NULL)
+// 新しいアドレス空間に切り替えた後に呼ぶ (書き込みでスタックのページがフォルトして用意される)
+static uint32_t setup_user_stack(const exec_args_t* a) {
+    uint32_t sp = USER_STACK_TOP;
+    sp -= a->len;
+    char* strs = (char*)sp;
+    for (uint32_t i = 0; i < a->len; i++) strs[i] = a->strs[i];
+
+    uint32_t words = 1 + (uint32_t)a->argc + 1 + 1 + 2;
+    sp = (sp - words * 4) & ~15u;
+    uint32_t* st = (uint32_t*)sp;
+    int k = 0;
+    st[k++] = (uint32_t)a->argc;
+    uint32_t off = 0;
+    for (int i = 0; i < a->argc; i++) {
+        st[k++] = (uint32_t)(strs + off);
+        off += kstrlen(a->strs + off) + 1;
+    }
+    st[k++] = 0;          // argv 終端
+    st[k++] = 0;          // envp 終端
+    st[k++] = 0;          // AT_NULL
+    st[k++] = 0;
+    return sp;
+}
+
+// a は成功・失敗どちらでも解放する。成功したらユーザーモードへ飛んで戻らない
+static int elf_exec(exec_args_t* a) {
+    vnode_t* v = vfs_lookup(a->path);
+    if (!v || v->type != VFS_FILE) { kfree(a); return -ENOENT; }
+
+    elf32_ehdr_t eh;
+    elf32_phdr_t ph[ELF_MAX_PHDRS];
+    int ret = -ENOEXEC;
+    if (vnode_read(v, 0, &eh, sizeof(eh)) != (ssize_t)sizeof(eh)) goto fail;
+    if (eh.e_magic != ELF_MAGIC || eh.e_class != ELFCLASS32 || eh.e_data != ELFDATA2LSB ||
+        eh.e_type != ET_EXEC || eh.e_machine != EM_386 ||
+        eh.e_phentsize != sizeof(elf32_phdr_t) || eh.e_phnum == 0 || eh.e_phnum > ELF_MAX_PHDRS)
+        goto fail;
+    size_t ph_size = (size_t)eh.e_phnum * sizeof(elf32_phdr_t);
+    if (vnode_read(v, eh.e_phoff, ph, ph_size) != (ssize_t)ph_size) goto fail;
+
+    mm_t* mm = mm_create();
+    if (!mm) { ret = -ENOMEM; goto fail; }
+    ret = load_segments(mm, v, &eh, ph);
+    if (ret == 0) ret = vdso_mm_setup(mm, current_proc->pid);
+    if (ret < 0) {
+        mm_put(mm);
+        goto fail;
+    }
+
+    // ここから先は戻れない: 新しいアドレス空間に乗り換える
+    process_t* self = current_proc;
+    mm_t* old = self->mm;
+    self->mm       = mm;
+    self->page_dir = mm->pgd;
+    vmm_switch(mm->pgd);
+    if (old) mm_put(old);
+
+    self->flags &= ~(PF_KTHREAD | PF_KTHREAD_STOP);
+    self->tls_desc = 0;
+    gdt_load_tls(0);
+    kmemset(self->cold->sig_handlers, 0, sizeof(self->cold->sig_handlers));
+    const char* base = a->path;
+    for (const char* s = a->path; *s; s++) if (*s == '/') base = s + 1;
+    kstrncpy(self->name, base, PROC_NAME_LEN);
+
+    uint32_t sp = setup_user_stack(a);
+    kfree(a);
+    switch_to_user(eh.e_entry, sp);
+    return 0;   // ここには来ない
+
+fail:
+    kfree(a);
+    return ret;
+}
+
 int exec_program(const char* path, char* const argv[]) {
-    (void)argv;
     for (int i = 0; builtins[i].name; i++) {
-        // 簡易strcmp
-        const char* a = path, *b = builtins[i].name;
-        while (*a && *a == *b) { a++; b++; }
-        if (*a == 0 && *b == 0) {
+        if (kstrcmp(path, builtins[i].name) == 0) {
             builtins[i].entry();
             return 0;
         }
     }
-    return -ENOENT;
+    exec_args_t* a = exec_args_new(path, argv);
+    if (!a) return -E2BIG;
+    return elf_exec(a);
+}
+
+// ===== proc_spawn =====
+// fn(arg) を新しいプロセスで動かす (fork + exec の代わり)。
+// 子は親の FD と作業ディレクトリを引き継ぎ、fn の戻り値で終わる
+typedef struct {
+    kthread_fn_t fn;
+    void*        arg;
+    file_t*      fds[MAX_FDS];
+    char         cwd[256];
+} spawn_req_t;
+
+static int spawn_entry(void* arg) {
+    spawn_req_t* req = (spawn_req_t*)arg;
+    proc_cold_t* cold = current_proc->cold;
+    for (int i = 0; i < MAX_FDS; i++) cold->files->fds[i] = req->fds[i];
+    kstrncpy(cold->fs->cwd, req->cwd, sizeof(cold->fs->cwd));
+    kthread_fn_t fn = req->fn;
+    void* fn_arg    = req->arg;
+    kfree(req);
+    return fn(fn_arg);
+}
+
+pid_t proc_spawn_fn(kthread_fn_t fn, void* arg, const char* name) {
+    spawn_req_t* req = (spawn_req_t*)kmalloc(sizeof(spawn_req_t));
+    if (!req) return -ENOMEM;
+    req->fn  = fn;
+    req->arg = arg;
+    proc_cold_t* cold = current_proc->cold;
+    for (int i = 0; i < MAX_FDS; i++) {
+        req->fds[i] = cold->files->fds[i];
+        if (req->fds[i]) req->fds[i]->ref++;
+    }
+    kstrncpy(req->cwd, cold->fs->cwd, sizeof(req->cwd));
+
+    process_t* p = kthread_create(spawn_entry, req, name);
+    if (!p) {
+        for (int i = 0; i < MAX_FDS; i++)
+            if (req->fds[i]) file_close(req->fds[i]);
+        kfree(req);
+        return -ENOMEM;
+    }
+    return p->pid;
+}
+
+// 失敗したら sh と同じく 127 で終わる
+static int spawn_exec(void* arg) {
+    return elf_exec((exec_args_t*)arg) < 0 ? 127 : 0;
+}
+
+pid_t proc_spawn(const char* path, char* const argv[]) {
+    vnode_t* v = vfs_lookup(path);
+    if (!v || v->type != VFS_FILE) return -ENOENT;
+
+    exec_args_t* a = exec_args_new(path, argv);
+    if (!a) return -E2BIG;
+    const char* base = path;
+    for (const char* s = path; *s; s++) if (*s == '/') base = s + 1;
+    pid_t pid = proc_spawn_fn(spawn_exec, a, base);
+    if (pid < 0) kfree(a);
+    return pid;
 }
@@ -0,0 +1,79 @@
+// userland/lib/vdso.c - vDSO のページを読むユーザー側 (各 ELF にリンクする)
+// 時刻・tick・pid・全体の数をトラップせずに返す (include/kernel/vdso.h)。
+// どれも cdecl なので、アセンブリのプログラムからも call で呼べる
+#include "../../include/kernel/types.h"
+#include "../../include/kernel/time.h"
+#include "../../include/kernel/vdso.h"
+
+#define SYS_GETPID 20
+
+static const vdso_data_t* const vd = (const vdso_data_t*)VDSO_DATA_ADDR;
+static const vdso_proc_t* const vp = (const vdso_proc_t*)VDSO_PROC_ADDR;
+
+// カーネルが書いている最中 (seq が奇数) なら待ち、読み終わって seq が変わっていたら読み直す
+static inline uint32_t vdso_read_begin(void) {
+    uint32_t seq;
+    while ((seq = vd->seq) & 1) asm volatile("pause");
+    asm volatile("" ::: "memory");
+    return seq;
+}
+
+static inline int vdso_read_retry(uint32_t seq) {
+    asm volatile("" ::: "memory");
+    return vd->seq != seq;
+}
+
+// seq の中で呼ぶ
+static uint64_t vdso_mono_ns(void) {
+    if (!vd->tsc_ok) return (uint64_t)vd->ticks * TICK_NSEC;
+    return mul_u64_u32_shr(rdtsc() - vd->tsc_base, vd->tsc_mult, (int)vd->tsc_shift);
+}
+
+uint32_t vdso_ticks(void) {
+    return vd->ticks;   // 32bit の1回の読み込みは割れない
+}
+
+// 起動からの単調増加ナノ秒 (カーネルの ktime_get_ns と同じ値)
+uint64_t vdso_clock_ns(void) {
+    uint64_t ns;
+    uint32_t seq;
+    do {
+        seq = vdso_read_begin();
+        ns  = vdso_mono_ns();
+    } while (vdso_read_retry(seq));
+    return ns;
+}
+
+int vdso_clock_gettime(int clk, timespec_t* ts) {
+    if (clk != CLOCK_REALTIME && clk != CLOCK_MONOTONIC) return -EINVAL;
+    uint64_t ns;
+    uint32_t seq;
+    do {
+        seq = vdso_read_begin();
+        ns  = vdso_mono_ns();
+        if (clk == CLOCK_REALTIME) ns += vd->boot_epoch_ns;
+    } while (vdso_read_retry(seq));
+    uint32_t rem;
+    ts->tv_sec  = (int32_t)div_u64_rem(ns, NSEC_PER_SEC, &rem);
+    ts->tv_nsec = (int32_t)rem;
+    return 0;
+}
+
+// CLONE_VM のスレッドがいると pid はスレッドごとなので、システムコールに任せる
+pid_t vdso_getpid(void) {
+    if (!vp->shared) return vp->pid;
+    int32_t ret;
+    asm volatile("call __syscall" : "=a"(ret) : "a"(SYS_GETPID) : "memory");
+    return ret;
+}
+
+// データのページ全体の、ある時点でそろった写し (全体の数を読む)
+void vdso_snapshot(vdso_data_t* out) {
+    uint32_t seq;
+    do {
+        seq = vdso_read_begin();
+        const uint32_t* s = (const uint32_t*)vd;
+        uint32_t* d = (uint32_t*)out;
+        for (uint32_t i = 0; i < sizeof(vdso_data_t) / 4; i++) d[i] = s[i];
+    } while (vdso_read_retry(seq));
+}
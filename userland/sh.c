@@ -3,6 +3,11 @@
 #include "../include/kernel/vfs.h"
 #include "../include/kernel/proc.h"
 #include "../include/kernel/mm.h"
+#include "../include/kernel/time.h"
+#include "../include/kernel/kthread.h"
+#include "../include/kernel/ipc.h"
+#include "../include/kernel/gthread.h"
+#include "../include/kernel/async.h"
 
 // libc関数プロトタイプ
 extern size_t strlen(const char* s);
@@ -31,12 +36,12 @@ extern void   tty_puts(const char* s);
 extern void   tty_putchar(char c);
 extern int    isspace(int c);
 extern pid_t  proc_wait(pid_t pid, int* status);
-extern process_t* proc_fork(void);
 extern int    file_readdir(file_t* f, uint32_t index, char* name);
 extern file_t* file_open(const char* path, int flags);
 extern int    file_close(file_t* f);
 extern vnode_t* vfs_lookup(const char* path);
-extern process_t* current_proc;
+extern int    getrusage(int who, rusage_t* usage);
+extern int    sched_yield(void);
 
 #define MAX_ARGS 32
 #define MAX_LINE 512
@@ -74,7 +79,7 @@ static int cmd_cat(int argc, char** argv) {
 
 // ls: ディレクトリ一覧
 static int cmd_ls(int argc, char** argv) {
-    const char* path = (argc >= 2) ? argv[1] : current_proc->cwd;
+    const char* path = (argc >= 2) ? argv[1] : current_proc->cold->fs->cwd;
 
     vnode_t* dir = vfs_lookup(path);
     if (!dir) { printf("ls: %s: No such directory\n", path); return 1; }
@@ -106,7 +111,7 @@ static int cmd_ls(int argc, char** argv) {
 // pwd: 現在ディレクトリ
 static int cmd_pwd(int argc, char** argv) {
     (void)argc; (void)argv;
-    printf("%s\n", current_proc->cwd);
+    printf("%s\n", current_proc->cold->fs->cwd);
     return 0;
 }
 
@@ -119,16 +124,16 @@ static int cmd_cd(int argc, char** argv) {
         return 1;
     }
     if (path[0] == '/') {
-        strncpy(current_proc->cwd, path, sizeof(current_proc->cwd)-1);
+        strncpy(current_proc->cold->fs->cwd, path, sizeof(current_proc->cold->fs->cwd)-1);
     } else {
-        char* cwd = current_proc->cwd;
+        char* cwd = current_proc->cold->fs->cwd;
         if (cwd[strlen(cwd)-1] != '/') strcat(cwd, "/");
         strcat(cwd, path);
     }
     // 末尾スラッシュ除去 (root以外)
-    size_t len = strlen(current_proc->cwd);
-    if (len > 1 && current_proc->cwd[len-1] == '/')
-        current_proc->cwd[len-1] = 0;
+    size_t len = strlen(current_proc->cold->fs->cwd);
+    if (len > 1 && current_proc->cold->fs->cwd[len-1] == '/')
+        current_proc->cold->fs->cwd[len-1] = 0;
     return 0;
 }
 
@@ -140,7 +145,7 @@ static int cmd_mkdir(int argc, char** argv) {
         const char* path = argv[i];
         char parent_path[MAX_PATH];
         const char* slash = strrchr(path, '/');
-        if (!slash) { strcpy(parent_path, current_proc->cwd); slash = path - 1; }
+        if (!slash) { strcpy(parent_path, current_proc->cold->fs->cwd); slash = path - 1; }
         else {
             size_t plen = slash - path;
             memcpy(parent_path, path, plen); parent_path[plen] = 0;
@@ -163,7 +168,7 @@ static int cmd_rm(int argc, char** argv) {
         const char* path = argv[i];
         char parent_path[MAX_PATH];
         const char* slash = strrchr(path, '/');
-        if (!slash) { strcpy(parent_path, current_proc->cwd); slash = path - 1; }
+        if (!slash) { strcpy(parent_path, current_proc->cold->fs->cwd); slash = path - 1; }
         else {
             size_t plen = slash - path;
             memcpy(parent_path, path, plen); parent_path[plen] = 0;
@@ -200,12 +205,12 @@ static int cmd_uname(int argc, char** argv) {
 // ps: プロセス一覧
 static int cmd_ps(int argc, char** argv) {
     (void)argc; (void)argv;
-    extern process_t proc_table[];
-    printf("  PID  PPID  STATE   NAME\n");
-    printf("--------------------------------\n");
-    for (int i = 0; i < MAX_PROCS; i++) {
-        process_t* p = &proc_table[i];
-        if (p->state == PROC_UNUSED) continue;
+    printf("  PID  PPID  STATE  CPU  CLS   NI  NAME\n");
+    printf("------------------------------------------\n");
+    read_lock(&tasklist_lock);
+    for (int i = 0; i < proc_table_size; i++) {
+        process_t* p = proc_table[i];
+        if (!p || p->state == PROC_UNUSED) continue;
         const char* state_str = "?";
         switch (p->state) {
             case PROC_RUNNING:  state_str = "RUN  "; break;
@@ -215,28 +220,331 @@ static int cmd_ps(int argc, char** argv) {
             case PROC_SLEEPING: state_str = "SLEEP"; break;
             default: break;
         }
-        printf("  %3d  %4d  %s  %s\n", p->pid, p->ppid, state_str, p->name);
+        if (p->policy == SCHED_DEADLINE) {
+            printf("  %3d  %4d  %s  %3d  DL     -  %s (miss %u, throttled %u)\n",
+                   p->pid, p->ppid, state_str, p->cpu, p->name, p->dl_misses, p->dl_throttles);
+            continue;
+        }
+        printf("  %3d  %4d  %s  %3d  TS   %3d  %s\n",
+               p->pid, p->ppid, state_str, p->cpu, p->nice, p->name);
+    }
+    read_unlock(&tasklist_lock);
+    return 0;
+}
+
+// lockstat: ロッククラスごとの競合と保持時間 ("lockstat reset" で0に戻す)
+static uint32_t cycles_to_us(uint64_t cycles) {
+    uint32_t khz = tsc_get_khz();
+    if (!khz) return 0;
+    return (uint32_t)div_u64_rem(cycles * 1000, khz, NULL);
+}
+
+static int cmd_lockstat(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        lock_stat_reset();
+        return 0;
+    }
+    printf("       ACQ      CONT   WAIT(us)   HOLD(us)    MAX(us)  CLASS\n");
+    printf("---------------------------------------------------------------\n");
+    for (lock_class_t* c = lock_classes; c; c = c->next) {
+        printf("  %8u  %8u  %9u  %9u  %9u  %s\n", c->acquired, c->contended,
+               cycles_to_us(c->wait_cycles), cycles_to_us(c->hold_cycles),
+               cycles_to_us(c->max_hold), c->name);
+    }
+    if (!lock_stat_enabled) printf("  (no TSC: times not recorded)\n");
+    return 0;
+}
+
+// bench: プロセス表の走査とコンテキストスイッチのコスト (TSC サイクル)
+#define BENCH_ENTRIES  512
+#define BENCH_ROUNDS   100
+#define BENCH_PINGPONG 10000
+// 分割前の process_t (840 バイト、state と vruntime が別のキャッシュライン)
+#define LEGACY_STRIDE        840
+#define LEGACY_STATE_OFF     8
+#define LEGACY_VRUNTIME_OFF  96
+
+// cold=1 ならキャッシュを全部捨ててから測る
+static uint32_t bench_scan(const uint8_t* base, uint32_t stride, uint32_t state_off,
+                           uint32_t vrt_off, int cold) {
+    uint64_t total = 0;
+    volatile uint32_t sink = 0;
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        if (cold) asm volatile("wbinvd" ::: "memory");
+        uint64_t t0 = rdtsc();
+        for (int i = 0; i < BENCH_ENTRIES; i++) {
+            const uint8_t* e = base + i * stride;
+            // pick_next 相当: 状態と vruntime を両方読む
+            sink += *(const uint32_t*)(e + state_off) +
+                    (uint32_t)*(const uint64_t*)(e + vrt_off);
+        }
+        total += rdtsc() - t0;
+    }
+    (void)sink;
+    return (uint32_t)div_u64_rem(total, BENCH_ROUNDS * BENCH_ENTRIES, NULL);
+}
+
+static volatile int      bench_turn;
+static wait_queue_head_t bench_wq[2];
+
+static int bench_partner(void* arg) {
+    (void)arg;
+    while (!kthread_should_stop()) {
+        wait_event(bench_wq[1], bench_turn == 1 || kthread_should_stop());
+        bench_turn = 0;
+        wake_up(&bench_wq[0]);
+    }
+    return 0;
+}
+
+// IPC の相手: w[0] に1を足して返す。w[0] == 0 が来たら返事をして終わる
+static int bench_ipc_server(void* arg) {
+    (void)arg;
+    ipc_msg_t msg, reply;
+    pid_t from = ipc_reply_wait(0, NULL, &msg);
+    while (from > 0) {
+        reply = msg;
+        reply.w[0]++;
+        if (msg.w[0] == 0) {
+            ipc_reply(from, &reply);
+            break;
+        }
+        from = ipc_reply_wait(from, &reply, &msg);
+    }
+    return 0;
+}
+
+// グリーンスレッド: たくさん作ってそれぞれ何回か譲り合う
+#define BENCH_GT_THREADS 2000
+#define BENCH_GT_YIELDS  10
+
+static void bench_gt_fn(void* arg) {
+    (void)arg;
+    for (int i = 0; i < BENCH_GT_YIELDS; i++) gt_yield();
+}
+
+// 非同期タスク: 同じ数を作って、それぞれ同じ回数だけ実行キューに回し直す
+#define BENCH_ASYNC_TASKS 2000
+
+static int bench_async_fn(async_task_t* t) {
+    return ++t->step > BENCH_GT_YIELDS ? ASYNC_DONE : ASYNC_AGAIN;
+}
+
+static int cmd_bench(int argc, char** argv) {
+    (void)argc; (void)argv;
+    printf("process_t %u bytes (hot %u), proc_cold_t %u bytes\n",
+           (uint32_t)sizeof(process_t),
+           (uint32_t)__builtin_offsetof(process_t, dl_node),
+           (uint32_t)sizeof(proc_cold_t));
+
+    // 同じ数のエントリを今の並びと分割前の並びで置いて state/vruntime だけ読む
+    uint8_t* compact_mem = (uint8_t*)kmalloc(BENCH_ENTRIES * sizeof(process_t) + CACHE_LINE);
+    uint8_t* legacy      = (uint8_t*)kmalloc(BENCH_ENTRIES * LEGACY_STRIDE);
+    if (!compact_mem || !legacy) {
+        printf("bench: out of memory\n");
+        kfree(compact_mem);
+        kfree(legacy);
+        return 1;
+    }
+    uint8_t* compact = (uint8_t*)(((uint32_t)compact_mem + CACHE_LINE - 1) & ~(CACHE_LINE - 1));
+    memset(compact, 0, BENCH_ENTRIES * sizeof(process_t));
+    memset(legacy,  0, BENCH_ENTRIES * LEGACY_STRIDE);
+
+    uint32_t so = __builtin_offsetof(process_t, state);
+    uint32_t vo = __builtin_offsetof(process_t, vruntime);
+    printf("scan (cycles/entry, %d entries)   warm   cold\n", BENCH_ENTRIES);
+    printf("  compact process_t            %6u %6u\n",
+           bench_scan(compact, sizeof(process_t), so, vo, 0),
+           bench_scan(compact, sizeof(process_t), so, vo, 1));
+    printf("  legacy 840-byte stride       %6u %6u\n",
+           bench_scan(legacy, LEGACY_STRIDE, LEGACY_STATE_OFF, LEGACY_VRUNTIME_OFF, 0),
+           bench_scan(legacy, LEGACY_STRIDE, LEGACY_STATE_OFF, LEGACY_VRUNTIME_OFF, 1));
+    kfree(compact_mem);
+    kfree(legacy);
+
+    // 待ちキューで交互に起こし合う: 1往復 = 切り替え2回 + 起床2回
+    init_waitqueue_head(&bench_wq[0]);
+    init_waitqueue_head(&bench_wq[1]);
+    bench_turn = 0;
+    process_t* partner = kthread_create(bench_partner, NULL, "bench");
+    if (!partner) { printf("bench: cannot create thread\n"); return 1; }
+
+    uint64_t t0 = rdtsc();
+    for (int i = 0; i < BENCH_PINGPONG; i++) {
+        bench_turn = 1;
+        wake_up(&bench_wq[1]);
+        wait_event(bench_wq[0], bench_turn == 0);
     }
+    uint64_t dt = rdtsc() - t0;
+
+    int partner_cpu = partner->cpu;
+    pid_t pid = partner->pid;
+    kthread_stop(partner);
+    wake_up(&bench_wq[1]);
+    proc_wait(pid, NULL);
+
+    printf("switch: %u cycles/round trip (cpu %d <-> cpu %d)\n",
+           (uint32_t)div_u64_rem(dt, BENCH_PINGPONG, NULL),
+           smp_processor_id(), partner_cpu);
+
+    // 同期 IPC: 受け手へ直接切り替えるので実行キューを通らない
+    process_t* server = kthread_create(bench_ipc_server, NULL, "ipcbench");
+    if (!server) { printf("bench: cannot create thread\n"); return 1; }
+    pid = server->pid;
+    ipc_msg_t msg, reply;
+    memset(&msg, 0, sizeof(msg));
+    int err = 0;
+    uint64_t ns0 = ktime_get_ns();
+    t0 = rdtsc();
+    for (int i = 0; i < BENCH_PINGPONG && !err; i++) {
+        msg.w[0] = (uint32_t)i + 1;
+        if (ipc_call(pid, &msg, &reply) < 0 || reply.w[0] != msg.w[0] + 1) err = 1;
+    }
+    dt = rdtsc() - t0;
+    uint64_t ns = ktime_get_ns() - ns0;
+    msg.w[0] = 0;
+    ipc_call(pid, &msg, &reply);
+    partner_cpu = server->cpu;
+    proc_wait(pid, NULL);
+    if (err) {
+        printf("ipc: call failed\n");
+        return 1;
+    }
+    printf("ipc:    %u cycles/round trip, %u ns (cpu %d <-> cpu %d)\n",
+           (uint32_t)div_u64_rem(dt, BENCH_PINGPONG, NULL),
+           (uint32_t)div_u64_rem(ns, BENCH_PINGPONG, NULL),
+           smp_processor_id(), partner_cpu);
+
+    // グリーンスレッド: 作成から全員の終了まで (ワーカー2つ)
+    if (gt_init(2, 1) < 0) { printf("bench: cannot start gthreads\n"); return 1; }
+    int spawned = 0;
+    t0 = rdtsc();
+    for (; spawned < BENCH_GT_THREADS; spawned++)
+        if (!gt_spawn(bench_gt_fn, NULL)) break;
+    gt_shutdown();
+    dt = rdtsc() - t0;
+    if (!spawned) return 1;
+    printf("gthread: %d threads x %d yields, %u cycles/yield\n", spawned, BENCH_GT_YIELDS,
+           (uint32_t)div_u64_rem(dt, (uint32_t)spawned * (BENCH_GT_YIELDS + 1), NULL));
+
+    // 非同期タスク: 作成から全部の終了まで (kasync スレッド1本)
+    uint32_t base = async_nr_tasks();
+    spawned = 0;
+    t0 = rdtsc();
+    for (; spawned < BENCH_ASYNC_TASKS; spawned++) {
+        async_task_t* t = async_create(bench_async_fn, NULL);
+        if (!t) break;
+        async_spawn(t);
+    }
+    while (async_nr_tasks() > base) sched_yield();
+    dt = rdtsc() - t0;
+    if (!spawned) return 1;
+    printf("async:  %d tasks x %d steps, %u cycles/step (%u bytes/task)\n", spawned, BENCH_GT_YIELDS,
+           (uint32_t)div_u64_rem(dt, (uint32_t)spawned * (BENCH_GT_YIELDS + 1), NULL),
+           (uint32_t)sizeof(async_task_t));
     return 0;
 }
 
+// time: コマンドの経過時間・TSC サイクルと資源使用量
+// 組み込みコマンドはシェル自身で、/bin のプログラムは子で走るので、自分と回収した子の増分を出す
+static int run_command(int argc, char** argv, int bg);
+
+static void print_u64(uint64_t v) {
+    uint32_t lo;
+    uint32_t hi = (uint32_t)div_u64_rem(v, 1000000000u, &lo);
+    if (hi) printf("%u%09u", hi, lo);
+    else    printf("%u", lo);
+}
+
+static uint64_t tv_to_us(const timeval_t* tv) {
+    return (uint64_t)(uint32_t)tv->tv_sec * 1000000 + (uint32_t)tv->tv_usec;
+}
+
+// 自分と子の合計
+static void rusage_total(rusage_t* ru) {
+    rusage_t c;
+    getrusage(RUSAGE_SELF, ru);
+    getrusage(RUSAGE_CHILDREN, &c);
+    uint64_t ut = tv_to_us(&ru->ru_utime) + tv_to_us(&c.ru_utime);
+    uint64_t st = tv_to_us(&ru->ru_stime) + tv_to_us(&c.ru_stime);
+    uint32_t rem;
+    ru->ru_utime.tv_sec  = (int32_t)div_u64_rem(ut, 1000000, &rem);
+    ru->ru_utime.tv_usec = (int32_t)rem;
+    ru->ru_stime.tv_sec  = (int32_t)div_u64_rem(st, 1000000, &rem);
+    ru->ru_stime.tv_usec = (int32_t)rem;
+    ru->ru_minflt += c.ru_minflt;
+    ru->ru_majflt += c.ru_majflt;
+    ru->ru_nvcsw  += c.ru_nvcsw;
+    ru->ru_nivcsw += c.ru_nivcsw;
+}
+
+static void print_us(const char* label, uint64_t us) {
+    uint32_t rem;
+    uint32_t sec = (uint32_t)div_u64_rem(us, 1000000, &rem);
+    printf("%s %u.%06us\n", label, sec, rem);
+}
+
+static int cmd_time(int argc, char** argv) {
+    if (argc < 2) { printf("time: usage: time <command> [args...]\n"); return 1; }
+
+    rusage_t r0, r1;
+    rusage_total(&r0);
+    uint64_t rchar0 = current_proc->rchar + current_proc->cacct.rchar;
+    uint64_t wchar0 = current_proc->wchar + current_proc->cacct.wchar;
+    uint64_t ns0 = ktime_get_ns();
+    uint64_t c0  = rdtsc();
+
+    int ret = run_command(argc - 1, argv + 1, 0);
+
+    uint64_t c1  = rdtsc();
+    uint64_t ns1 = ktime_get_ns();
+    rusage_total(&r1);
+    uint64_t rchar1 = current_proc->rchar + current_proc->cacct.rchar;
+    uint64_t wchar1 = current_proc->wchar + current_proc->cacct.wchar;
+    if (ret < 0) { printf("time: %s: command not found\n", argv[1]); return 1; }
+
+    printf("\n");
+    print_us("real  ", div_u64_rem(ns1 - ns0, NSEC_PER_USEC, NULL));
+    print_us("user  ", tv_to_us(&r1.ru_utime) - tv_to_us(&r0.ru_utime));
+    print_us("sys   ", tv_to_us(&r1.ru_stime) - tv_to_us(&r0.ru_stime));
+    printf("cycles ");
+    print_u64(c1 - c0);
+    printf("\n");
+    printf("csw    %u voluntary, %u involuntary\n",
+           (uint32_t)(r1.ru_nvcsw - r0.ru_nvcsw), (uint32_t)(r1.ru_nivcsw - r0.ru_nivcsw));
+    printf("faults %u minor, %u major\n",
+           (uint32_t)(r1.ru_minflt - r0.ru_minflt), (uint32_t)(r1.ru_majflt - r0.ru_majflt));
+    printf("io     ");
+    print_u64(rchar1 - rchar0);
+    printf(" bytes read, ");
+    print_u64(wchar1 - wchar0);
+    printf(" bytes written\n");
+    return ret;
+}
+
 // help: コマンド一覧
 static int cmd_help(int argc, char** argv) {
     (void)argc; (void)argv;
     tty_puts("MyOS Shell コマンド一覧:\n");
+    tty_puts("  bench           - プロセス表走査・切り替えのコスト\n");
     tty_puts("  cat [file...]   - ファイル内容を表示\n");
     tty_puts("  cd [dir]        - ディレクトリ移動\n");
     tty_puts("  echo [args...]  - テキスト表示\n");
     tty_puts("  exit [code]     - シェル終了\n");
     tty_puts("  help            - このヘルプ\n");
+    tty_puts("  jobs            - バックグラウンドジョブ一覧\n");
+    tty_puts("  lockstat [reset]- ロックの競合統計\n");
     tty_puts("  ls [dir]        - ディレクトリ一覧\n");
     tty_puts("  mkdir <dir>     - ディレクトリ作成\n");
     tty_puts("  ps              - プロセス一覧\n");
     tty_puts("  pwd             - 現在のディレクトリ\n");
     tty_puts("  rm <file>       - ファイル削除\n");
     tty_puts("  sleep <secs>    - 指定秒スリープ\n");
+    tty_puts("  time <cmd>      - 実行時間と資源使用量\n");
     tty_puts("  uname           - OS情報\n");
+    tty_puts("  wait [%job|pid] - ジョブの終了を待つ\n");
     tty_puts("  write <file>    - テキストをファイルに書く\n");
+    tty_puts("  <cmd> &         - バックグラウンドで実行\n");
     return 0;
 }
 
@@ -277,25 +585,188 @@ static int cmd_write(int argc, char** argv) {
     return 0;
 }
 
+// ===== ジョブ =====
+// '&' で始めたコマンドはジョブとして覚えておき、
+// プロンプトを出す前に終わったものを待たずに回収する
+#define MAX_JOBS 16
+
+typedef struct {
+    pid_t pid;          // 0 なら空き。ジョブ番号は添字 + 1
+    char  cmd[64];
+} job_t;
+
+static job_t jobs[MAX_JOBS];
+
+static int job_add(pid_t pid, int argc, char** argv) {
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (jobs[i].pid) continue;
+        jobs[i].pid = pid;
+        jobs[i].cmd[0] = 0;
+        for (int k = 0; k < argc; k++) {
+            size_t len = strlen(jobs[i].cmd);
+            snprintf(jobs[i].cmd + len, sizeof(jobs[i].cmd) - len, k ? " %s" : "%s", argv[k]);
+        }
+        return i + 1;
+    }
+    return -1;
+}
+
+static void job_done(int i, int status) {
+    printf("[%d]  Done(%d)    %s\n", i + 1, status, jobs[i].cmd);
+    jobs[i].pid = 0;
+}
+
+// 終わったジョブを回収して知らせる (待たない)
+static void jobs_reap(void) {
+    for (int i = 0; i < MAX_JOBS; i++) {
+        if (!jobs[i].pid) continue;
+        int status = 0;
+        pid_t r = proc_wait_nohang(jobs[i].pid, &status);
+        if (r > 0)      job_done(i, status);
+        else if (r < 0) jobs[i].pid = 0;     // もういない
+    }
+}
+
+// jobs: 走っているジョブ
+static int cmd_jobs(int argc, char** argv) {
+    (void)argc; (void)argv;
+    jobs_reap();
+    for (int i = 0; i < MAX_JOBS; i++)
+        if (jobs[i].pid)
+            printf("[%d]  Running  %d  %s\n", i + 1, jobs[i].pid, jobs[i].cmd);
+    return 0;
+}
+
+// wait: 引数なしなら全ジョブ、%n ならジョブ n、数字なら pid を待つ
+static int cmd_wait(int argc, char** argv) {
+    int status = 0;
+    if (argc < 2) {
+        for (int i = 0; i < MAX_JOBS; i++) {
+            if (!jobs[i].pid) continue;
+            if (proc_wait(jobs[i].pid, &status) > 0) job_done(i, status);
+            else jobs[i].pid = 0;
+        }
+        return status;
+    }
+    const char* s = argv[1];
+    int job = (*s == '%');
+    if (job) s++;
+    int n = 0;
+    while (*s >= '0' && *s <= '9') n = n * 10 + (*s++ - '0');
+    pid_t pid = job ? (n >= 1 && n <= MAX_JOBS ? jobs[n - 1].pid : 0) : n;
+    if (!pid || proc_wait(pid, &status) < 0) {
+        printf("wait: %s: no such job\n", argv[1]);
+        return 127;
+    }
+    for (int i = 0; i < MAX_JOBS; i++)
+        if (jobs[i].pid == pid) job_done(i, status);
+    return status;
+}
+
 // ===== コマンドテーブル =====
-typedef struct { const char* name; int (*func)(int, char**); } cmd_entry_t;
+// in_shell のコマンドはシェル自身の状態 (cwd・ジョブ) を変えるのでシェルで走らせる。
+// それ以外は子プロセスで走り、シェルはその間も次の入力やジョブを扱える
+typedef struct { const char* name; int (*func)(int, char**); int in_shell; } cmd_entry_t;
 
 static cmd_entry_t commands[] = {
-    { "cat",   cmd_cat   },
-    { "cd",    cmd_cd    },
-    { "echo",  cmd_echo  },
-    { "help",  cmd_help  },
-    { "ls",    cmd_ls    },
-    { "mkdir", cmd_mkdir },
-    { "ps",    cmd_ps    },
-    { "pwd",   cmd_pwd   },
-    { "rm",    cmd_rm    },
-    { "sleep", cmd_sleep },
-    { "uname", cmd_uname },
-    { "write", cmd_write },
-    { NULL, NULL }
+    { "bench",    cmd_bench,    0 },
+    { "cat",      cmd_cat,      0 },
+    { "cd",       cmd_cd,       1 },
+    { "echo",     cmd_echo,     0 },
+    { "help",     cmd_help,     0 },
+    { "jobs",     cmd_jobs,     1 },
+    { "lockstat", cmd_lockstat, 0 },
+    { "ls",       cmd_ls,       0 },
+    { "mkdir",    cmd_mkdir,    0 },
+    { "ps",       cmd_ps,       0 },
+    { "pwd",      cmd_pwd,      0 },
+    { "rm",       cmd_rm,       0 },
+    { "sleep",    cmd_sleep,    0 },
+    { "time",     cmd_time,     1 },
+    { "uname",    cmd_uname,    0 },
+    { "wait",     cmd_wait,     1 },
+    { "write",    cmd_write,    0 },
+    { NULL, NULL, 0 }
 };
 
+// 子プロセスで走らせる組み込みコマンド。
+// シェルの行バッファは次の入力で上書きされるので引数を写して渡す
+typedef struct {
+    int  (*func)(int, char**);
+    int   argc;
+    char* argv[MAX_ARGS];
+    char  buf[MAX_LINE];
+} cmd_req_t;
+
+static int cmd_child(void* arg) {
+    cmd_req_t* req = (cmd_req_t*)arg;
+    int ret = req->func(req->argc, req->argv);
+    free(req);
+    return ret;
+}
+
+static pid_t spawn_builtin(cmd_entry_t* c, int argc, char** argv) {
+    cmd_req_t* req = (cmd_req_t*)malloc(sizeof(cmd_req_t));
+    if (!req) return -ENOMEM;
+    req->func = c->func;
+    req->argc = argc;
+    size_t off = 0;
+    for (int i = 0; i < argc; i++) {
+        size_t n = strlen(argv[i]) + 1;
+        memcpy(req->buf + off, argv[i], n);
+        req->argv[i] = req->buf + off;
+        off += n;
+    }
+    req->argv[argc] = NULL;
+    pid_t pid = proc_spawn_fn(cmd_child, req, c->name);
+    if (pid < 0) free(req);
+    return pid;
+}
+
+// 組み込みコマンドか /bin (または '/' で始まるパス) の ELF を子プロセスで動かす。
+// bg なら待たずにジョブにする。見つからなければ -1
+static int run_command(int argc, char** argv, int bg) {
+    pid_t pid = -ENOENT;
+    for (int i = 0; commands[i].name; i++) {
+        if (strcmp(argv[0], commands[i].name) != 0) continue;
+        if (commands[i].in_shell) return commands[i].func(argc, argv);
+        pid = spawn_builtin(&commands[i], argc, argv);
+        if (pid < 0) { printf("sh: %s: cannot create process\n", argv[0]); return 1; }
+        break;
+    }
+    if (pid == -ENOENT) {
+        char path[VFS_PATH_LEN];
+        if (argv[0][0] == '/') snprintf(path, sizeof(path), "%s", argv[0]);
+        else                   snprintf(path, sizeof(path), "/bin/%s", argv[0]);
+        pid = proc_spawn(path, argv);
+        if (pid < 0) return -1;
+    }
+
+    if (bg) {
+        int job = job_add(pid, argc, argv);
+        if (job < 0) {
+            // ジョブ表が一杯: 覚えておけないので待つ
+            printf("sh: too many jobs, waiting for %d\n", pid);
+        } else {
+            printf("[%d] %d\n", job, pid);
+            return 0;
+        }
+    }
+    int status = 0;
+    proc_wait(pid, &status);
+    return status;
+}
+
+// 行末の '&' (単独でも "cmd&" でも) を取り除く。あればバックグラウンド
+static int strip_background(int* argc, char** argv) {
+    char* last = argv[*argc - 1];
+    size_t len = strlen(last);
+    if (last[len - 1] != '&') return 0;
+    if (len == 1) argv[--*argc] = NULL;
+    else          last[len - 1] = 0;
+    return 1;
+}
+
 // ===== コマンドライン解析 =====
 static int parse_args(char* line, char** argv) {
     int argc = 0;
@@ -328,8 +799,10 @@ void shell_main(void) {
     tty_puts(" MyOS Shell v1.0 - type 'help' for commands\n\n");
 
     while (1) {
+        jobs_reap();
+
         // プロンプト表示
-        printf("\033[1;32mroot@myos\033[0m:\033[1;34m%s\033[0m$ ", current_proc->cwd);
+        printf("\033[1;32mroot@myos\033[0m:\033[1;34m%s\033[0m$ ", current_proc->cold->fs->cwd);
 
         int n = tty_readline(line, sizeof(line));
         if (n < 0) continue;   // Ctrl+C
@@ -351,16 +824,11 @@ void shell_main(void) {
             return;
         }
 
-        // 組み込みコマンド検索
-        int found = 0;
-        for (int i = 0; commands[i].name; i++) {
-            if (strcmp(argv[0], commands[i].name) == 0) {
-                commands[i].func(argc, argv);
-                found = 1;
-                break;
-            }
-        }
-        if (!found) {
+        int bg = strip_background(&argc, argv);
+        if (argc == 0) continue;
+
+        // 組み込みコマンド → /bin
+        if (run_command(argc, argv, bg) < 0) {
             printf("sh: %s: command not found\n", argv[0]);
         }
     }